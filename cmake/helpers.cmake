@@ -79,15 +79,9 @@ endmacro (add_tgt_dir_dep_lib)
 
 macro (add_tgt_dir_dep_exe NAME)
   if (CSKEL_FLAT_LAYOUT)
-    add_tgt_dir_once(include)
-    add_tgt_dir_once(src)
-    add_tgt_dir_once(tests)
-    add_dependencies(${NAME} src)
+    add_tgt_dir_once(src ${NAME})
   else ()
-    add_tgt_dir_once(include/${NAME})
-    add_tgt_dir_once(src/${NAME})
-    add_tgt_dir_once(tests/${NAME})
-    add_dependencies(${NAME} src/${NAME})
+    add_tgt_dir_once(src/${NAME} ${NAME})
   endif ()
 endmacro (add_tgt_dir_dep_exe)
 
@@ -98,13 +92,13 @@ find_package(PythonInterp)
 #[[ msggen ]]
 
 function (msggen file ns outdir)
-  if (NOT Python_FOUND)
+  if (NOT PYTHONINTERP_FOUND)
     message(
       FATAL_ERROR "${CSKEL_PROJ_NAME} Python interpreter not found"
       )
   endif ()
   set(args
-      ${Python_EXECUTABLE}
+      ${PYTHON_EXECUTABLE}
       ${CSKEL_PROJ_ROOT}/py/msggen.py
       gencpp
       --file
@@ -116,7 +110,16 @@ function (msggen file ns outdir)
     )
   string(REPLACE ";" " " cpargs "${args}")
   cskel_info("Running: ${cpargs}")
-  execute_process(COMMAND ${args})
+  execute_process(COMMAND ${args} RESULT_VARIABLE res)
+  if (NOT res EQUAL 0)
+    message(FATAL_ERROR "${CSKEL_PROJ_NAME} msggen failed for ${file}")
+  endif ()
+  # Regenerate when the message file changes
+  set_property(
+    DIRECTORY
+    APPEND
+    PROPERTY CMAKE_CONFIGURE_DEPENDS ${file}
+    )
 endfunction (msggen)
 
 #[[ On Windows, don't rely on SDKs being available ]]
@@ -460,7 +463,8 @@ function (cskel_add_executable)
     "" "${options}" "${one_value}" "${multi_value}" ${ARGN}
     )
 
-  string(TOUPPER "${_NAME}" _UNAME)
+  string(MAKE_C_IDENTIFIER "${_NAME}" _UNAME)
+  string(TOUPPER "${_UNAME}" _UNAME)
   string(REPLACE "." ";" ver_list "${_VERSION}")
 
   list(GET ver_list 0 ver_maj)
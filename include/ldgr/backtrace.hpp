@@ -0,0 +1,170 @@
+//! @file backtrace.hpp
+//! @brief Per-thread ring of suppressed records, dumped on error.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_BACKTRACE_HPP
+#define INCLUDED_LDGR_BACKTRACE_HPP
+
+#include <ldgr/exports.h>
+#include <ldgr/logclock.hpp>
+#include <ldgr/logentry.hpp>
+
+#include <fmt/format.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <tuple>
+#include <type_traits>
+
+namespace ldgr {
+
+namespace dtl {
+
+//! A record captured below its logger's level. Arithmetic arguments are
+//! stored raw and formatted only if the record is ever dumped; anything
+//! else (strings, user types) may not outlive the call, so it is
+//! formatted into `payload` right away, truncated to `payload_size`.
+struct backtrace_record {
+    static constexpr std::size_t payload_size = 128;
+
+    using format_fn = void (*)(log_buffer_t&, fmt::string_view, const void*);
+
+    const void* owner{nullptr}; //!< the capturing logger; null once dumped
+    format_fn format{nullptr};  //!< null when `payload` holds the text
+    const log_site* site;
+    time_point when;
+    std::uint32_t size;
+    alignas(std::max_align_t) unsigned char payload[payload_size];
+};
+
+//! Fixed-size ring of the calling thread's most recent captures, shared
+//! by every logger the thread captures for. Only the owning thread reads
+//! or writes it, so neither side needs locks or atomics.
+class backtrace_ring {
+  public:
+    static constexpr std::size_t capacity = 128;
+
+  private:
+    backtrace_record d_records_[capacity];
+    std::uint64_t d_next_{0};
+
+  public:
+
+    backtrace_record& next() noexcept
+    {
+        return d_records_[d_next_++ % capacity];
+    }
+
+    //! Pass `owner`'s records to `fn`, oldest first, and forget them.
+    template <class FN>
+    void drain(const void* owner, FN&& fn)
+    {
+        const auto n = d_next_ < capacity ? d_next_ : capacity;
+        for (auto seq = d_next_ - n; seq < d_next_; ++seq) {
+            auto& rec = d_records_[seq % capacity];
+            if (rec.owner == owner) {
+                rec.owner = nullptr;
+                fn(static_cast<const backtrace_record&>(rec));
+            }
+        }
+    }
+};
+
+//! The calling thread's ring, allocated on first use if `create` is set.
+//! Null if it does not exist or cannot be allocated.
+LDGR_API backtrace_ring* thread_backtrace_ring(bool create) noexcept;
+
+template <class... ARGS>
+void format_backtrace_args(log_buffer_t& out,
+                           fmt::string_view fmtstr,
+                           const void* payload)
+{
+    const auto& args = *static_cast<const std::tuple<ARGS...>*>(payload);
+    std::apply(
+        [&](const auto&... a) {
+            fmt::vformat_to(
+                std::back_inserter(out), fmtstr, fmt::make_format_args(a...));
+        },
+        args);
+}
+
+//! Whether `ARGS` can be kept raw: plain values small enough to fit.
+template <class... ARGS>
+constexpr bool store_raw_args() noexcept
+{
+    if constexpr ((std::is_arithmetic<ARGS>::value && ...)) {
+        return sizeof(std::tuple<ARGS...>) <= backtrace_record::payload_size;
+    }
+    else {
+        return false;
+    }
+}
+
+template <class... ARGS>
+void capture_backtrace(const void* owner,
+                       const log_site& site,
+                       const ARGS&... args) noexcept
+{
+    auto* ring = thread_backtrace_ring(true);
+    if (!ring) {
+        return;
+    }
+    auto& rec = ring->next();
+    rec.owner = owner;
+    rec.site = &site;
+    rec.when = log_clock::now();
+    if constexpr (store_raw_args<ARGS...>()) {
+        using raw_args = std::tuple<ARGS...>;
+        static_assert(std::is_trivially_destructible<raw_args>::value);
+        ::new (static_cast<void*>(rec.payload)) raw_args(args...);
+        rec.format = &format_backtrace_args<ARGS...>;
+        rec.size = sizeof(raw_args);
+    }
+    else {
+        rec.format = nullptr;
+        rec.size = 0;
+        try {
+            const auto res =
+                fmt::vformat_to_n(reinterpret_cast<char*>(rec.payload),
+                                  backtrace_record::payload_size,
+                                  site.format,
+                                  fmt::make_format_args(args...));
+            rec.size = static_cast<std::uint32_t>(
+                res.size < backtrace_record::payload_size
+                    ? res.size
+                    : backtrace_record::payload_size);
+        }
+        catch (...) {
+            rec.owner = nullptr; // a bad argument; drop the record
+        }
+    }
+}
+
+} // namespace dtl
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_BACKTRACE_HPP*/
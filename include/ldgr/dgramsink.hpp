@@ -0,0 +1,97 @@
+//! @file dgramsink.hpp
+//! @brief Datagram log sink.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_DGRAMSINK_HPP
+#define INCLUDED_LDGR_DGRAMSINK_HPP
+
+#include <ldgr/exports.h>
+#include <ldgr/logsink.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ldgr {
+
+struct dgram_sink_config {
+    //! Most records sent per `sendmmsg` call. A record logged while
+    //! nothing is queued goes out at once; records queued behind a full
+    //! socket are retried once a batch has built up, or on a flush.
+    std::size_t batch{16};
+    //! Records kept for retry while the socket would block. Beyond this the
+    //! oldest queued records are dropped, so logging never blocks.
+    std::size_t max_queued{1024};
+};
+
+struct dgram_sink_stats {
+    std::size_t sent;    //!< records handed to the socket
+    std::size_t dropped; //!< records lost to a full queue or a send error
+    std::size_t batches; //!< successful `sendmmsg` calls
+    std::size_t retries; //!< sends deferred because the socket was full
+};
+
+//! Sink shipping each record as one datagram over a connected Unix
+//! datagram socket, e.g. `/dev/log` (with `syslog_formatter`) or
+//! `/run/systemd/journal/socket` (with `journald_formatter`). The socket is
+//! non-blocking: when the collector falls behind, records wait in a bounded
+//! queue and are retried on the next log call or flush.
+class LDGR_API unix_dgram_sink final : public log_sink {
+    struct impl;
+    std::unique_ptr<impl> d_impl_;
+    mutable dtl::sink_mutex d_mutex_;
+
+    explicit unix_dgram_sink(std::unique_ptr<impl> impl) noexcept;
+
+    void do_log(const log_buffer_t& buff) override;
+    void do_flush() override;
+    void do_emergency_flush() noexcept override;
+
+  public:
+    //! Connect to the collector listening on `path`. Throws
+    //! `std::system_error` if the socket cannot be created or connected.
+    static std::shared_ptr<unix_dgram_sink>
+    create(const std::string& path,
+           log_formatter::format_fn format = &syslog_formatter,
+           const dgram_sink_config& config = dgram_sink_config{});
+
+    ~unix_dgram_sink() override;
+
+    //! Records waiting to be sent.
+    std::size_t queued() const noexcept;
+
+    dgram_sink_stats stats() const noexcept;
+
+    std::uint64_t dropped_records() const noexcept override
+    {
+        return stats().dropped;
+    }
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_DGRAMSINK_HPP*/
@@ -33,6 +33,7 @@
 
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <ctime>
 #include <memory>
 #include <string>
@@ -43,7 +44,9 @@ namespace ldgr {
 template <std::size_t SIZE>
 using buffer_t = fmt::basic_memory_buffer<char, SIZE>;
 
-using log_buffer_t = buffer_t<1024>;
+constexpr std::size_t log_buffer_inline_size = 1024;
+
+using log_buffer_t = buffer_t<log_buffer_inline_size>;
 
 template <class INT, int POW>
 constexpr INT pow10()
@@ -59,6 +62,14 @@ constexpr INT pow10()
     }
 }
 
+//! Sub-second digits a timestamp is rendered with.
+enum class time_precision : std::size_t {
+    seconds = 0,
+    milliseconds = 3,
+    microseconds = 6,
+    nanoseconds = 9,
+};
+
 struct fmtutil {
     template <std::size_t PREC, class INT, std::size_t SIZE>
     static constexpr buffer_t<SIZE>&
@@ -83,29 +94,31 @@ struct fmtutil {
         return dest;
     }
 
+    //! Append `n` as exactly `PREC` zero-padded digits. The digits are
+    //! split at compile time, so any width renders without branches.
     template <std::size_t PREC, class INT, std::size_t SIZE>
     static constexpr buffer_t<SIZE>& append_pad_int(buffer_t<SIZE>& dest,
                                                     INT n)
     {
-        auto sz = dest.size();
-        if constexpr (PREC == 0) {
-            static_cast<void>(dest);
-        }
-        else if constexpr (PREC == 1) {
-            dest.resize(dest.size() + 1);
-            append_pad_int_<1, INT, SIZE>(dest, n, &dest[sz]);
-        }
-        else if constexpr (PREC == 2) {
-            dest.resize(dest.size() + 2);
-            append_pad_int_<2, INT, SIZE>(dest, n, &dest[sz]);
+        if constexpr (PREC != 0) {
+            const auto sz = dest.size();
+            dest.resize(sz + PREC);
+            append_pad_int_<PREC, INT, SIZE>(dest, n, &dest[sz]);
         }
-        else {
-            constexpr auto div = pow10<INT, PREC / 2>();
-            dest.resize(dest.size() + PREC);
-            append_pad_int_<PREC - (PREC / 2), INT, SIZE>(
-                dest, n / div, &dest[sz]);
-            sz += (PREC - (PREC / 2));
-            append_pad_int_<PREC / 2, INT, SIZE>(dest, n % div, &dest[sz]);
+        return dest;
+    }
+
+    //! Append `.` and the leading digits of `nanos`, a sub-second count in
+    //! [0, 1e9), at `PREC`; whole-second precision appends nothing.
+    template <time_precision PREC, std::size_t SIZE>
+    static constexpr buffer_t<SIZE>& append_fraction(buffer_t<SIZE>& dest,
+                                                     long nanos)
+    {
+        constexpr auto digits = static_cast<std::size_t>(PREC);
+        if constexpr (digits != 0) {
+            append(dest, '.');
+            append_pad_int<digits>(
+                dest, nanos / pow10<long, 9 - static_cast<int>(digits)>());
         }
         return dest;
     }
@@ -135,25 +148,35 @@ struct fmtutil {
         return append_pad_int<2>(dest, val.tm_sec);
     }
 
-    template <std::size_t SIZE, class CLOCK, class DUR>
+    template <time_precision PREC = time_precision::microseconds,
+              std::size_t SIZE,
+              class CLOCK,
+              class DUR>
     static constexpr buffer_t<SIZE>&
     append(buffer_t<SIZE>& dest,
            const std::chrono::time_point<CLOCK, DUR>& val,
            bool local_time = false)
     {
-        return append(dest, val.time_since_epoch(), local_time);
+        return append<PREC>(dest, val.time_since_epoch(), local_time);
     }
 
-    template <std::size_t SIZE, class REP, class PER>
+    //! Append `dur`, taken as time since the epoch, as a timestamp with
+    //! `PREC` sub-second digits. Any period converts exactly; times before
+    //! the epoch round down to the previous whole second.
+    template <time_precision PREC = time_precision::microseconds,
+              std::size_t SIZE,
+              class REP,
+              class PER>
     static constexpr buffer_t<SIZE>&
     append(buffer_t<SIZE>& dest,
            const std::chrono::duration<REP, PER>& dur,
            bool local_time = false)
     {
         namespace chr = std::chrono;
-        auto ct = dur.count();
-        auto time = static_cast<std::time_t>(ct / 1000000);
-        auto micros = ct % 1000000;
+        const auto secs = chr::floor<chr::seconds>(dur);
+        const auto nanos =
+            chr::duration_cast<chr::nanoseconds>(dur - secs).count();
+        auto time = static_cast<std::time_t>(secs.count());
         std::tm tm_val{};
         if (local_time) {
             ::localtime_r(&time, &tm_val);
@@ -162,8 +185,7 @@ struct fmtutil {
             ::gmtime_r(&time, &tm_val);
         }
         append(dest, tm_val);
-        append(dest, '.');
-        append_pad_int<6>(dest, micros);
+        append_fraction<PREC>(dest, static_cast<long>(nanos));
         if (!local_time) {
             append(dest, 'Z');
         }
@@ -278,6 +300,12 @@ struct fmtutil {
         return v;
     }
 
+    //! Offset of `trunc_file(v)` within `v`.
+    static constexpr std::uint32_t trunc_file_offset(const fmt::string_view& v)
+    {
+        return static_cast<std::uint32_t>(v.size() - trunc_file(v).size());
+    }
+
     static constexpr fmt::string_view to_view(log_severity sev)
     {
         switch (sev) {
@@ -0,0 +1,81 @@
+//! @file logclock.hpp
+//! @brief Record timestamp clock, optionally TSC-based.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_LOGCLOCK_HPP
+#define INCLUDED_LDGR_LOGCLOCK_HPP
+
+#include <ldgr/exports.h>
+
+#include <atomic>
+#include <chrono>
+
+namespace ldgr {
+
+namespace dtl {
+
+inline std::atomic<bool> s_use_tsc{false};
+
+//! `system_clock` time derived from the TSC and the current calibration.
+LDGR_API std::chrono::system_clock::time_point tsc_now() noexcept;
+
+} // namespace dtl
+
+//! The clock log statements timestamp records with. By default this is
+//! `system_clock::now()`. With `use_tsc(true)` it reads the CPU's invariant
+//! time stamp counter instead, and turns ticks into `system_clock` time
+//! with a multiply and a shift. The conversion is re-anchored to
+//! `system_clock` about once a second, on whichever call first notices the
+//! calibration is due, so it follows NTP slewing and steps within a second.
+//! Like `system_clock`, it is not monotonic across such adjustments.
+struct log_clock {
+    static std::chrono::system_clock::time_point now() noexcept
+    {
+        return dtl::s_use_tsc.load(std::memory_order_relaxed)
+                   ? dtl::tsc_now()
+                   : std::chrono::system_clock::now();
+    }
+
+    //! Whether the TSC is usable: x86-64 with an invariant TSC that (on
+    //! Linux) the kernel itself trusts as its clock source.
+    LDGR_API static bool tsc_available() noexcept;
+
+    //! Switch to the TSC, or back to `system_clock`. Enabling spends a few
+    //! milliseconds on the first calibration; it returns false and stays
+    //! on `system_clock` if the TSC is not available.
+    LDGR_API static bool use_tsc(bool enable) noexcept;
+
+    static bool using_tsc() noexcept
+    {
+        return dtl::s_use_tsc.load(std::memory_order_relaxed);
+    }
+
+    //! Re-anchor the TSC to `system_clock` now, e.g. after a clock step.
+    LDGR_API static void recalibrate() noexcept;
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_LOGCLOCK_HPP*/
@@ -0,0 +1,72 @@
+//! @file logconfig.hpp
+//! @brief Configuration file hot reload.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_LOGCONFIG_HPP
+#define INCLUDED_LDGR_LOGCONFIG_HPP
+
+#include <ldgr/exports.h>
+#include <ldgr/logger.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace ldgr {
+
+//! Applies a configuration file with `log_registry::load_config` and
+//! re-applies it whenever the file is rewritten or replaced (watched with
+//! inotify through its directory, so editors that save by renaming are
+//! caught too). Reloads run on a background thread and never block
+//! logging; a reload that fails leaves the previous configuration in
+//! place. Linux only.
+class LDGR_API log_config_watcher {
+    struct impl;
+    std::unique_ptr<impl> d_impl_;
+
+  public:
+    using error_handler = std::function<void(const std::string& what)>;
+
+    //! Loads `path` once, throwing if that fails, then starts watching it.
+    //! `on_error` is called from the watcher thread for failed reloads.
+    explicit log_config_watcher(std::string path,
+                                error_handler on_error = error_handler{});
+
+    log_config_watcher(const log_config_watcher&) = delete;
+    log_config_watcher& operator=(const log_config_watcher&) = delete;
+
+    ~log_config_watcher();
+
+    //! Reloads applied since construction.
+    std::size_t reloads() const noexcept;
+
+    //! Reloads that failed since construction.
+    std::size_t failures() const noexcept;
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_LOGCONFIG_HPP*/
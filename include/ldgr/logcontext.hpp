@@ -0,0 +1,354 @@
+//! @file logcontext.hpp
+//! @brief Per-thread diagnostic context (MDC) fields.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_LOGCONTEXT_HPP
+#define INCLUDED_LDGR_LOGCONTEXT_HPP
+
+#include <fmt/format.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ldgr {
+
+namespace dtl {
+
+//! The calling thread's diagnostic context. Fields are packed back to back
+//! in `data`, outermost first, each as key size (1 byte), value size (2
+//! bytes, low byte first), key and value; `starts` remembers where each
+//! field begins so a pop is a single store.
+struct log_context_arena {
+    static constexpr std::size_t capacity = 512;
+    static constexpr std::size_t max_depth = 16;
+    static constexpr std::size_t header_size = 3;
+
+    char data[capacity];
+    std::uint16_t starts[max_depth];
+    std::uint16_t size;
+    std::uint16_t depth;
+};
+
+inline thread_local log_context_arena t_log_context{};
+
+//! A task's arena standing in for the thread's own while the task runs
+//! on this thread; see `log_task_context`.
+inline thread_local log_context_arena* t_active_context = nullptr;
+
+inline log_context_arena& context_arena() noexcept
+{
+    auto* a = t_active_context;
+    return a ? *a : t_log_context;
+}
+
+} // namespace dtl
+
+struct log_context_field {
+    fmt::string_view key;
+    fmt::string_view value;
+};
+
+//! Read-only view of packed context fields, as snapshotted into a log
+//! entry. Iterates outermost first.
+class log_context_view {
+    fmt::string_view d_data_;
+
+  public:
+    class iterator {
+        const char* d_pos_{nullptr};
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = log_context_field;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const log_context_field*;
+        using reference = log_context_field;
+
+        iterator() = default;
+
+        explicit iterator(const char* pos) noexcept: d_pos_(pos)
+        {
+        }
+
+        log_context_field operator*() const noexcept
+        {
+            const auto* p = reinterpret_cast<const unsigned char*>(d_pos_);
+            const std::size_t key_size = p[0];
+            const std::size_t value_size = p[1] | (std::size_t{p[2]} << 8);
+            const char* key = d_pos_ + dtl::log_context_arena::header_size;
+            return {{key, key_size}, {key + key_size, value_size}};
+        }
+
+        iterator& operator++() noexcept
+        {
+            const auto field = **this;
+            d_pos_ = field.value.data() + field.value.size();
+            return *this;
+        }
+
+        iterator operator++(int) noexcept
+        {
+            auto prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        bool operator==(const iterator& other) const noexcept
+        {
+            return d_pos_ == other.d_pos_;
+        }
+
+        bool operator!=(const iterator& other) const noexcept
+        {
+            return d_pos_ != other.d_pos_;
+        }
+    };
+
+    log_context_view() = default;
+
+    explicit log_context_view(fmt::string_view data) noexcept: d_data_(data)
+    {
+    }
+
+    //! The packed fields, e.g. to copy them along with an entry.
+    fmt::string_view data() const noexcept
+    {
+        return d_data_;
+    }
+
+    bool empty() const noexcept
+    {
+        return d_data_.size() == 0;
+    }
+
+    iterator begin() const noexcept
+    {
+        return iterator{d_data_.data()};
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator{d_data_.data() + d_data_.size()};
+    }
+
+    //! The value of the innermost field named `key`.
+    std::optional<fmt::string_view> find(fmt::string_view key) const noexcept
+    {
+        std::optional<fmt::string_view> found;
+        for (const auto field : *this) {
+            if (field.key == key) {
+                found = field.value;
+            }
+        }
+        return found;
+    }
+};
+
+struct log_context {
+    //! The calling thread's fields, or those of the task context active
+    //! on it. Valid until the next push or pop; log entries copy them
+    //! along with their other strings.
+    static log_context_view current() noexcept
+    {
+        const auto& a = dtl::context_arena();
+        return log_context_view{fmt::string_view{a.data, a.size}};
+    }
+};
+
+//! Adds a key/value field to the calling thread's diagnostic context for
+//! the lifetime of the scope; every record the thread logs meanwhile
+//! carries it. Fields live in a fixed per-thread arena, so push and pop
+//! never allocate. A field that does not fit (more than `max_depth`
+//! fields, keys over 255 bytes, or arena full) is silently left out.
+//!
+//! \code
+//! const ldgr::log_context_scope request{"request", request_id};
+//! LDGR_INFO("handling"); // ... {request=42} handling
+//! \endcode
+class log_context_scope {
+    //! Where the field went, so that it is popped from the same context
+    //! even if a task has switched threads in between; null if left out.
+    dtl::log_context_arena* d_arena_;
+
+    //! Start a field for `key` at the end of the arena, or null if full.
+    static char* reserve(dtl::log_context_arena& a,
+                         fmt::string_view key) noexcept
+    {
+        if (a.depth == a.max_depth || key.size() > 0xff ||
+            a.size + a.header_size + key.size() > a.capacity) {
+            return nullptr;
+        }
+        char* p = a.data + a.size;
+        p[0] = static_cast<char>(key.size());
+        std::memcpy(p + a.header_size, key.data(), key.size());
+        return p;
+    }
+
+    //! Finish the field started by `reserve`; the value must fit.
+    static dtl::log_context_arena*
+    commit(dtl::log_context_arena& a, char* p, std::size_t value_size) noexcept
+    {
+        const auto used = static_cast<std::size_t>(p - a.data) +
+                          a.header_size +
+                          static_cast<unsigned char>(p[0]) + value_size;
+        p[1] = static_cast<char>(value_size & 0xff);
+        p[2] = static_cast<char>(value_size >> 8);
+        a.starts[a.depth++] = a.size;
+        a.size = static_cast<std::uint16_t>(used);
+        return &a;
+    }
+
+    static dtl::log_context_arena* push(fmt::string_view key,
+                                        fmt::string_view value) noexcept
+    {
+        auto& a = dtl::context_arena();
+        char* p = reserve(a, key);
+        if (!p) {
+            return nullptr;
+        }
+        char* out = p + a.header_size + key.size();
+        const auto room = static_cast<std::size_t>(a.data + a.capacity - out);
+        if (value.size() > room) {
+            return nullptr;
+        }
+        std::memcpy(out, value.data(), value.size());
+        return commit(a, p, value.size());
+    }
+
+    template <class T>
+    static dtl::log_context_arena* push_formatted(fmt::string_view key,
+                                                  const T& value) noexcept
+    {
+        auto& a = dtl::context_arena();
+        char* p = reserve(a, key);
+        if (!p) {
+            return nullptr;
+        }
+        char* out = p + a.header_size + key.size();
+        const auto room = static_cast<std::size_t>(a.data + a.capacity - out);
+        try {
+            const auto res = fmt::format_to_n(out, room, "{}", value);
+            return res.size <= room ? commit(a, p, res.size) : nullptr;
+        }
+        catch (...) {
+            return nullptr;
+        }
+    }
+
+  public:
+    log_context_scope(fmt::string_view key, fmt::string_view value) noexcept
+    : d_arena_(push(key, value))
+    {
+    }
+
+    //! Formats `value` with fmt straight into the arena.
+    template <class T,
+              std::enable_if_t<!std::is_convertible<const T&,
+                                                    fmt::string_view>::value,
+                               int> = 0>
+    log_context_scope(fmt::string_view key, const T& value) noexcept
+    : d_arena_(push_formatted(key, value))
+    {
+    }
+
+    ~log_context_scope()
+    {
+        if (d_arena_) {
+            d_arena_->size = d_arena_->starts[--d_arena_->depth];
+        }
+    }
+
+    log_context_scope(const log_context_scope&) = delete;
+    log_context_scope& operator=(const log_context_scope&) = delete;
+
+    //! Whether the field made it into the context.
+    bool pushed() const noexcept
+    {
+        return d_arena_ != nullptr;
+    }
+};
+
+//! A diagnostic context that belongs to a task rather than a thread, for
+//! work that hops between threads (executor tasks, coroutines). It starts
+//! as a copy of the fields current where it is created. While activated
+//! on a thread it stands in for that thread's context: records logged
+//! there carry its fields, and `log_context_scope`s push onto it.
+//!
+//! \code
+//! pool.submit([ctx = ldgr::log_task_context{}]() mutable {
+//!     const auto active = ctx.activate();
+//!     LDGR_INFO("runs with the submitter's fields");
+//! });
+//! \endcode
+class log_task_context {
+    friend class log_context_promise;
+
+    dtl::log_context_arena d_arena_;
+
+  public:
+    log_task_context() noexcept: d_arena_(dtl::context_arena())
+    {
+    }
+
+    //! Installs the task context on the calling thread until destroyed,
+    //! then puts back whatever was active before. Activations nest.
+    class activation {
+        dtl::log_context_arena* d_prev_;
+
+      public:
+        explicit activation(log_task_context& ctx) noexcept
+        : d_prev_(std::exchange(dtl::t_active_context, &ctx.d_arena_))
+        {
+        }
+
+        ~activation()
+        {
+            dtl::t_active_context = d_prev_;
+        }
+
+        activation(const activation&) = delete;
+        activation& operator=(const activation&) = delete;
+    };
+
+    activation activate() noexcept
+    {
+        return activation{*this};
+    }
+
+    log_context_view fields() const noexcept
+    {
+        return log_context_view{fmt::string_view{d_arena_.data,
+                                                 d_arena_.size}};
+    }
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_LOGCONTEXT_HPP*/
@@ -0,0 +1,248 @@
+//! @file logcoro.hpp
+//! @brief Logging context and flushing for C++20 coroutines.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_LOGCORO_HPP
+#define INCLUDED_LDGR_LOGCORO_HPP
+
+#if defined(LDGR_HAVE_COROUTINES) && defined(__cpp_impl_coroutine)
+
+#include <ldgr/exports.h>
+#include <ldgr/logcontext.hpp>
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+namespace ldgr {
+
+class logger;
+
+namespace dtl {
+struct log_flush_worker;
+} // namespace dtl
+
+//! Mixin for a coroutine promise type that gives the coroutine its own
+//! `log_task_context`, inherited from the fields current where the
+//! coroutine is created, and keeps it active on whichever thread runs the
+//! coroutine. The context is put aside whenever the coroutine suspends and
+//! brought back when it resumes, so `co_await`s that hop threads keep it
+//! and the threads left behind do not.
+//!
+//! The promise routes its awaits through `await_transform`, and wraps the
+//! awaiters of `initial_suspend` with `with_log_context` and of
+//! `final_suspend` with `without_log_context`:
+//!
+//! \code
+//! struct promise_type : ldgr::log_context_promise {
+//!     auto initial_suspend() noexcept
+//!     {
+//!         return with_log_context(std::suspend_always{});
+//!     }
+//!     auto final_suspend() noexcept
+//!     {
+//!         return without_log_context(final_awaiter{});
+//!     }
+//!     // ...
+//! };
+//! \endcode
+class log_context_promise {
+    log_task_context d_context_;
+    dtl::log_context_arena* d_prev_{nullptr};
+    bool d_active_{false};
+
+    void activate() noexcept
+    {
+        if (!d_active_) {
+            d_prev_ = std::exchange(dtl::t_active_context, &arena());
+            d_active_ = true;
+        }
+    }
+
+    void deactivate() noexcept
+    {
+        if (d_active_) {
+            dtl::t_active_context = d_prev_;
+            d_active_ = false;
+        }
+    }
+
+    dtl::log_context_arena& arena() noexcept
+    {
+        return d_context_.d_arena_;
+    }
+
+    template <class AWAITER>
+    struct resuming_awaiter {
+        log_context_promise& promise;
+        AWAITER inner;
+
+        bool await_ready() noexcept(noexcept(inner.await_ready()))
+        {
+            const bool ready = inner.await_ready();
+            if (!ready) {
+                // Suspending; whoever resumes us may be another thread.
+                promise.deactivate();
+            }
+            return ready;
+        }
+
+        template <class PROMISE>
+        auto await_suspend(std::coroutine_handle<PROMISE> h) noexcept(
+            noexcept(inner.await_suspend(h)))
+        {
+            return inner.await_suspend(h);
+        }
+
+        decltype(auto) await_resume() noexcept(noexcept(inner.await_resume()))
+        {
+            promise.activate();
+            return inner.await_resume();
+        }
+    };
+
+    //! Final awaiters must not throw, and neither does this one.
+    template <class AWAITER>
+    struct leaving_awaiter {
+        log_context_promise& promise;
+        AWAITER inner;
+
+        bool await_ready() noexcept
+        {
+            promise.deactivate();
+            return inner.await_ready();
+        }
+
+        template <class PROMISE>
+        auto await_suspend(std::coroutine_handle<PROMISE> h) noexcept
+        {
+            return inner.await_suspend(h);
+        }
+
+        decltype(auto) await_resume() noexcept
+        {
+            return inner.await_resume();
+        }
+    };
+
+    //! The awaiter `co_await` would use for `awaitable`. Awaitables are
+    //! held by reference: they live until the end of the `co_await`.
+    template <class T>
+    static decltype(auto) get_awaiter(T&& awaitable)
+    {
+        if constexpr (requires { static_cast<T&&>(awaitable).operator
+                                 co_await(); }) {
+            return static_cast<T&&>(awaitable).operator co_await();
+        }
+        else if constexpr (requires {
+                               operator co_await(static_cast<T&&>(awaitable));
+                           }) {
+            return operator co_await(static_cast<T&&>(awaitable));
+        }
+        else {
+            return static_cast<T&&>(awaitable);
+        }
+    }
+
+  public:
+    //! The coroutine's context, e.g. to pass on to work it spawns.
+    log_task_context& log_context() noexcept
+    {
+        return d_context_;
+    }
+
+    //! Runs the coroutine with its context from this point on.
+    template <class AWAITER>
+    auto with_log_context(AWAITER&& awaiter) noexcept
+    {
+        return resuming_awaiter<std::decay_t<AWAITER>>{
+            *this, std::forward<AWAITER>(awaiter)};
+    }
+
+    //! Drops the context for good, for the coroutine's final suspension.
+    template <class AWAITER>
+    auto without_log_context(AWAITER&& awaiter) noexcept
+    {
+        return leaving_awaiter<std::decay_t<AWAITER>>{
+            *this, std::forward<AWAITER>(awaiter)};
+    }
+
+    template <class AWAITABLE>
+    auto await_transform(AWAITABLE&& awaitable)
+    {
+        using awaiter = decltype(get_awaiter(std::declval<AWAITABLE>()));
+        return resuming_awaiter<awaiter>{
+            *this, get_awaiter(std::forward<AWAITABLE>(awaitable))};
+    }
+};
+
+//! Awaitable that flushes every sink of `target` (or of every logger) on
+//! ldgr's flush thread and resumes the awaiting coroutine there once done,
+//! so slow sinks do not block the thread the coroutine was running on.
+class log_flush_awaitable {
+    logger* d_target_;
+    std::exception_ptr d_error_;
+
+    friend struct dtl::log_flush_worker;
+
+  public:
+    explicit log_flush_awaitable(logger* target) noexcept: d_target_(target)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    LDGR_API void await_suspend(std::coroutine_handle<> h);
+
+    //! Rethrows whatever the flush threw.
+    void await_resume() const
+    {
+        if (d_error_) {
+            std::rethrow_exception(d_error_);
+        }
+    }
+};
+
+//! `co_await ldgr::flush_async();` flushes every logger's sinks.
+inline log_flush_awaitable flush_async() noexcept
+{
+    return log_flush_awaitable{nullptr};
+}
+
+//! `co_await ldgr::flush_async(l);` flushes the sinks of `l`.
+inline log_flush_awaitable flush_async(logger& l) noexcept
+{
+    return log_flush_awaitable{&l};
+}
+
+} // namespace ldgr
+
+#endif
+
+#endif /*INCLUDED_LDGR_LOGCORO_HPP*/
@@ -28,43 +28,95 @@
 
 #include <ldgr/exports.h>
 #include <ldgr/fmtutil.hpp>
+#include <ldgr/logcontext.hpp>
+#include <ldgr/logsite.hpp>
+#include <ldgr/logthread.hpp>
 #include <ldgr/logseverity.hpp>
 
 #include <fmt/format.h>
 
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <ctime>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 namespace ldgr {
 
 using time_point = std::chrono::system_clock::time_point;
 
 struct log_entry {
+    //! `file_base` value asking for the offset to be found when formatting.
+    static constexpr std::uint32_t unknown_file_base =
+        std::numeric_limits<std::uint32_t>::max();
+
     log_severity severity;
     fmt::string_view name;
     fmt::string_view file;
-    fmt::string_view line;
+    std::uint32_t line;
     time_point when;
     fmt::string_view message;
+    //! Packed diagnostic context fields; the constructing thread's own
+    //! unless given.
+    fmt::string_view context{log_context::current().data()};
+    //! The constructing thread, from its cached `log_thread` details.
+    std::uint32_t thread_id{log_thread::id()};
+    fmt::string_view thread_name{log_thread::name()};
+    int cpu{log_thread::captured_cpu()};
+    //! Offset of `fmtutil::trunc_file(file)` within `file`; the logging
+    //! macros compute it at compile time.
+    std::uint32_t file_base{unknown_file_base};
+    //! The call site when logged through the macros, whose static strings
+    //! `file`, and `name` when the site has a category, then point into.
+    const log_site* site{nullptr};
 };
 
 struct log_entry_fmt {
     log_severity severity;
     fmt::string_view name;
     fmt::string_view file;
-    fmt::string_view line;
+    std::uint32_t line;
+    std::uint32_t file_base; //!< where `short_file()` starts in `file`
     std::time_t time;
     std::tm time_struct;
-    long microseconds;
+    long nanoseconds; //!< within `time`, in [0, 1e9)
     bool is_local;
     fmt::string_view message;
+    fmt::string_view context_data;
+    std::uint32_t thread_id;
+    fmt::string_view thread_name; //!< empty if the thread has no name
+    int cpu;                      //!< -1 unless CPU capture is on
+    const log_site* site;         //!< null unless logged at a call site
 
     long milliseconds() const noexcept
     {
-        return (microseconds / 1000) + ((microseconds % 1000) >= 500);
+        return (nanoseconds / 1000000) + ((nanoseconds % 1000000) >= 500000);
+    }
+
+    //! Sub-second part truncated to microseconds.
+    long microseconds() const noexcept
+    {
+        return nanoseconds / 1000;
+    }
+
+    //! `file` trimmed to its last three components.
+    fmt::string_view short_file() const noexcept
+    {
+        return fmt::string_view{file.data() + file_base,
+                                file.size() - file_base};
+    }
+
+    //! The diagnostic context fields in effect when the entry was logged.
+    log_context_view context() const noexcept
+    {
+        return log_context_view{context_data};
     }
 };
 
@@ -73,31 +125,156 @@ struct log_entry_fmt_cp {
     std::shared_ptr<log_buffer_t> buffer;
 };
 
+//! RAII lease on the calling thread's reusable staging buffer. The buffer
+//! keeps its capacity across log calls, so messages are formatted without
+//! touching the allocator once it has warmed up. A nested lease on the same
+//! thread (e.g. a formatter that itself logs) gets a private buffer.
+class staging_buffer {
+    log_buffer_t* d_buffer_;
+    std::unique_ptr<log_buffer_t> d_spill_;
+
+    static log_buffer_t*& slot() noexcept
+    {
+        static thread_local log_buffer_t s_buffer{};
+        static thread_local log_buffer_t* s_slot = &s_buffer;
+        return s_slot;
+    }
+
+  public:
+    staging_buffer(): d_buffer_(std::exchange(slot(), nullptr)), d_spill_()
+    {
+        if (!d_buffer_) {
+            d_spill_ = std::make_unique<log_buffer_t>();
+            d_buffer_ = d_spill_.get();
+        }
+    }
+
+    //! A staging buffer that grew past this is released after use, so one
+    //! huge message does not pin its memory to the thread forever.
+    static constexpr std::size_t max_retained_capacity = 64 * 1024;
+
+    ~staging_buffer() noexcept
+    {
+        if (!d_spill_) {
+            if (d_buffer_->capacity() > max_retained_capacity) {
+                *d_buffer_ = log_buffer_t{};
+            }
+            d_buffer_->clear();
+            slot() = d_buffer_;
+        }
+    }
+
+    staging_buffer(const staging_buffer&) = delete;
+    staging_buffer& operator=(const staging_buffer&) = delete;
+
+    log_buffer_t& get() noexcept
+    {
+        return *d_buffer_;
+    }
+};
+
 struct default_log_buffer_factory {
-    std::shared_ptr<log_buffer_t> operator()() const
+    std::shared_ptr<log_buffer_t> operator()(std::size_t size = 0) const
     {
+        static_cast<void>(size);
         return std::make_shared<log_buffer_t>();
     }
+
+    std::size_t max_size() const noexcept
+    {
+        return std::numeric_limits<std::size_t>::max();
+    }
+};
+
+//! What a pool does with an entry larger than its largest size class.
+enum class log_overflow_policy {
+    spill,    //!< hand out a one-off buffer that the pool does not keep
+    truncate, //!< cut the message so the entry fits the largest class
+};
+
+//! When a pool gives idle memory back to the allocator.
+enum class log_trim_policy {
+    on_release, //!< whenever a release leaves it above the high watermark
+    manual,     //!< only when `trim()` is called, e.g. from a timer thread
+};
+
+//! How a pool spreads its free lists across the machine.
+enum class log_pool_sharding {
+    none,      //!< a single set of free lists
+    numa_node, //!< one shard per NUMA node
+    cpu,       //!< one shard per CPU
+};
+
+struct log_buffer_pool_config {
+    log_overflow_policy overflow{log_overflow_policy::spill};
+    log_pool_sharding sharding{log_pool_sharding::none};
+    log_trim_policy trim{log_trim_policy::on_release};
+    //! Resident bytes above which idle nodes are trimmed.
+    std::size_t high_watermark{std::numeric_limits<std::size_t>::max()};
+    //! Resident bytes that trimming brings the pool back down to.
+    std::size_t low_watermark{0};
+    //! Hard cap on resident bytes; past it buffers are not pooled.
+    std::size_t memory_cap{std::numeric_limits<std::size_t>::max()};
+};
+
+struct log_buffer_pool_stats {
+    std::size_t hits;           //!< requests served from a free list
+    std::size_t misses;         //!< requests that had to allocate
+    std::size_t bytes_resident; //!< memory held by pooled nodes
+    std::size_t peak_bytes;     //!< high-water mark of `bytes_resident`
+    std::size_t bytes_trimmed;  //!< idle memory given back by trimming
+    std::size_t spilled;        //!< entries too large for any size class
+    std::size_t bytes_spilled;  //!< total size of the spilled entries
+    std::size_t truncated;      //!< entries cut to the largest size class
+    std::size_t capped;         //!< unpooled buffers due to `memory_cap`
+    std::size_t remote_frees;   //!< releases handed back to another shard
 };
 
+//! Pool of log buffers segregated by size class. Each node reserves the
+//! capacity of its class up front and never outgrows it, so resident memory
+//! is bounded by the classes in use rather than by the largest message seen.
+//!
+//! With sharding enabled, free lists are kept per NUMA node (or per CPU).
+//! Buffers are taken from the caller's local shard and always go back to
+//! the shard that allocated them: a release from another shard is pushed
+//! onto the owner's lock-free remote-free stack, which the owner drains on
+//! its next miss. Machines with a single node fall back to one shard.
 class LDGR_API pooled_log_buffer_factory
 : public std::enable_shared_from_this<pooled_log_buffer_factory> {
+  public:
+    static constexpr std::array<std::size_t, 4> size_classes{
+        {log_buffer_inline_size, 4 * 1024, 16 * 1024, 64 * 1024}};
+
+  private:
     struct node {
         node* next = nullptr;
         pooled_log_buffer_factory* pool = nullptr;
+        std::uint32_t size_class = 0;
+        std::uint32_t shard = 0;
+        // The shared_ptr control block lives in the node, so handing out a
+        // buffer costs no allocation beyond the node itself.
+        alignas(std::max_align_t) unsigned char ctrl_block[64];
         log_buffer_t buffer{};
     };
 
-    struct mem_block {
-        mem_block* next;
+    struct free_list {
+        node* head = nullptr;
+        std::mutex mutex{};
+    };
+
+    struct alignas(64) shard {
+        std::array<free_list, size_classes.size()> free_lists{};
+        std::atomic<node*> remote_free{nullptr};
     };
 
     template <class T>
     struct ctrl_block_alloc {
         std::shared_ptr<pooled_log_buffer_factory> d_pool_;
+        node* d_node_;
 
-        ctrl_block_alloc(std::shared_ptr<pooled_log_buffer_factory>&& p)
-        : d_pool_(std::move(p))
+        ctrl_block_alloc(std::shared_ptr<pooled_log_buffer_factory>&& p,
+                         node* n)
+        : d_pool_(std::move(p)), d_node_(n)
         {
         }
 
@@ -105,51 +282,45 @@ class LDGR_API pooled_log_buffer_factory
 
         template <class U>
         ctrl_block_alloc(const ctrl_block_alloc<U>& rhs) noexcept
-        : d_pool_(rhs.d_pool_)
+        : d_pool_(rhs.d_pool_), d_node_(rhs.d_node_)
         {
         }
         template <class U>
         ctrl_block_alloc(ctrl_block_alloc<U>&& rhs) noexcept
-        : d_pool_(std::move(rhs.d_pool_))
+        : d_pool_(std::move(rhs.d_pool_)), d_node_(rhs.d_node_)
         {
         }
 
         inline T* allocate(std::size_t n)
         {
+            static_assert(sizeof(T) <= sizeof(node::ctrl_block),
+                          "control block does not fit in the node");
             assert(n == 1);
-            auto* p = d_pool_.get();
-            {
-                std::lock_guard<std::mutex> guard(
-                    p->d_free_ctrl_blocks_mutex_);
-                if (auto* cb = p->d_free_ctrl_blocks_) {
-                    p->d_free_ctrl_blocks_ = cb->next;
-                    return reinterpret_cast<T*>(cb);
-                }
-            }
-            return static_cast<T*>(::operator new(sizeof(T)));
+            static_cast<void>(n);
+            return reinterpret_cast<T*>(d_node_->ctrl_block);
         }
 
         inline void deallocate(T* ptr, std::size_t n)
         {
+            // The control block is destroyed by now, so this is the first
+            // point at which the node can be reused.
             assert(n == 1);
-            auto* cb = reinterpret_cast<mem_block*>(ptr);
-            auto* p = d_pool_.get();
-            std::lock_guard<std::mutex> guard(p->d_free_ctrl_blocks_mutex_);
-            cb->next = p->d_free_ctrl_blocks_;
-            p->d_free_ctrl_blocks_ = cb;
+            static_cast<void>(n);
+            static_cast<void>(ptr);
+            d_pool_->release(d_node_);
         }
 
         template <class U>
         friend bool operator==(const ctrl_block_alloc<T>& x,
                                const ctrl_block_alloc<U>& y) noexcept
         {
-            return x.d_pool_ == y.d_pool_;
+            return x.d_pool_ == y.d_pool_ && x.d_node_ == y.d_node_;
         }
         template <class U>
         friend bool operator!=(const ctrl_block_alloc<T>& x,
                                const ctrl_block_alloc<U>& y) noexcept
         {
-            return x.d_pool_ != y.d_pool_;
+            return !(x == y);
         }
     };
 
@@ -157,31 +328,145 @@ class LDGR_API pooled_log_buffer_factory
         inline void operator()(node* n) const noexcept
         {
             n->buffer.clear();
-            auto* p = n->pool;
-            std::lock_guard<std::mutex> guard{p->d_free_list_mutex_};
-            n->next = p->d_free_list_;
-            p->d_free_list_ = n;
         }
     };
 
-    node* d_free_list_;
-    mutable std::mutex d_free_list_mutex_;
-    mem_block* d_free_ctrl_blocks_;
-    mutable std::mutex d_free_ctrl_blocks_mutex_;
+    log_buffer_pool_config d_config_;
+    std::size_t d_shard_count_;
+    std::unique_ptr<shard[]> d_shards_;
+    std::vector<std::uint32_t> d_cpu_shards_;
+    std::atomic<std::size_t> d_hits_;
+    std::atomic<std::size_t> d_misses_;
+    std::atomic<std::size_t> d_bytes_resident_;
+    std::atomic<std::size_t> d_peak_bytes_;
+    std::atomic<std::size_t> d_bytes_trimmed_;
+    std::atomic<std::size_t> d_spilled_;
+    std::atomic<std::size_t> d_bytes_spilled_;
+    std::atomic<std::size_t> d_truncated_;
+    std::atomic<std::size_t> d_capped_;
+    std::atomic<std::size_t> d_remote_frees_;
+
+    explicit pooled_log_buffer_factory(const log_buffer_pool_config& config);
+
+    static constexpr std::size_t size_class_of(std::size_t size) noexcept
+    {
+        std::size_t i = 0;
+        while (i < size_classes.size() && size_classes[i] < size) {
+            ++i;
+        }
+        return i;
+    }
+
+    static std::size_t node_bytes(std::size_t capacity) noexcept
+    {
+        return sizeof(node) +
+               (capacity > log_buffer_inline_size ? capacity : 0);
+    }
+
+    static std::size_t node_bytes(const node& n) noexcept
+    {
+        return node_bytes(n.buffer.capacity());
+    }
+
+    //! CPU the calling thread is running on, or -1 if unknown.
+    static int current_cpu() noexcept;
+
+    std::uint32_t current_shard() const noexcept
+    {
+        if (d_shard_count_ == 1) {
+            return 0;
+        }
+        const auto cpu = current_cpu();
+        return cpu < 0 ? 0
+                       : d_cpu_shards_[static_cast<std::size_t>(cpu) %
+                                       d_cpu_shards_.size()];
+    }
+
+    void add_resident(std::size_t bytes) noexcept
+    {
+        const auto now =
+            d_bytes_resident_.fetch_add(bytes, std::memory_order_relaxed) +
+            bytes;
+        auto peak = d_peak_bytes_.load(std::memory_order_relaxed);
+        while (peak < now && !d_peak_bytes_.compare_exchange_weak(
+                                 peak, now, std::memory_order_relaxed)) {
+        }
+    }
+
+    //! Whether `bytes` more can become resident without breaching the
+    //! memory cap, trimming idle nodes to make room if needed. The check is
+    //! not atomic with the allocation, so concurrent misses may overshoot
+    //! the cap by a node each.
+    bool fits_cap(std::size_t bytes) noexcept
+    {
+        const auto cap = d_config_.memory_cap;
+        if (bytes > cap) {
+            return false;
+        }
+        if (d_bytes_resident_.load(std::memory_order_relaxed) + bytes <= cap) {
+            return true;
+        }
+        trim(cap - bytes);
+        return d_bytes_resident_.load(std::memory_order_relaxed) + bytes <=
+               cap;
+    }
+
+    static node* pop(free_list& fl) noexcept
+    {
+        std::lock_guard<std::mutex> guard{fl.mutex};
+        node* n = fl.head;
+        if (n) {
+            fl.head = n->next;
+            n->next = nullptr;
+        }
+        return n;
+    }
+
+    //! Move nodes released by other shards onto `sh`'s free lists.
+    void drain_remote(shard& sh) noexcept;
 
-    pooled_log_buffer_factory()
-    : d_free_list_(nullptr)
-    , d_free_list_mutex_()
-    , d_free_ctrl_blocks_(nullptr)
-    , d_free_ctrl_blocks_mutex_()
+    inline void release(node* n) noexcept
     {
+        if (n->buffer.capacity() > size_classes[n->size_class]) {
+            // Someone wrote past the class capacity; don't keep the growth.
+            // The node was charged at its class size, not its grown one.
+            d_bytes_resident_.fetch_sub(
+                node_bytes(size_classes[n->size_class]),
+                std::memory_order_relaxed);
+            delete n;
+            return;
+        }
+        auto& sh = d_shards_[n->shard];
+        if (d_shard_count_ > 1 && current_shard() != n->shard) {
+            d_remote_frees_.fetch_add(1, std::memory_order_relaxed);
+            auto* head = sh.remote_free.load(std::memory_order_relaxed);
+            do {
+                n->next = head;
+            } while (!sh.remote_free.compare_exchange_weak(
+                head,
+                n,
+                std::memory_order_release,
+                std::memory_order_relaxed));
+        }
+        else {
+            auto& fl = sh.free_lists[n->size_class];
+            std::lock_guard<std::mutex> guard{fl.mutex};
+            n->next = fl.head;
+            fl.head = n;
+        }
+        if (d_config_.trim == log_trim_policy::on_release &&
+            d_bytes_resident_.load(std::memory_order_relaxed) >
+                d_config_.high_watermark) {
+            trim();
+        }
     }
 
   public:
-    static std::shared_ptr<pooled_log_buffer_factory> create()
+    static std::shared_ptr<pooled_log_buffer_factory>
+    create(const log_buffer_pool_config& config = log_buffer_pool_config{})
     {
         return std::shared_ptr<pooled_log_buffer_factory>(
-            new pooled_log_buffer_factory{});
+            new pooled_log_buffer_factory{config});
     }
 
     ~pooled_log_buffer_factory() noexcept;
@@ -190,49 +475,143 @@ class LDGR_API pooled_log_buffer_factory
     pooled_log_buffer_factory&
     operator=(const pooled_log_buffer_factory&) = delete;
 
-    inline std::shared_ptr<log_buffer_t> operator()()
+    //! Largest entry this pool will hand out a buffer for.
+    std::size_t max_size() const noexcept
     {
-        node* n = nullptr;
-        {
-            std::lock_guard<std::mutex> guard{d_free_list_mutex_};
-            if ((n = d_free_list_)) {
-                d_free_list_ = n->next;
-                n->next = nullptr;
+        return d_config_.overflow == log_overflow_policy::truncate
+                   ? size_classes.back()
+                   : std::numeric_limits<std::size_t>::max();
+    }
+
+    const log_buffer_pool_config& config() const noexcept
+    {
+        return d_config_;
+    }
+
+    std::size_t shard_count() const noexcept
+    {
+        return d_shard_count_;
+    }
+
+    log_buffer_pool_stats stats() const noexcept
+    {
+        return log_buffer_pool_stats{
+            d_hits_.load(std::memory_order_relaxed),
+            d_misses_.load(std::memory_order_relaxed),
+            d_bytes_resident_.load(std::memory_order_relaxed),
+            d_peak_bytes_.load(std::memory_order_relaxed),
+            d_bytes_trimmed_.load(std::memory_order_relaxed),
+            d_spilled_.load(std::memory_order_relaxed),
+            d_bytes_spilled_.load(std::memory_order_relaxed),
+            d_truncated_.load(std::memory_order_relaxed),
+            d_capped_.load(std::memory_order_relaxed),
+            d_remote_frees_.load(std::memory_order_relaxed)};
+    }
+
+    //! Free idle nodes, largest classes first, until resident memory is at
+    //! or below `target`. Thread-safe; returns the number of bytes freed.
+    std::size_t trim(std::size_t target) noexcept;
+
+    //! Trim down to the configured low watermark.
+    std::size_t trim() noexcept
+    {
+        return trim(d_config_.low_watermark);
+    }
+
+    inline std::shared_ptr<log_buffer_t> operator()(std::size_t size = 0)
+    {
+        auto cls = size_class_of(size);
+        if (cls == size_classes.size()) {
+            if (d_config_.overflow == log_overflow_policy::spill) {
+                d_misses_.fetch_add(1, std::memory_order_relaxed);
+                d_spilled_.fetch_add(1, std::memory_order_relaxed);
+                d_bytes_spilled_.fetch_add(size, std::memory_order_relaxed);
+                return std::make_shared<log_buffer_t>();
             }
+            d_truncated_.fetch_add(1, std::memory_order_relaxed);
+            cls = size_classes.size() - 1;
         }
 
-        if (!n) {
+        const auto shard_idx = current_shard();
+        auto& sh = d_shards_[shard_idx];
+        node* n = pop(sh.free_lists[cls]);
+        if (!n && sh.remote_free.load(std::memory_order_relaxed)) {
+            drain_remote(sh);
+            n = pop(sh.free_lists[cls]);
+        }
+
+        if (n) {
+            d_hits_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            d_misses_.fetch_add(1, std::memory_order_relaxed);
+            if (!fits_cap(node_bytes(size_classes[cls]))) {
+                d_capped_.fetch_add(1, std::memory_order_relaxed);
+                auto buff = std::make_shared<log_buffer_t>();
+                buff->reserve(size_classes[cls]);
+                return buff;
+            }
             n = new node{};
             n->pool = this;
+            n->size_class = static_cast<std::uint32_t>(cls);
+            n->shard = shard_idx;
+            n->buffer.reserve(size_classes[cls]);
+            add_resident(node_bytes(*n));
         }
 
         return std::shared_ptr<log_buffer_t>(
             std::shared_ptr<node>{
-                n, clear_node{}, ctrl_block_alloc<node>{shared_from_this()}},
+                n,
+                clear_node{},
+                ctrl_block_alloc<node>{shared_from_this(), n}},
             &n->buffer);
     }
 };
 
 struct log_entry_util {
+    //! An entry for a record logged at `site`, borrowing its strings. A
+    //! site without a category of its own is named `category`.
+    static log_entry from_site(const log_site& site,
+                               time_point when,
+                               fmt::string_view message,
+                               fmt::string_view category) noexcept
+    {
+        const auto name =
+            site.category.size() != 0 ? site.category : category;
+        log_entry out{
+            site.severity, name, site.file, site.line, when, message};
+        out.file_base = site.file_base;
+        out.site = &site;
+        return out;
+    }
+
     static log_entry_fmt to_log_entry_fmt(const log_entry& entry,
                                           bool local_time = false) noexcept
     {
         namespace chr = std::chrono;
-        const auto dur = chr::duration_cast<chr::microseconds>(
-            entry.when.time_since_epoch());
-        auto ct = dur.count();
-        auto time = static_cast<std::time_t>(ct / 1000000);
-        auto micros = ct % 1000000;
+        const auto dur = entry.when.time_since_epoch();
+        const auto secs = chr::floor<chr::seconds>(dur);
+        auto time = static_cast<std::time_t>(secs.count());
+        auto nanos = static_cast<long>(
+            chr::duration_cast<chr::nanoseconds>(dur - secs).count());
 
         log_entry_fmt out{entry.severity,
                           entry.name,
                           entry.file,
                           entry.line,
+                          entry.file_base != log_entry::unknown_file_base
+                              ? entry.file_base
+                              : fmtutil::trunc_file_offset(entry.file),
                           time,
                           {},
-                          micros,
+                          nanos,
                           local_time,
-                          entry.message};
+                          entry.message,
+                          entry.context,
+                          entry.thread_id,
+                          entry.thread_name,
+                          entry.cpu,
+                          entry.site};
         if (local_time) {
             ::localtime_r(&time, &out.time_struct);
         }
@@ -242,17 +621,43 @@ struct log_entry_util {
         return out;
     }
 
+    //! Wrap `entry` without copying: the result borrows the caller's
+    //! strings and has no buffer, so it is only valid for the duration of
+    //! a synchronous call.
+    static log_entry_fmt_cp view_log_entry(const log_entry& entry,
+                                           bool local_time = false) noexcept
+    {
+        return log_entry_fmt_cp{to_log_entry_fmt(entry, local_time), nullptr};
+    }
+
     template <class FACTORY = default_log_buffer_factory>
     static log_entry_fmt_cp copy_log_entry_fmt(const log_entry_fmt& entry_fmt,
                                                FACTORY&& factory = FACTORY())
     {
+        // A call site's strings are static, so only its record's own
+        // strings need copying; the name is the site's only if the site
+        // has a category.
+        const bool sited = entry_fmt.site != nullptr;
+        const bool sited_name =
+            sited && entry_fmt.name.data() == entry_fmt.site->category.data();
+        const auto fixed_size = (sited_name ? 0 : entry_fmt.name.size()) +
+                                (sited ? 0 : entry_fmt.file.size()) +
+                                entry_fmt.context_data.size() +
+                                entry_fmt.thread_name.size();
+        auto message = entry_fmt.message;
+        const auto limit = factory.max_size();
+        if (fixed_size + message.size() > limit) {
+            message = fmt::string_view{
+                message.data(), limit > fixed_size ? limit - fixed_size : 0};
+        }
+
         log_entry_fmt_cp out{};
-        out.buffer = std::forward<FACTORY>(factory)();
+        out.buffer = std::forward<FACTORY>(factory)(
+            fixed_size + entry_fmt.message.size());
 
         std::size_t off{0};
         auto& buff = *(out.buffer);
-        buff.reserve(entry_fmt.name.size() + entry_fmt.file.size() +
-                     entry_fmt.line.size() + entry_fmt.message.size());
+        buff.reserve(fixed_size + message.size());
 
         auto append_str = [&off, &buff](const fmt::string_view& view) {
             fmtutil::append(buff, view);
@@ -262,14 +667,21 @@ struct log_entry_util {
         };
 
         out.entry.severity = entry_fmt.severity;
-        out.entry.name = append_str(entry_fmt.name);
-        out.entry.file = append_str(entry_fmt.file);
-        out.entry.line = append_str(entry_fmt.line);
+        out.entry.name =
+            sited_name ? entry_fmt.name : append_str(entry_fmt.name);
+        out.entry.file = sited ? entry_fmt.file : append_str(entry_fmt.file);
+        out.entry.line = entry_fmt.line;
+        out.entry.file_base = entry_fmt.file_base;
         out.entry.time = entry_fmt.time;
         out.entry.time_struct = entry_fmt.time_struct;
-        out.entry.microseconds = entry_fmt.microseconds;
+        out.entry.nanoseconds = entry_fmt.nanoseconds;
         out.entry.is_local = entry_fmt.is_local;
-        out.entry.message = append_str(entry_fmt.message);
+        out.entry.message = append_str(message);
+        out.entry.context_data = append_str(entry_fmt.context_data);
+        out.entry.thread_id = entry_fmt.thread_id;
+        out.entry.thread_name = append_str(entry_fmt.thread_name);
+        out.entry.cpu = entry_fmt.cpu;
+        out.entry.site = entry_fmt.site;
         return out;
     }
 
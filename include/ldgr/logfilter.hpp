@@ -0,0 +1,93 @@
+//! @file logfilter.hpp
+//! @brief Per-sink record filters.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_LOGFILTER_HPP
+#define INCLUDED_LDGR_LOGFILTER_HPP
+
+#include <ldgr/exports.h>
+#include <ldgr/logentry.hpp>
+#include <ldgr/logseverity.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ldgr {
+
+enum class log_filter_action {
+    accept,
+    reject,
+};
+
+struct log_filter_rule {
+    log_filter_action action{log_filter_action::accept};
+    //! Category the rule applies to: empty or `*` matches every category,
+    //! a trailing `*` (as in `AUTH.*`) matches by prefix, anything else
+    //! must match exactly.
+    std::string category;
+    log_severity min_severity{log_severity::trace};
+    log_severity max_severity{log_severity::fatal};
+    //! Substring of the source file path; empty matches any file.
+    std::string file;
+    //! Substring of the message; empty matches any message.
+    std::string message;
+    //! ECMAScript regex searched for in the message; empty matches any.
+    std::string message_regex;
+};
+
+//! Immutable decision structure compiled from a list of rules. A record
+//! passes if no `reject` rule matches it and, when there are `accept`
+//! rules, at least one of them does; rule order does not matter.
+//!
+//! Rule categories are compiled into a prefix trie whose nodes carry one
+//! severity bitmask per action, so rules on category and severity alone
+//! cost a walk down the record's category. Rules with file or message
+//! predicates hang off the same nodes and are only evaluated for records
+//! that reach them.
+class LDGR_API log_filter {
+  public:
+    //! Throws `std::regex_error` for an invalid `message_regex`.
+    explicit log_filter(const std::vector<log_filter_rule>& rules);
+
+    log_filter(const log_filter&) = delete;
+    log_filter& operator=(const log_filter&) = delete;
+
+    ~log_filter();
+
+    bool accepts(const log_entry_fmt& entry) const noexcept;
+
+  private:
+    struct node;
+    struct slow_rule;
+
+    std::vector<node> d_nodes_;
+    std::vector<slow_rule> d_slow_;
+    bool d_has_accept_{false};
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_LOGFILTER_HPP*/
@@ -26,6 +26,9 @@
 #ifndef INCLUDED_LDGR_LOGGER_HPP
 #define INCLUDED_LDGR_LOGGER_HPP
 
+#include <ldgr/backtrace.hpp>
+#include <ldgr/exports.h>
+#include <ldgr/logclock.hpp>
 #include <ldgr/logentry.hpp>
 #include <ldgr/logsink.hpp>
 
@@ -33,29 +36,106 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace ldgr {
 
+namespace dtl {
+
+//! A configuration published by `log_registry::apply_config`; immutable
+//! once published.
+struct log_config_state {
+    struct level_rule {
+        std::string category;
+        log_severity level;
+    };
+
+    struct sink_route {
+        std::string key; //!< sink type and path, to reuse it across reloads
+        std::shared_ptr<log_sink> sink;
+        //! The sink's own formatter, restored when a pattern is dropped.
+        std::shared_ptr<const log_formatter> base_formatter;
+        std::shared_ptr<const log_formatter> formatter;
+        log_severity level;
+        std::vector<std::string> categories;
+    };
+
+    std::vector<level_rule> levels;
+    std::vector<sink_route> sinks;
+};
+
+} // namespace dtl
+
 class logger {
     friend class log_registry;
 
     std::atomic<log_severity> d_level_;
     std::shared_ptr<pooled_log_buffer_factory> d_factory_;
     std::vector<std::shared_ptr<log_sink>> d_sinks_;
+    //! The sinks set up in code, put back when a configuration stops
+    //! routing sinks; meaningful while `d_config_routed_`.
+    std::vector<std::shared_ptr<log_sink>> d_code_sinks_;
     std::string d_name_;
     std::mutex d_sinks_mutex_;
+    bool d_copy_entries_;
+    bool d_config_routed_;
+    //! Configuration generation this logger last synced with, and the
+    //! registry's current one.
+    std::atomic<std::uint64_t> d_config_gen_;
+    const std::atomic<std::uint64_t>* d_registry_gen_;
+    log_metrics d_metrics_;
+    //! Suppressed records at or above `d_backtrace_level_` are captured
+    //! in the thread's backtrace ring; records at or above
+    //! `d_backtrace_trigger_` dump it first. Both `off` by default.
+    std::atomic<log_severity> d_backtrace_level_;
+    std::atomic<log_severity> d_backtrace_trigger_;
 
     logger(std::string name,
            std::shared_ptr<log_sink> sink,
-           std::shared_ptr<pooled_log_buffer_factory> factory) noexcept
+           std::shared_ptr<pooled_log_buffer_factory> factory,
+           const std::atomic<std::uint64_t>& config_gen) noexcept
     : d_level_(log_severity::info)
     , d_factory_(std::move(factory))
     , d_sinks_(1, std::move(sink))
+    , d_code_sinks_()
     , d_name_(std::move(name))
     , d_sinks_mutex_()
+    , d_copy_entries_(false)
+    , d_config_routed_(false)
+    , d_config_gen_(0)
+    , d_registry_gen_(&config_gen)
+    , d_metrics_()
+    , d_backtrace_level_(log_severity::off)
+    , d_backtrace_trigger_(log_severity::off)
     {
+        update_copy_entries();
+    }
+
+    //! Take this logger's level and sinks from the registry's current
+    //! configuration. Runs once per logger after each `apply_config`.
+    LDGR_API void sync_config() noexcept;
+
+    void check_config() noexcept
+    {
+        if (d_config_gen_.load(std::memory_order_relaxed) !=
+            d_registry_gen_->load(std::memory_order_acquire)) {
+            sync_config();
+        }
+    }
+
+    //! Write the calling thread's captured records to the sinks. Requires
+    //! `d_sinks_mutex_`.
+    LDGR_API void emit_backtrace();
+
+    void update_copy_entries() noexcept
+    {
+        d_copy_entries_ = std::any_of(
+            d_sinks_.begin(), d_sinks_.end(), [](const auto& s) {
+                return s->is_async();
+            });
     }
 
   public:
@@ -72,26 +152,44 @@ class logger {
         return d_level_.load(std::memory_order_acquire);
     }
 
+    //! Add `sink`. While a configuration routes this logger's sinks, the
+    //! sink is also kept for when the configuration stops routing them.
     void add_sink(std::shared_ptr<log_sink> sink)
     {
         const std::lock_guard<std::mutex> guard{d_sinks_mutex_};
+        if (d_config_routed_ &&
+            std::find(d_code_sinks_.begin(), d_code_sinks_.end(), sink) ==
+                d_code_sinks_.end()) {
+            d_code_sinks_.push_back(sink);
+        }
         for (const auto& s : d_sinks_) {
             if (s == sink) {
                 return;
             }
         }
         d_sinks_.push_back(sink);
+        update_copy_entries();
     }
 
     void remove_sink(std::shared_ptr<log_sink> sink)
     {
         const std::lock_guard<std::mutex> guard{d_sinks_mutex_};
-        d_sinks_.erase(std::remove(d_sinks_.begin(), d_sinks_.end(), sink));
+        d_code_sinks_.erase(
+            std::remove(d_code_sinks_.begin(), d_code_sinks_.end(), sink),
+            d_code_sinks_.end());
+        d_sinks_.erase(std::remove(d_sinks_.begin(), d_sinks_.end(), sink),
+                       d_sinks_.end());
+        update_copy_entries();
     }
 
-    bool should_log(log_severity lvl) const noexcept
+    bool should_log(log_severity lvl) noexcept
     {
-        return lvl >= level();
+        check_config();
+        if (lvl >= level()) {
+            return true;
+        }
+        d_metrics_.add(log_metrics::filtered);
+        return false;
     }
 
     void set_level(log_severity lvl) noexcept
@@ -99,17 +197,76 @@ class logger {
         d_level_.store(lvl, std::memory_order_release);
     }
 
+    //! Keep suppressed records at `capture` and above in a fixed-size
+    //! per-thread ring, and write the thread's ring out ahead of any
+    //! record at `trigger` or above, to give an error the context that
+    //! led up to it. Sinks still apply their own levels and filters.
+    void enable_backtrace(log_severity capture,
+                          log_severity trigger = log_severity::error) noexcept
+    {
+        d_backtrace_trigger_.store(trigger, std::memory_order_relaxed);
+        d_backtrace_level_.store(capture, std::memory_order_relaxed);
+    }
+
+    void disable_backtrace() noexcept
+    {
+        d_backtrace_level_.store(log_severity::off, std::memory_order_relaxed);
+        d_backtrace_trigger_.store(log_severity::off,
+                                   std::memory_order_relaxed);
+    }
+
+    //! Whether a record suppressed by `should_log` goes to the backtrace.
+    bool backtrace_captures(log_severity lvl) const noexcept
+    {
+        return lvl >= d_backtrace_level_.load(std::memory_order_relaxed);
+    }
+
+    //! Write the records this thread captured for this logger, oldest
+    //! first, without waiting for a trigger.
+    void dump_backtrace()
+    {
+        const std::lock_guard<std::mutex> guard{d_sinks_mutex_};
+        emit_backtrace();
+    }
+
     void log(const log_entry& entry)
     {
-        auto cp = log_entry_util::copy_log_entry(entry, true, *d_factory_);
+        check_config();
         const std::lock_guard<std::mutex> guard{d_sinks_mutex_};
+        if (entry.severity >=
+            d_backtrace_trigger_.load(std::memory_order_relaxed)) {
+            emit_backtrace();
+        }
+        // Synchronous sinks consume the entry before we return, so they can
+        // read straight from the caller's staging buffer.
+        const auto cp =
+            d_copy_entries_
+                ? log_entry_util::copy_log_entry(entry, true, *d_factory_)
+                : log_entry_util::view_log_entry(entry, true);
         for (const auto& s : d_sinks_) {
             s->log(cp);
         }
+        d_metrics_.add(log_metrics::logged);
+    }
+
+    //! Counters and the `call` timing of this logger's log statements.
+    log_metrics& metrics() noexcept
+    {
+        return d_metrics_;
+    }
+
+    void flush()
+    {
+        const std::lock_guard<std::mutex> guard{d_sinks_mutex_};
+        for (const auto& s : d_sinks_) {
+            s->flush();
+        }
     }
 };
 
 class log_registry {
+    friend class logger;
+
     struct hasher {
         std::size_t operator()(const fmt::string_view& x) const noexcept
         {
@@ -126,11 +283,14 @@ class log_registry {
     std::shared_ptr<log_sink> d_default_sink_{log_sink_factory::stderr_sink()};
     std::shared_ptr<pooled_log_buffer_factory> d_factory_{
         pooled_log_buffer_factory::create()};
+    std::atomic<std::uint64_t> d_config_gen_{0};
+    std::shared_ptr<const dtl::log_config_state> d_config_{};
+    std::mutex d_config_mutex_{};
     std::unordered_map<fmt::string_view, std::shared_ptr<logger>, hasher>
         d_loggers_{std::make_pair(
             fmt::string_view{"ROOT", 4},
-            std::shared_ptr<logger>{
-                new logger{"ROOT", d_default_sink_, d_factory_}})};
+            std::shared_ptr<logger>{new logger{
+                "ROOT", d_default_sink_, d_factory_, d_config_gen_}})};
     std::mutex d_logger_mutex_{};
 
   public:
@@ -145,10 +305,54 @@ class log_registry {
         auto l = std::shared_ptr<logger>(
             new logger{std::string{logger_name.data(), logger_name.size()},
                        s.d_default_sink_,
-                       s.d_factory_});
+                       s.d_factory_,
+                       s.d_config_gen_});
         s.d_loggers_[l->name()] = l;
+        l->sync_config();
         return *l;
     }
+
+    //! Flush every sink of every logger.
+    LDGR_API static void flush_all();
+
+    //! Apply a JSON configuration (schema: `msg/configmsg.py`) of levels
+    //! per category and sinks with their layouts and routes. Everything is
+    //! built first and then published with a single atomic swap; each
+    //! logger switches over whole on its next call, so no record sees a
+    //! half-applied configuration. Loggers matching no level rule get
+    //! `info`; with sinks configured, loggers matching no route get none,
+    //! and a later configuration without sinks gives loggers back the
+    //! sinks they had in code. `stdout` and `stderr` sinks are new
+    //! `log_sink_factory::fd_sink`s, not the shared ones.
+    //! Sinks whose type and path are unchanged are reused across calls.
+    //! Throws `std::runtime_error` (or `std::system_error` from opening a
+    //! sink) and leaves the current configuration in place on error.
+    LDGR_API static void apply_config(const std::string& json);
+
+    //! `apply_config` with the contents of the file at `path`.
+    LDGR_API static void load_config(const std::string& path);
+
+    //! Snapshot the metrics of every logger and of every sink attached to
+    //! one. All zero unless built with `LDGR_HAVE_METRICS`.
+    LDGR_API static log_metrics_report metrics();
+
+    //! Install handlers for SIGSEGV, SIGABRT, SIGBUS, SIGILL and SIGFPE
+    //! that emergency-flush every live sink, write a final FATAL record
+    //! describing the signal to `fd` using only async-signal-safe calls,
+    //! and then re-raise the signal with the previous disposition. Nothing
+    //! is added to the logging fast path. No-op on non-POSIX platforms.
+    //! The handler runs on a per-thread alternate stack, so it survives a
+    //! stack overflow: the calling thread gets one now, and other threads
+    //! with their first log record (see `install_crash_stack`).
+    LDGR_API static void install_crash_handler(int fd = 2);
+
+    //! Restore the signal dispositions saved by `install_crash_handler`.
+    LDGR_API static void uninstall_crash_handler();
+
+    //! Give the calling thread its alternate stack for the crash handler,
+    //! freed when the thread exits. Only needed on threads that logged
+    //! before `install_crash_handler` ran, or that never log.
+    LDGR_API static void install_crash_stack();
 };
 
 namespace dtl {
@@ -186,16 +390,36 @@ auto derive_types(ARGS&&...) -> format_checker<std::tuple<ARGS...>>
 
 } // namespace ldgr
 
-#define LDGR__STR2(x) #x
-#define LDGR__STR(x) LDGR__STR2(x)
-
 #define LDGR__LOG_IMPL(lvl, cat, fmtstr, ...)                                 \
     do {                                                                      \
+        using ldgr_site_args =                                                \
+            decltype(::ldgr::dtl::log_site_args(__VA_ARGS__));                \
+        LDGR__SITE_STORAGE ::ldgr::log_site ldgr_site =                      \
+            ::ldgr::dtl::make_log_site<ldgr_site_args>(                       \
+                ::ldgr::log_severity::lvl,                                    \
+                ::ldgr::dtl::is_site_category<decltype((cat))>::value         \
+                    ? ::ldgr::fmtutil::to_view(cat)                           \
+                    : ::fmt::string_view{},                                   \
+                ::ldgr::fmtutil::to_view(__FILE__),                           \
+                __LINE__,                                                     \
+                ::fmt::string_view{fmtstr});                                  \
+        const auto ldgr_mode = ::ldgr::dtl::log_site_mode_of(ldgr_site);      \
+        if (ldgr_mode == ::ldgr::log_site_mode::off) {                        \
+            break;                                                            \
+        }                                                                     \
         auto& l = ::ldgr::log_registry::get(cat);                             \
-        if (!l.should_log(::ldgr::log_severity::lvl)) {                       \
+        if (ldgr_mode != ::ldgr::log_site_mode::on &&                         \
+            !l.should_log(::ldgr::log_severity::lvl)) {                       \
+            if (l.backtrace_captures(::ldgr::log_severity::lvl)) {            \
+                ::ldgr::dtl::capture_backtrace(                               \
+                    &l, ldgr_site, ##__VA_ARGS__);                            \
+            }                                                                 \
             break;                                                            \
         }                                                                     \
-        ::ldgr::log_buffer_t buff;                                            \
+        const ::ldgr::log_metrics_timer ldgr_timer{                           \
+            l.metrics(), ::ldgr::log_metrics::call};                          \
+        ::ldgr::staging_buffer staged;                                        \
+        auto& buff = staged.get();                                            \
         using compile_time_format =                                           \
             decltype(::ldgr::dtl::derive_types(__VA_ARGS__));                 \
         if constexpr (compile_time_format::value) {                           \
@@ -207,14 +431,16 @@ auto derive_types(ARGS&&...) -> format_checker<std::tuple<ARGS...>>
             ::fmt::format_to(                                                 \
                 ::std::back_inserter(buff), fmtstr, ##__VA_ARGS__);           \
         }                                                                     \
-        ::ldgr::log_entry entry{                                              \
-            ::ldgr::log_severity::lvl,                                        \
-            ::ldgr::fmtutil::to_view(cat),                                    \
-            ::ldgr::fmtutil::to_view(__FILE__),                               \
-            ::ldgr::fmtutil::to_view(LDGR__STR(__LINE__)),                    \
-            ::std::chrono::system_clock::now(),                               \
-            ::ldgr::fmtutil::to_view(buff)};                                  \
+        const auto entry = ::ldgr::log_entry_util::from_site(                 \
+            ldgr_site,                                                        \
+            ::ldgr::log_clock::now(),                                         \
+            ::ldgr::fmtutil::to_view(buff),                                   \
+            l.name());                                                        \
         l.log(entry);                                                         \
+        if constexpr (::ldgr::log_severity::lvl ==                            \
+                      ::ldgr::log_severity::fatal) {                          \
+            ::ldgr::log_registry::flush_all();                                \
+        }                                                                     \
     } while (0)
 
 #define LDGR_CAT_TRACE(cat, fmtstr, ...)                                      \
@@ -0,0 +1,324 @@
+//! @file logmetrics.hpp
+//! @brief Logging self-instrumentation: counters and latency histograms.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_LOGMETRICS_HPP
+#define INCLUDED_LDGR_LOGMETRICS_HPP
+
+#include <ldgr/exports.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ldgr {
+
+class log_sink;
+
+namespace dtl {
+
+//! This thread's metrics slot plus one, 0 until first use.
+inline thread_local unsigned t_metrics_slot = 0;
+inline thread_local unsigned t_metrics_countdown = 0;
+
+//! The calling thread's slot, allocated on first use and handed back when
+//! the thread exits; `log_metrics::thread_slots` once all are taken.
+LDGR_API unsigned acquire_metrics_slot() noexcept;
+
+inline unsigned metrics_thread_slot() noexcept
+{
+    auto& slot = t_metrics_slot;
+    if (!slot) {
+        slot = acquire_metrics_slot() + 1;
+    }
+    return slot - 1;
+}
+
+} // namespace dtl
+
+//! Latency distribution in nanoseconds with HDR-style log-linear buckets:
+//! eight per power of two, so any reported value is within 12.5% of the
+//! recorded one. Values past ~36 minutes land in the last bucket.
+struct LDGR_API log_histogram {
+    static constexpr unsigned sub_bucket_bits = 3;
+    static constexpr std::size_t bucket_count = 312;
+
+    std::array<std::uint64_t, bucket_count> counts{};
+    std::uint64_t count{0};
+    std::uint64_t sum_ns{0};
+    std::uint64_t max_ns{0};
+
+    static std::size_t bucket_of(std::uint64_t ns) noexcept
+    {
+        constexpr std::uint64_t sub = std::uint64_t{1} << sub_bucket_bits;
+        if (ns < sub) {
+            return static_cast<std::size_t>(ns);
+        }
+        unsigned e = 63;
+        while (!(ns >> e)) {
+            --e;
+        }
+        const auto idx = (e - sub_bucket_bits + 1) * sub +
+                         ((ns >> (e - sub_bucket_bits)) & (sub - 1));
+        return idx < bucket_count ? static_cast<std::size_t>(idx)
+                                  : bucket_count - 1;
+    }
+
+    //! Largest value that maps to bucket `idx`.
+    static std::uint64_t bucket_upper(std::size_t idx) noexcept;
+
+    //! Value at quantile `q` in [0, 1] (bucket upper bound, capped at the
+    //! largest recorded value); 0 when empty.
+    std::uint64_t percentile(double q) const noexcept;
+
+    double mean() const noexcept
+    {
+        return count ? static_cast<double>(sum_ns) / count : 0.0;
+    }
+
+    void merge(const log_histogram& other) noexcept;
+};
+
+//! Totals for one logger or sink. Loggers fill `logged`, `filtered` and
+//! the `call` histogram; sinks fill the rest.
+struct log_metrics_snapshot {
+    std::uint64_t logged{0};   //!< records accepted
+    std::uint64_t filtered{0}; //!< records rejected by level or filter
+    std::uint64_t dropped{0};  //!< records a sink accepted but lost
+    std::uint64_t bytes{0};    //!< formatted bytes handed to the sink
+    log_histogram call;        //!< log statement, formatting included
+    log_histogram format;      //!< sink formatter
+    log_histogram write;       //!< sink `do_log`
+};
+
+//! Counters and latency histograms owned by a logger or sink. Each thread
+//! updates its own shard with plain relaxed stores, so the hot path never
+//! takes a lock or a locked instruction; `snapshot()` merges the shards.
+//! Latencies are sampled (see `set_sample_period`) to keep clock reads
+//! off most calls. Compiled out unless `LDGR_HAVE_METRICS` is defined.
+class LDGR_API log_metrics {
+  public:
+    enum counter : unsigned { logged, filtered, bytes, counter_count };
+    enum timer : unsigned { call, format, write, timer_count };
+
+    //! Threads beyond this many share one shard updated with atomic adds.
+    static constexpr unsigned thread_slots = 32;
+
+    log_metrics() noexcept;
+    log_metrics(const log_metrics&) = delete;
+    log_metrics& operator=(const log_metrics&) = delete;
+    ~log_metrics();
+
+    void add(counter c, std::uint64_t n = 1) noexcept
+    {
+#if defined(LDGR_HAVE_METRICS)
+        const auto slot = thread_slot();
+        if (auto* s = shard_for(slot)) {
+            bump(s->counters[c], n, slot);
+        }
+#else
+        static_cast<void>(c);
+        static_cast<void>(n);
+#endif
+    }
+
+    void record(timer t, std::chrono::nanoseconds elapsed) noexcept
+    {
+#if defined(LDGR_HAVE_METRICS)
+        const auto slot = thread_slot();
+        if (auto* s = shard_for(slot)) {
+            const auto ns = static_cast<std::uint64_t>(elapsed.count());
+            auto& h = s->timers[t];
+            bump(h.buckets[log_histogram::bucket_of(ns)], 1, slot);
+            bump(h.count, 1, slot);
+            bump(h.sum_ns, ns, slot);
+            auto prev = h.max_ns.load(std::memory_order_relaxed);
+            while (ns > prev && !h.max_ns.compare_exchange_weak(
+                                    prev, ns, std::memory_order_relaxed)) {
+            }
+        }
+#else
+        static_cast<void>(t);
+        static_cast<void>(elapsed);
+#endif
+    }
+
+    //! `true` on one call in every sample period on this thread; callers
+    //! time the operation only then.
+    static bool sample() noexcept
+    {
+#if defined(LDGR_HAVE_METRICS)
+        auto& countdown = dtl::t_metrics_countdown;
+        if (countdown) {
+            --countdown;
+            return false;
+        }
+        countdown = s_sample_period.load(std::memory_order_relaxed) - 1;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    //! Time one call in every `period` (at least 1; default 16). Takes
+    //! effect at once on the calling thread and on other threads after
+    //! their current period ends.
+    static void set_sample_period(unsigned period) noexcept
+    {
+        s_sample_period.store(period ? period : 1, std::memory_order_relaxed);
+#if defined(LDGR_HAVE_METRICS)
+        dtl::t_metrics_countdown = 0;
+#endif
+    }
+
+    //! `dropped` is left at 0; sinks report it themselves.
+    log_metrics_snapshot snapshot() const;
+
+  private:
+    struct timer_data {
+        std::atomic<std::uint64_t> count;
+        std::atomic<std::uint64_t> sum_ns;
+        std::atomic<std::uint64_t> max_ns;
+        std::atomic<std::uint64_t> buckets[log_histogram::bucket_count];
+    };
+
+    struct shard {
+        std::atomic<std::uint64_t> counters[counter_count];
+        timer_data timers[timer_count];
+    };
+
+    static std::atomic<unsigned> s_sample_period;
+
+    static unsigned thread_slot() noexcept
+    {
+        return dtl::metrics_thread_slot();
+    }
+
+    static void
+    bump(std::atomic<std::uint64_t>& a, std::uint64_t n, unsigned slot)
+    {
+        if (slot < thread_slots) {
+            // Only this thread writes the slot; readers tolerate staleness.
+            a.store(a.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+        }
+        else {
+            a.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    shard* shard_for(unsigned slot) noexcept
+    {
+        auto& p = d_shards_[slot < thread_slots ? slot : thread_slots];
+        auto* s = p.load(std::memory_order_acquire);
+        return s ? s : make_shard(p);
+    }
+
+    shard* make_shard(std::atomic<shard*>& p) noexcept;
+
+    std::atomic<shard*> d_shards_[thread_slots + 1];
+};
+
+//! Times a scope into `metrics` when `log_metrics::sample()` picks it.
+class log_metrics_timer {
+    log_metrics* d_metrics_;
+    log_metrics::timer d_timer_;
+    std::chrono::steady_clock::time_point d_start_{};
+
+  public:
+    log_metrics_timer(log_metrics& metrics, log_metrics::timer t) noexcept
+    : d_metrics_(log_metrics::sample() ? &metrics : nullptr), d_timer_(t)
+    {
+        if (d_metrics_) {
+            d_start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    log_metrics_timer(const log_metrics_timer&) = delete;
+    log_metrics_timer& operator=(const log_metrics_timer&) = delete;
+
+    ~log_metrics_timer()
+    {
+        if (d_metrics_) {
+            d_metrics_->record(d_timer_,
+                               std::chrono::steady_clock::now() - d_start_);
+        }
+    }
+};
+
+//! Everything `log_registry::metrics()` knows, loggers by name and sinks
+//! by identity along with the loggers feeding them.
+struct log_metrics_report {
+    struct logger_metrics {
+        std::string name;
+        log_metrics_snapshot metrics;
+    };
+
+    struct sink_metrics {
+        std::shared_ptr<log_sink> sink;
+        std::vector<std::string> loggers;
+        log_metrics_snapshot metrics;
+    };
+
+    std::vector<logger_metrics> loggers;
+    std::vector<sink_metrics> sinks;
+};
+
+//! One line per logger or sink that has seen activity, e.g.
+//! `logger APP logged=10 filtered=2 call[p50=180ns p99=1.2us max=9us]`.
+LDGR_API std::vector<std::string>
+format_metrics_report(const log_metrics_report& report);
+
+//! Logs `format_metrics_report(log_registry::metrics())` to `out` every
+//! `interval` from a background thread, as `info` records in category
+//! `LDGR.METRICS`. Attach it to a sink no logger uses, or its own records
+//! show up in the report.
+class LDGR_API log_metrics_reporter {
+    struct impl;
+    std::unique_ptr<impl> d_impl_;
+
+  public:
+    explicit log_metrics_reporter(
+        std::shared_ptr<log_sink> out,
+        std::chrono::milliseconds interval = std::chrono::seconds(60));
+
+    log_metrics_reporter(const log_metrics_reporter&) = delete;
+    log_metrics_reporter& operator=(const log_metrics_reporter&) = delete;
+
+    //! Emits a final report, then stops.
+    ~log_metrics_reporter();
+
+    //! Emit a report now.
+    void report();
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_LOGMETRICS_HPP*/
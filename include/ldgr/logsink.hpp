@@ -29,23 +29,131 @@
 #include <ldgr/exports.h>
 #include <ldgr/fmtutil.hpp>
 #include <ldgr/logentry.hpp>
+#include <ldgr/logfilter.hpp>
+#include <ldgr/logmetrics.hpp>
 
 #include <fmt/compile.h>
 #include <fmt/format.h>
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <functional>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace ldgr {
 
+namespace dtl {
+
+//! `std::mutex` that remembers which thread holds it, so a crash handler
+//! can tell whether it interrupted the owner: `try_lock` on a mutex the
+//! caller already holds is undefined. Waits need
+//! `std::condition_variable_any`.
+class sink_mutex {
+    std::mutex d_mutex_;
+    std::atomic<std::thread::id> d_owner_{};
+
+  public:
+    void lock()
+    {
+        d_mutex_.lock();
+        d_owner_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    }
+
+    bool try_lock() noexcept
+    {
+        if (!d_mutex_.try_lock()) {
+            return false;
+        }
+        d_owner_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        return true;
+    }
+
+    void unlock() noexcept
+    {
+        d_owner_.store(std::thread::id{}, std::memory_order_relaxed);
+        d_mutex_.unlock();
+    }
+
+    //! `try_lock` for `do_emergency_flush`: fails when the calling thread
+    //! crashed while holding the lock, instead of relocking it.
+    bool try_lock_from_crash() noexcept
+    {
+        if (d_owner_.load(std::memory_order_relaxed) ==
+            std::this_thread::get_id()) {
+            return false;
+        }
+        return try_lock();
+    }
+};
+
+} // namespace dtl
+
+//! `<time> [<LEVEL>] [<thread id>:<name>@<cpu>] <category> <file>:<line>
+//! {<context>} <message>`, followed by a newline. The thread name, CPU and
+//! context appear only when present.
 LDGR_API void default_formatter(log_buffer_t& buff,
                                 const log_entry_fmt_cp& ent,
                                 std::time_t& cached_time,
                                 std::string& cached_str);
 
+//! `default_formatter` with `PREC` sub-second digits, e.g.
+//! `default_formatter_at<time_precision::nanoseconds>`. Instantiated for
+//! every `time_precision`.
+template <time_precision PREC>
+LDGR_API void default_formatter_at(log_buffer_t& buff,
+                                   const log_entry_fmt_cp& ent,
+                                   std::time_t& cached_time,
+                                   std::string& cached_str);
+
+//! RFC 5424 syslog line (facility `user`) without a trailing newline:
+//! `<PRI>1 TIMESTAMP HOST APP PID CATEGORY - file:line message`.
+LDGR_API void syslog_formatter(log_buffer_t& buff,
+                               const log_entry_fmt_cp& ent,
+                               std::time_t& cached_time,
+                               std::string& cached_str);
+
+//! One JSON object per record, without a trailing newline: `time`,
+//! `level`, `category`, `file`, `line` and `message` as strings, plus a
+//! `context` object when the record carries diagnostic context fields.
+LDGR_API void json_formatter(log_buffer_t& buff,
+                             const log_entry_fmt_cp& ent,
+                             std::time_t& cached_time,
+                             std::string& cached_str);
+
+//! `json_formatter` with `PREC` sub-second digits in `time`.
+template <time_precision PREC>
+LDGR_API void json_formatter_at(log_buffer_t& buff,
+                                const log_entry_fmt_cp& ent,
+                                std::time_t& cached_time,
+                                std::string& cached_str);
+
+//! systemd-journald native protocol record (`KEY=value` lines, with the
+//! length-prefixed form for values containing newlines). Context fields
+//! become `LDGR_CTX_<KEY>`.
+LDGR_API void journald_formatter(log_buffer_t& buff,
+                                 const log_entry_fmt_cp& ent,
+                                 std::time_t& cached_time,
+                                 std::string& cached_str);
+
+//! Layout driven by `pattern`, followed by a newline. Directives: `%d`
+//! local/UTC timestamp as in `default_formatter`, `%i` RFC 3339 timestamp,
+//! `%l` severity name, `%c` category, `%f` source file (trimmed like
+//! `default_formatter`), `%F` full source path, `%n` line, `%m` message,
+//! `%X` context fields as `k=v k2=v2`, `%X{key}` one context field's value,
+//! `%t` thread id, `%T` thread name, `%P` CPU (-1 unless captured) and
+//! `%%`. Anything else is copied through. `%d` and `%i` take an optional
+//! precision, `{s}`, `{ms}`, `{us}` (the default) or `{ns}`.
+LDGR_API void pattern_formatter(log_buffer_t& buff,
+                                const log_entry_fmt_cp& ent,
+                                fmt::string_view pattern,
+                                std::time_t& cached_time,
+                                std::string& cached_str);
+
 struct log_formatter {
     using format_fn = void (*)(log_buffer_t&,
                                const log_entry_fmt_cp&,
@@ -55,6 +163,9 @@ struct log_formatter {
     struct as_vec {
     };
 
+    struct as_pattern {
+    };
+
     log_formatter(format_fn f): d_fmt_fn_{f}, d_is_vec_{false}
     {
     }
@@ -64,9 +175,16 @@ struct log_formatter {
         ::new ((void*)&d_vec_) std::vector<format_fn>{};
     }
 
+    //! Formats records with `pattern_formatter`.
+    log_formatter(const as_pattern&, std::string pattern)
+    : d_fmt_fn_{nullptr}, d_is_vec_{false}, d_pattern_{std::move(pattern)}
+    {
+    }
+
     log_formatter(const log_formatter& fmt)
     {
         d_is_vec_ = fmt.d_is_vec_;
+        d_pattern_ = fmt.d_pattern_;
         if (d_is_vec_) {
             ::new ((void*)&d_vec_) std::vector<format_fn>(fmt.vec());
         }
@@ -93,9 +211,16 @@ struct log_formatter {
                 f(buff, ent, d_cached_time_, d_cached_str_);
             }
         }
-        else {
+        else if (d_fmt_fn_) {
             d_fmt_fn_(buff, ent, d_cached_time_, d_cached_str_);
         }
+        else {
+            pattern_formatter(buff,
+                              ent,
+                              fmtutil::to_view(d_pattern_),
+                              d_cached_time_,
+                              d_cached_str_);
+        }
     }
 
     std::vector<format_fn>& vec()
@@ -121,6 +246,7 @@ struct log_formatter {
         std::aligned_storage_t<sizeof(std::vector<format_fn>)> d_vec_;
     };
     bool d_is_vec_{false};
+    std::string d_pattern_{};
     mutable std::time_t d_cached_time_{};
     mutable std::string d_cached_str_{};
 };
@@ -129,14 +255,38 @@ class LDGR_API log_sink {
   public:
     virtual ~log_sink();
 
+    //! Invoke `fn(sink)` for every live sink. Lock-free and
+    //! async-signal-safe; meant for crash handlers, which cannot take the
+    //! locks that guard the loggers' sink lists.
+    static void for_each_live(void (*fn)(log_sink&) noexcept) noexcept;
+
     void log(const log_entry_fmt_cp& entry)
     {
         if (!should_log(entry.entry.severity)) {
+            d_metrics_.add(log_metrics::filtered);
+            return;
+        }
+        const auto* f = d_filter_.load(std::memory_order_acquire);
+        if (f && !f->accepts(entry.entry)) {
+            d_metrics_.add(log_metrics::filtered);
             return;
         }
         log_buffer_t buff;
-        formatter()->format(buff, entry);
-        do_log(buff);
+        if (log_metrics::sample()) {
+            using clock = std::chrono::steady_clock;
+            const auto start = clock::now();
+            formatter()->format(buff, entry);
+            const auto formatted = clock::now();
+            do_log(buff);
+            d_metrics_.record(log_metrics::format, formatted - start);
+            d_metrics_.record(log_metrics::write, clock::now() - formatted);
+        }
+        else {
+            formatter()->format(buff, entry);
+            do_log(buff);
+        }
+        d_metrics_.add(log_metrics::logged);
+        d_metrics_.add(log_metrics::bytes, buff.size());
     }
 
     void flush()
@@ -144,6 +294,21 @@ class LDGR_API log_sink {
         do_flush();
     }
 
+    //! Push anything still buffered out with async-signal-safe calls only
+    //! (e.g. `write(2)`). Called from fatal signal handlers.
+    void emergency_flush() noexcept
+    {
+        do_emergency_flush();
+    }
+
+    //! Sinks that hold on to entries past `log()` must return `true`, so
+    //! that loggers hand them an owned (pooled) copy instead of a view into
+    //! the caller's staging buffer.
+    virtual bool is_async() const noexcept
+    {
+        return false;
+    }
+
     log_severity level() const noexcept
     {
         return d_level_.load(std::memory_order_acquire);
@@ -171,22 +336,112 @@ class LDGR_API log_sink {
         d_formatter_ = std::move(formatter);
     }
 
+    //! Counters and timings for this sink; see `log_registry::metrics()`.
+    const log_metrics& metrics() const noexcept
+    {
+        return d_metrics_;
+    }
+
+    //! Records this sink accepted but could not deliver, for sinks that
+    //! drop rather than block.
+    virtual std::uint64_t dropped_records() const noexcept
+    {
+        return 0;
+    }
+
+    //! Filter applied after the level check and before formatting; null
+    //! passes everything.
+    const log_filter* filter() const noexcept
+    {
+        return d_filter_.load(std::memory_order_acquire);
+    }
+
+    //! Swap the filter without blocking concurrent `log()` calls. Filters
+    //! set on a sink are kept alive until the sink is destroyed, so a
+    //! reader never sees a freed one; swap them at configuration time, not
+    //! per record.
+    void set_filter(std::shared_ptr<const log_filter> filter);
+
   protected:
+    log_sink() noexcept;
+
+    //! Take this sink out of the set `for_each_live` visits, waiting for a
+    //! crash handler that is flushing it right now. Sinks overriding
+    //! `do_emergency_flush` call this first thing in their destructor, so
+    //! no handler runs on a half-destroyed sink. Idempotent.
+    void retire() noexcept;
+
     std::atomic<log_severity> d_level_{log_severity::trace};
     std::shared_ptr<const log_formatter> d_formatter_{default_fmt()};
     mutable std::mutex d_formatter_mutex_{};
+    std::atomic<const log_filter*> d_filter_{nullptr};
+    std::vector<std::shared_ptr<const log_filter>> d_filters_{};
+    log_metrics d_metrics_{};
 
   private:
     virtual void do_log(const log_buffer_t& buff) = 0;
     virtual void do_flush() = 0;
 
+    //! Sinks that buffer or queue records override this (and call
+    //! `retire` from their destructor); the default has nothing pending.
+    virtual void do_emergency_flush() noexcept
+    {
+    }
+
     static std::shared_ptr<const log_formatter> default_fmt();
 };
 
+class capture_sink;
+class counting_sink;
+
 struct LDGR_API log_sink_factory {
     static std::shared_ptr<log_sink> stdout_sink();
 
     static std::shared_ptr<log_sink> stderr_sink();
+
+    //! A new sink writing each record to `fd` with `write`; `fd` stays
+    //! open. Unlike `stdout_sink()`, `fd_sink(1)` has a level and
+    //! formatter of its own.
+    static std::shared_ptr<log_sink> fd_sink(int fd);
+
+    //! Discard records, formatting them first unless `format` is false
+    //! (see `null_sink`).
+    static std::shared_ptr<log_sink> null_sink(bool format = true);
+
+    //! Keep the last `capacity` records in memory (see `capture_sink`).
+    static std::shared_ptr<ldgr::capture_sink>
+    capture_sink(std::size_t capacity = 1024);
+
+    //! Count records and bytes per thread (see `counting_sink`).
+    static std::shared_ptr<ldgr::counting_sink>
+    counting_sink(bool format = true);
+
+    //! Append to `path` through stdio, flushing after every record.
+    static std::shared_ptr<log_sink> file_sink(const std::string& path);
+
+    //! Append to `path` with batched io_uring writes (`uring_file_sink`),
+    //! or fall back to `file_sink` where io_uring is unavailable.
+    static std::shared_ptr<log_sink> async_file_sink(const std::string& path);
+
+    //! Append to `path` with `O_DIRECT` block writes (`direct_file_sink`),
+    //! keeping log output out of the page cache.
+    static std::shared_ptr<log_sink>
+    direct_file_sink(const std::string& path);
+
+    //! Sink writing each record into the shared-memory ring `name` (see
+    //! `shm_ring`), creating the ring if needed. Logging never blocks on a
+    //! slow consumer; drain it with `ldgr-shmd`.
+    static std::shared_ptr<log_sink> shm_sink(const std::string& name,
+                                              std::size_t slot_count = 4096,
+                                              std::size_t slot_size = 512);
+
+    //! RFC 5424 records to the local syslog daemon (see `unix_dgram_sink`).
+    static std::shared_ptr<log_sink>
+    syslog_sink(const std::string& path = "/dev/log");
+
+    //! journald native records to the systemd journal.
+    static std::shared_ptr<log_sink>
+    journald_sink(const std::string& path = "/run/systemd/journal/socket");
 };
 
 } // namespace ldgr
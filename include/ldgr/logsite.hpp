@@ -0,0 +1,214 @@
+//! @file logsite.hpp
+//! @brief Static per-call-site log metadata.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_LOGSITE_HPP
+#define INCLUDED_LDGR_LOGSITE_HPP
+
+#include <ldgr/exports.h>
+#include <ldgr/fmtutil.hpp>
+#include <ldgr/logseverity.hpp>
+
+#include <fmt/format.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ldgr {
+
+//! Broad kind of one formatted argument, as recorded for a call site.
+enum class log_arg_type : std::uint8_t {
+    boolean,
+    character,
+    signed_integer,
+    unsigned_integer,
+    floating,
+    string,
+    pointer,
+    custom,
+};
+
+//! Whether a call site logs, set at runtime through `log_sites`.
+enum class log_site_mode : std::uint8_t {
+    level = 1, //!< as its category's level decides (the default)
+    on,        //!< whatever its category's level
+    off,       //!< never
+};
+
+//! Everything about a logging call that is fixed at compile time. Each
+//! `LDGR_*` expansion owns one in static storage, and records logged there
+//! point back to it, so its strings outlive every record.
+struct log_site {
+    log_severity severity;
+    //! Empty unless the call names its category with a string literal;
+    //! other categories may change from call to call.
+    fmt::string_view category;
+    fmt::string_view file;
+    std::uint32_t line;
+    //! Offset of `fmtutil::trunc_file(file)` within `file`.
+    std::uint32_t file_base;
+    fmt::string_view format;
+    const log_arg_type* arg_types; //!< `arg_count` entries
+    std::size_t arg_count;
+    //! A `log_site_mode`, or 0 until the site first logs and registers.
+    std::atomic<std::uint8_t> mode{0};
+
+    constexpr fmt::string_view short_file() const noexcept
+    {
+        return fmt::string_view{file.data() + file_base,
+                                file.size() - file_base};
+    }
+};
+
+//! Runtime switches for individual call sites, in the spirit of Linux
+//! dynamic debug. A site is known once it has logged (or tried to); rules
+//! are kept, so sites reached later pick them up, and later rules win.
+//! Sites whose category is not a string literal have no category of their
+//! own (see `log_site::category`), so only `file:line` rules reach them.
+struct log_sites {
+    //! Set the mode of every site whose category, or whose `file:line`
+    //! with either the full or the trimmed path, matches the glob
+    //! `pattern` (`*` any run of characters, `?` any one). Returns how many
+    //! known sites matched.
+    LDGR_API static std::size_t set(fmt::string_view pattern,
+                                    log_site_mode mode);
+
+    //! `set` with an ECMAScript regular expression searched for in the
+    //! same keys. Throws `std::regex_error` for an invalid `regex`.
+    LDGR_API static std::size_t set_regex(const std::string& regex,
+                                          log_site_mode mode);
+
+    //! Drop every rule and return all sites to `log_site_mode::level`.
+    LDGR_API static void reset();
+
+    //! The sites known so far, in the order they first logged.
+    LDGR_API static std::vector<const log_site*> list();
+};
+
+//! Storage of the `log_site` in each logging macro. Sites are always
+//! constant-initialized, so their first use costs no guard; C++20 checks
+//! it.
+#if defined(__cpp_constinit)
+#define LDGR__SITE_STORAGE static constinit
+#else
+#define LDGR__SITE_STORAGE static
+#endif
+
+namespace dtl {
+
+template <class T>
+constexpr log_arg_type log_arg_type_of() noexcept
+{
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same<U, bool>::value) {
+        return log_arg_type::boolean;
+    }
+    else if constexpr (std::is_same<U, char>::value) {
+        return log_arg_type::character;
+    }
+    else if constexpr (std::is_integral<U>::value) {
+        return std::is_signed<U>::value ? log_arg_type::signed_integer
+                                        : log_arg_type::unsigned_integer;
+    }
+    else if constexpr (std::is_floating_point<U>::value) {
+        return log_arg_type::floating;
+    }
+    else if constexpr (std::is_same<U, std::nullptr_t>::value) {
+        return log_arg_type::pointer;
+    }
+    else if constexpr (std::is_convertible<const U&,
+                                           fmt::string_view>::value) {
+        return log_arg_type::string;
+    }
+    else if constexpr (std::is_pointer<U>::value) {
+        return log_arg_type::pointer;
+    }
+    else {
+        return log_arg_type::custom;
+    }
+}
+
+template <class... ARGS>
+struct log_arg_list {
+    static constexpr std::array<log_arg_type, sizeof...(ARGS)> types{
+        {log_arg_type_of<ARGS>()...}};
+};
+
+//! Whether a logging call's category expression of type `T` (as given by
+//! `decltype((cat))`) is a string literal, whose view the call site keeps.
+//! Anything else, such as a `std::string` or `const char*`, is only read
+//! per call.
+template <class T>
+struct is_site_category : std::false_type {
+};
+
+template <std::size_t N>
+struct is_site_category<const char (&)[N]> : std::true_type {
+};
+
+//! Names the argument types of a logging call; only used unevaluated.
+template <class... ARGS>
+auto log_site_args(ARGS&&...) -> log_arg_list<ARGS...>;
+
+//! Add `site` to the registry and apply the matching rules. Returns
+//! `level`, leaving the site unregistered, if memory runs out.
+LDGR_API log_site_mode register_log_site(log_site& site) noexcept;
+
+//! The site's mode, registering it on its first call. One relaxed load
+//! after that.
+inline log_site_mode log_site_mode_of(log_site& site) noexcept
+{
+    const auto mode = site.mode.load(std::memory_order_relaxed);
+    return mode != 0 ? static_cast<log_site_mode>(mode)
+                     : register_log_site(site);
+}
+
+template <class ARG_LIST>
+constexpr log_site make_log_site(log_severity severity,
+                                 fmt::string_view category,
+                                 fmt::string_view file,
+                                 std::uint32_t line,
+                                 fmt::string_view format) noexcept
+{
+    return log_site{severity,
+                    category,
+                    file,
+                    line,
+                    fmtutil::trunc_file_offset(file),
+                    format,
+                    ARG_LIST::types.data(),
+                    ARG_LIST::types.size()};
+}
+
+} // namespace dtl
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_LOGSITE_HPP*/
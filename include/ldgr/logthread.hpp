@@ -0,0 +1,116 @@
+//! @file logthread.hpp
+//! @brief Cached thread id, name and CPU of the calling thread.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_LOGTHREAD_HPP
+#define INCLUDED_LDGR_LOGTHREAD_HPP
+
+#include <ldgr/exports.h>
+
+#include <fmt/format.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace ldgr {
+
+namespace dtl {
+
+//! Per-thread cache of what log records report about their thread, so
+//! that the fast path reads thread-local memory instead of making system
+//! calls. Filled on the thread's first record, and again after `fork` in
+//! the child; filling it also sets up the thread's crash stack if needed.
+struct thread_info {
+    std::uint32_t id;     //!< kernel thread id; 0 until looked up
+    std::uint32_t name_size;
+    char name[64];
+};
+
+inline thread_local thread_info t_thread_info{};
+
+inline std::atomic<bool> s_capture_cpu{false};
+
+//! Whether threads give themselves a crash stack (see
+//! `install_crash_stack`) when their info is first filled; set while the
+//! crash handler is installed.
+inline std::atomic<bool> s_crash_stacks{false};
+
+//! Give the calling thread an alternate signal stack of its own, so the
+//! crash handler can run after a stack overflow. Does nothing if the
+//! thread already has one; the stack is freed when the thread exits.
+LDGR_API void install_crash_stack() noexcept;
+
+//! Fill `t_thread_info` and return the thread id.
+LDGR_API std::uint32_t init_thread_info() noexcept;
+
+//! The CPU the caller is running on, or -1 if unknown.
+LDGR_API int current_cpu() noexcept;
+
+} // namespace dtl
+
+struct log_thread {
+    //! The calling thread's kernel thread id (what `gettid()` returns), as
+    //! shown by `top -H`, `gdb` and `perf`.
+    static std::uint32_t id() noexcept
+    {
+        const auto id = dtl::t_thread_info.id;
+        return id ? id : dtl::init_thread_info();
+    }
+
+    //! The calling thread's name, or empty if it has none of its own (on
+    //! Linux, threads start out with the process name; that is not
+    //! reported). Looked up once per thread.
+    static fmt::string_view name() noexcept
+    {
+        auto& info = dtl::t_thread_info;
+        if (!info.id) {
+            dtl::init_thread_info();
+        }
+        return {info.name, info.name_size};
+    }
+
+    //! Name the calling thread in its log records, and in the OS as far
+    //! as it allows (15 characters on Linux).
+    LDGR_API static void set_name(fmt::string_view name) noexcept;
+
+    //! Whether log records capture the CPU they were logged on. Off by
+    //! default; when off, records report CPU -1.
+    static void set_capture_cpu(bool enabled) noexcept
+    {
+        dtl::s_capture_cpu.store(enabled, std::memory_order_relaxed);
+    }
+
+    //! The calling thread's current CPU if CPU capture is on, else -1.
+    static int captured_cpu() noexcept
+    {
+        return dtl::s_capture_cpu.load(std::memory_order_relaxed)
+                   ? dtl::current_cpu()
+                   : -1;
+    }
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_LOGTHREAD_HPP*/
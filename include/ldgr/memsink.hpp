@@ -0,0 +1,111 @@
+//! @file memsink.hpp
+//! @brief In-process sinks: null, capture ring and counting.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_MEMSINK_HPP
+#define INCLUDED_LDGR_MEMSINK_HPP
+
+#include <ldgr/exports.h>
+#include <ldgr/logmetrics.hpp>
+#include <ldgr/logsink.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ldgr {
+
+//! Discards every record, so that benchmarks measure the pipeline rather
+//! than I/O. Records are formatted unless created with `format = false`,
+//! which swaps in a formatter that does nothing.
+class LDGR_API null_sink final : public log_sink {
+    void do_log(const log_buffer_t& buff) override;
+    void do_flush() override;
+
+  public:
+    explicit null_sink(bool format = true);
+};
+
+//! Keeps the last `capacity` formatted records in memory, e.g. to attach
+//! them to a crash report or to inspect them in tests. Older records are
+//! overwritten.
+class LDGR_API capture_sink final : public log_sink {
+    mutable std::mutex d_mutex_;
+    std::vector<std::string> d_ring_;
+    std::uint64_t d_total_{0};
+
+    void do_log(const log_buffer_t& buff) override;
+    void do_flush() override;
+
+  public:
+    explicit capture_sink(std::size_t capacity = 1024);
+
+    std::size_t capacity() const noexcept
+    {
+        return d_ring_.size();
+    }
+
+    //! Records ever captured, including overwritten ones.
+    std::uint64_t total() const noexcept;
+
+    //! The retained records, oldest first.
+    std::vector<std::string> records() const;
+
+    //! Write the retained records, oldest first, to `out`.
+    void dump(std::FILE* out) const;
+
+    void clear() noexcept;
+};
+
+//! Counts records and formatted bytes without keeping them. Each thread
+//! updates its own counter cell (see `log_metrics`), so concurrent loggers
+//! neither lock nor contend. Skips formatting with `format = false`, in
+//! which case `bytes()` stays 0.
+class LDGR_API counting_sink final : public log_sink {
+    struct alignas(64) cell {
+        std::atomic<std::uint64_t> records{0};
+        std::atomic<std::uint64_t> bytes{0};
+    };
+
+    cell d_cells_[log_metrics::thread_slots + 1];
+
+    void do_log(const log_buffer_t& buff) override;
+    void do_flush() override;
+
+  public:
+    explicit counting_sink(bool format = true);
+
+    std::uint64_t records() const noexcept;
+    std::uint64_t bytes() const noexcept;
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_MEMSINK_HPP*/
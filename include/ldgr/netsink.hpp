@@ -0,0 +1,128 @@
+//! @file netsink.hpp
+//! @brief Network log shipper sink.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_NETSINK_HPP
+#define INCLUDED_LDGR_NETSINK_HPP
+
+#include <ldgr/exports.h>
+#include <ldgr/logsink.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace ldgr {
+
+enum class net_framing {
+    //! 4-byte big-endian length followed by the formatted record.
+    length_prefixed,
+    //! One `json_formatter` object per line.
+    json_lines,
+};
+
+struct net_sink_config {
+    net_framing framing{net_framing::length_prefixed};
+    //! Bytes of framed records held in memory while the peer is slow or
+    //! down. Records that do not fit are dropped (see `dropped`).
+    std::size_t spool_bytes{8 * 1024 * 1024};
+    //! File that takes over the spool while the peer is down; empty
+    //! disables spillover. Left-over records from a previous run are sent
+    //! first.
+    std::string spill_path{};
+    //! Upper bound on the spill file's size.
+    std::size_t spill_bytes{256 * 1024 * 1024};
+    //! Reconnect delay, doubled after each failed attempt up to the max.
+    std::chrono::milliseconds backoff_min{100};
+    std::chrono::milliseconds backoff_max{10000};
+    //! Longest `flush()` waits for the spool to drain.
+    std::chrono::milliseconds flush_timeout{1000};
+    //! Longest the destructor waits to deliver what is left.
+    std::chrono::milliseconds shutdown_timeout{1000};
+};
+
+struct net_sink_stats {
+    std::size_t enqueued;         //!< records accepted into the spool
+    std::size_t dropped;          //!< records lost to a full spool or spill
+    std::size_t bytes_sent;       //!< framed bytes written to the peer
+    std::size_t bytes_spilled;    //!< framed bytes moved to the spill file
+    std::size_t bytes_replayed;   //!< spilled bytes since sent to the peer
+    std::size_t spool_bytes;      //!< bytes currently spooled in memory
+    std::size_t spool_peak;       //!< high-water mark of `spool_bytes`
+    std::size_t connects;         //!< successful connections
+    std::size_t connect_failures; //!< failed attempts and dropped links
+    bool connected;               //!< whether the peer is currently up
+};
+
+//! Sink streaming framed records to a collector over TCP or a Unix stream
+//! socket. Log calls only format and append to an in-memory spool; a
+//! private libuv event-loop thread owns the connection, writes the spool
+//! out, reconnects with exponential backoff and, if configured, moves the
+//! spool to disk while the peer is unreachable.
+//!
+//! Delivery is at-least-once: a write that fails part-way is resent in
+//! full on the next connection.
+//!
+//! On a crash the spool is appended to the spill file, if there is one,
+//! and sent on the next run; without `spill_path` it is lost.
+//!
+//! Only available when ldgr is built with `LDGR_WITH_LIBUV`; otherwise the
+//! factories throw `std::system_error` (`ENOSYS`).
+class LDGR_API net_sink final : public log_sink {
+    struct impl;
+    std::unique_ptr<impl> d_impl_;
+
+    explicit net_sink(std::unique_ptr<impl> impl) noexcept;
+
+    void do_log(const log_buffer_t& buff) override;
+    void do_flush() override;
+    void do_emergency_flush() noexcept override;
+
+  public:
+    //! Connect to `host:port`; `host` is resolved once, here.
+    static std::shared_ptr<net_sink>
+    tcp(const std::string& host,
+        unsigned short port,
+        const net_sink_config& config = net_sink_config{});
+
+    //! Connect to the Unix stream socket at `path`.
+    static std::shared_ptr<net_sink>
+    unix_socket(const std::string& path,
+                const net_sink_config& config = net_sink_config{});
+
+    ~net_sink() override;
+
+    net_sink_stats stats() const noexcept;
+
+    std::uint64_t dropped_records() const noexcept override
+    {
+        return stats().dropped;
+    }
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_NETSINK_HPP*/
@@ -0,0 +1,162 @@
+//! @file shmring.hpp
+//! @brief Shared-memory log ring.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef INCLUDED_LDGR_SHMRING_HPP
+#define INCLUDED_LDGR_SHMRING_HPP
+
+#include <ldgr/exports.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ldgr {
+
+//! Layout of the ring's shared-memory segment. Everything is fixed-size so
+//! that a reader in another process (see `ldgr-shmd`) can map it without
+//! knowing anything about the writer.
+//!
+//! Writers claim sequence numbers with a fetch-add on `write_seq` and
+//! record `seq` in slot `seq % slot_count`. Each slot's `state` is
+//! `2 * seq + 1` while its record is being written and `2 * seq + 2` once
+//! committed, so a reader expecting `seq` can tell "not written yet",
+//! "committed" and "overwritten by a later lap" apart. The ring never
+//! blocks writers: when the reader falls more than a lap behind, the oldest
+//! records are overwritten and the reader reports them as lost.
+struct shm_ring_layout {
+    static constexpr std::uint64_t magic = 0x314d485352474c44ull; // LDGRSHM1
+    static constexpr std::uint32_t version = 1;
+
+    struct header {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t slot_size;
+        std::uint64_t slot_count;
+        alignas(64) std::atomic<std::uint64_t> write_seq;
+        alignas(64) std::atomic<std::uint32_t> ready;
+    };
+
+    struct slot {
+        std::atomic<std::uint64_t> state;
+        std::uint32_t size;
+        std::uint32_t flags;
+        // followed by `slot_size - sizeof(slot)` bytes of payload
+    };
+
+    enum slot_flags : std::uint32_t {
+        truncated = 1u, //!< record was cut to fit the slot
+    };
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+                  "shared-memory ring needs address-free 64-bit atomics");
+};
+
+//! POSIX shared-memory (`shm_open` + `mmap`) ring of fixed-size records.
+//! Any number of processes may write; one reader at a time should drain.
+class LDGR_API shm_ring {
+    std::string d_name_;
+    void* d_base_;
+    std::size_t d_map_size_;
+    shm_ring_layout::header* d_header_;
+    unsigned char* d_slots_;
+    std::uint64_t d_mask_;
+
+    shm_ring(std::string name, void* base, std::size_t map_size) noexcept;
+
+    shm_ring_layout::slot& slot_at(std::uint64_t seq) const noexcept
+    {
+        return *reinterpret_cast<shm_ring_layout::slot*>(
+            d_slots_ + (seq & d_mask_) * d_header_->slot_size);
+    }
+
+  public:
+    //! Open the ring called `name` (e.g. "/myapp.log"), creating it with
+    //! `slot_count` slots of `slot_size` bytes if it does not exist yet.
+    //! `slot_count` is rounded up to a power of two. An existing ring keeps
+    //! its own geometry. Throws `std::system_error` on failure.
+    static std::unique_ptr<shm_ring> open(const std::string& name,
+                                          std::size_t slot_count = 4096,
+                                          std::size_t slot_size = 512);
+
+    //! Open an existing ring without creating it.
+    static std::unique_ptr<shm_ring> attach(const std::string& name);
+
+    //! Remove the ring's name; existing mappings stay valid.
+    static void unlink(const std::string& name) noexcept;
+
+    ~shm_ring() noexcept;
+
+    shm_ring(const shm_ring&) = delete;
+    shm_ring& operator=(const shm_ring&) = delete;
+
+    const std::string& name() const noexcept
+    {
+        return d_name_;
+    }
+
+    std::size_t slot_count() const noexcept
+    {
+        return static_cast<std::size_t>(d_header_->slot_count);
+    }
+
+    //! Largest record stored without truncation.
+    std::size_t max_record_size() const noexcept
+    {
+        return d_header_->slot_size - sizeof(shm_ring_layout::slot);
+    }
+
+    //! Sequence number the next record will get.
+    std::uint64_t write_seq() const noexcept
+    {
+        return d_header_->write_seq.load(std::memory_order_acquire);
+    }
+
+    //! Append a record, truncating it to `max_record_size()`. Never blocks;
+    //! lock-free and async-signal-safe.
+    void write(const char* data, std::size_t size) noexcept;
+
+    //! Result of a `read`.
+    enum class read_status {
+        ok,    //!< a record was copied out
+        empty, //!< nothing committed past the reader's position yet
+        lost,  //!< records were overwritten; the reader skipped past them
+    };
+
+    //! Copy record `seq` into `out` (which must hold `max_record_size()`
+    //! bytes). On `ok`, `size` and `flags` describe it and `seq` advances.
+    //! On `lost`, `lost_count` is set and `seq` moves to the oldest record
+    //! still in the ring.
+    read_status read(std::uint64_t& seq,
+                     char* out,
+                     std::size_t& size,
+                     std::uint32_t& flags,
+                     std::uint64_t& lost_count) const noexcept;
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_SHMRING_HPP*/
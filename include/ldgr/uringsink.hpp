@@ -0,0 +1,96 @@
+//! @file uringsink.hpp
+//! @brief io_uring file sink.
+
+/*
+ * zlib License
+ *
+ * (C) 2020 Aaditya Kalsi
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef INCLUDED_LDGR_URINGSINK_HPP
+#define INCLUDED_LDGR_URINGSINK_HPP
+
+#include <ldgr/exports.h>
+#include <ldgr/logentry.hpp>
+#include <ldgr/logsink.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace ldgr {
+
+struct uring_sink_config {
+    //! Size of each batch buffer; defaults to the pool's largest class.
+    std::size_t buffer_size{pooled_log_buffer_factory::size_classes.back()};
+    //! Batch buffers, i.e. the most writes in flight at once. Producers
+    //! wait for a completion when all of them are busy.
+    std::size_t buffer_count{8};
+    //! Longest a partly filled batch waits before it is written anyway.
+    std::chrono::milliseconds flush_interval{10};
+};
+
+struct uring_sink_stats {
+    std::size_t writes;          //!< write requests submitted to the ring
+    std::size_t bytes_written;   //!< bytes the kernel reported written
+    std::size_t producer_waits;  //!< log calls that waited for a buffer
+    std::size_t fallback_writes; //!< writes done with plain `pwrite`
+    bool registered_buffers;     //!< batch buffers are registered
+};
+
+//! Linux file sink that packs records into batch buffers and writes whole
+//! batches through io_uring (raw syscalls, no liburing). Log calls only
+//! copy into the current batch; a dedicated thread submits sealed batches
+//! and reaps completions. Each batch is written at an offset reserved when
+//! it is sealed, so batches in flight concurrently still land in log order.
+//!
+//! The batch buffers are allocated once and registered with the ring
+//! (`IORING_OP_WRITE_FIXED`) when the memlock limit allows. Records larger
+//! than a batch buffer are written synchronously.
+class LDGR_API uring_file_sink final : public log_sink {
+    struct impl;
+    std::unique_ptr<impl> d_impl_;
+
+    explicit uring_file_sink(std::unique_ptr<impl> impl) noexcept;
+
+    void do_log(const log_buffer_t& buff) override;
+    void do_flush() override;
+    void do_emergency_flush() noexcept override;
+
+  public:
+    //! Whether io_uring can be set up in this process (kernel support,
+    //! seccomp policy, ...).
+    static bool available() noexcept;
+
+    //! Open `path` for appending. Throws `std::system_error` if the file
+    //! cannot be opened or io_uring is unavailable.
+    static std::shared_ptr<uring_file_sink>
+    create(const std::string& path,
+           const uring_sink_config& config = uring_sink_config{});
+
+    ~uring_file_sink() override;
+
+    uring_sink_stats stats() const noexcept;
+};
+
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_URINGSINK_HPP*/
@@ -0,0 +1,39 @@
+"""
+ldgr configuration file: category levels and sink routing.
+"""
+
+
+class ConfigLevel(Sequence):
+    """
+    Level for loggers whose category matches `category`: exact, a prefix
+    ending in `*`, or `*` for every category. The most specific match wins.
+    """
+
+    category: str
+    level: str
+
+
+class ConfigSink(Sequence):
+    """
+    A sink and the categories routed to it. `type` is one of `stdout`,
+    `stderr`, `file`, `async_file`, `direct_file`, `syslog` or `journald`;
+    file types need `path`, socket types default it. `pattern` selects a
+    layout (see `pattern_formatter`) and `level` the sink's own threshold.
+    """
+
+    name: str
+    type: str
+    path: Optional[str]
+    pattern: Optional[str]
+    level: Optional[str]
+    categories: List[str]
+
+
+class Config(Sequence):
+    """
+    A whole configuration, applied at once. An empty `sinks` list leaves the
+    sinks set up in code alone.
+    """
+
+    levels: List[ConfigLevel]
+    sinks: List[ConfigSink]
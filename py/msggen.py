@@ -167,7 +167,10 @@ def _type_name(anno: ast.AST) -> str:
         'List',
         'Optional',
     ):
-        anno = anno.slice.value
+        anno = anno.slice
+        if isinstance(anno, ast.Index):
+            # Python < 3.9 wraps subscripts in ast.Index
+            anno = anno.value
     if not isinstance(anno, ast.Name) and (
         not isinstance(anno, ast.Constant) or not isinstance(anno.value, str)
     ):
@@ -381,6 +384,11 @@ def _topo_sort(types: List[TypeDef]) -> List[TypeDef]:
     return out
 
 
+def _doc_lines(doc: str) -> str:
+    """Continue a multi-line docstring as further `//!` comment lines."""
+    return doc.replace('\n', '\n//! ').replace('//! \n', '//!\n')
+
+
 def _gen_field(m: Field) -> str:
     tn = (
         _scalar_type_map[m.type_name]
@@ -426,7 +434,7 @@ def _generate_hdr(mod: Module, ns: str, out_dir: str) -> None:
     nl = '\n'
     stream.write(
         f'''//! {bs}file {modname}.hpp
-{f"//! {bs}brief {mod.doc}" if mod.doc else ""}
+{f"//! {bs}brief {_doc_lines(mod.doc)}" if mod.doc else ""}
 
 #ifndef INCLUDED_{modnameup}
 #define INCLUDED_{modnameup}
@@ -1422,7 +1430,7 @@ struct hash<{nsq}{t.name}> {{
 def _gen_choice_def_method_decl(bs, nl, stream, t):
     stream.write(
         f'''
-//! {bs}class {t.name}{f'{f"{nl}//! {bs}brief {t.doc}" if t.doc else ""}'}
+//! {bs}class {t.name}{f'{f"{nl}//! {bs}brief {_doc_lines(t.doc)}" if t.doc else ""}'}
 struct {t.name} {{
   private:
     int d_choice;
@@ -1483,7 +1491,7 @@ std::ostream& toJson(std::ostream& os, const {t.name}& obj);
 def _gen_sequence_def_method_decl(bs, nl, stream, t):
     stream.write(
         f'''
-//! {bs}class {t.name}{f'{f"{nl}//! {bs}brief {t.doc}" if t.doc else ""}'}
+//! {bs}class {t.name}{f'{f"{nl}//! {bs}brief {_doc_lines(t.doc)}" if t.doc else ""}'}
 struct {t.name} {{
     {f";{nl}    ".join(_gen_field(m) for m in t.members)};
 }};
@@ -1505,7 +1513,7 @@ std::ostream& toJson(std::ostream& os, const {t.name}& obj);
 def _gen_enum_def_method_decl(bs, nl, stream, t):
     stream.write(
         f'''
-//! {bs}enum {t.name}{f'{f"{nl}//! {bs}brief {t.doc}" if t.doc else ""}'}
+//! {bs}enum {t.name}{f'{f"{nl}//! {bs}brief {_doc_lines(t.doc)}" if t.doc else ""}'}
 enum class {t.name} {{
     {f",{nl}    ".join(f"{m.name} = {m.value}" for m in t.members)}
 }};
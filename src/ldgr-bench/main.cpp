@@ -0,0 +1,547 @@
+//! @file main.cpp
+//! @brief ldgr-bench: benchmark matrix for the logging pipeline.
+
+#include <ldgr/dgramsink.hpp>
+#include <ldgr/logger.hpp>
+#include <ldgr/memsink.hpp>
+#include <ldgr/shmring.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct options {
+    std::string filter;
+    std::string format = "json";
+    std::string tmp_dir = "/tmp";
+    unsigned min_ms = 200;
+    unsigned repetitions = 5;
+    bool list = false;
+};
+
+struct result {
+    std::string name;
+    unsigned threads;
+    std::uint64_t iterations; //!< per thread and repetition
+    double ns_per_op;         //!< median over repetitions
+    double ns_per_op_min;
+    double ns_per_op_max;
+};
+
+template <class T>
+inline void keep(const T& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    static volatile const void* s_sink;
+    s_sink = &value;
+#endif
+}
+
+//! Runs `body(iterations)` on `threads` threads started together; returns
+//! the wall time.
+std::chrono::nanoseconds
+timed_run(unsigned threads,
+          std::uint64_t iterations,
+          const std::function<void(std::uint64_t)>& body)
+{
+    using clock = std::chrono::steady_clock;
+    if (threads == 1) {
+        const auto start = clock::now();
+        body(iterations);
+        return clock::now() - start;
+    }
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&] {
+            ++ready;
+            while (!go.load(std::memory_order_acquire)) {
+            }
+            body(iterations);
+        });
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+    const auto start = clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& t : pool) {
+        t.join();
+    }
+    return clock::now() - start;
+}
+
+class runner {
+    const options& d_opts_;
+    std::vector<result> d_results_;
+
+  public:
+    explicit runner(const options& opts): d_opts_(opts)
+    {
+    }
+
+    bool selected(const std::string& name) const
+    {
+        return name.find(d_opts_.filter) != std::string::npos;
+    }
+
+    bool listing() const noexcept
+    {
+        return d_opts_.list;
+    }
+
+    //! Benchmark `body`, which must perform `n` operations per call.
+    void run(const std::string& name,
+             unsigned threads,
+             const std::function<void(std::uint64_t)>& body)
+    {
+        if (!selected(name)) {
+            return;
+        }
+        if (d_opts_.list) {
+            std::printf("%s\n", name.c_str());
+            return;
+        }
+        // Grow the iteration count until one run lasts `min_ms`; that run
+        // doubles as warm-up.
+        const std::chrono::milliseconds min_time{d_opts_.min_ms};
+        std::uint64_t n = 1;
+        for (;;) {
+            const auto took = timed_run(threads, n, body);
+            if (took >= min_time || n >= (std::uint64_t{1} << 40)) {
+                break;
+            }
+            const auto ns = std::max<std::int64_t>(took.count(), 1);
+            const auto want = static_cast<double>(n) *
+                              std::chrono::nanoseconds(min_time).count() /
+                              static_cast<double>(ns);
+            n = std::max<std::uint64_t>(
+                n * 2, static_cast<std::uint64_t>(want * 1.2));
+        }
+
+        std::vector<double> samples;
+        for (unsigned r = 0; r < std::max(1u, d_opts_.repetitions); ++r) {
+            const auto took = timed_run(threads, n, body);
+            samples.push_back(static_cast<double>(took.count()) /
+                              static_cast<double>(n * threads));
+        }
+        std::sort(samples.begin(), samples.end());
+        d_results_.push_back({name,
+                              threads,
+                              n,
+                              samples[samples.size() / 2],
+                              samples.front(),
+                              samples.back()});
+        std::fprintf(stderr,
+                     "%-40s %10.1f ns/op\n",
+                     name.c_str(),
+                     d_results_.back().ns_per_op);
+    }
+
+    const std::vector<result>& results() const noexcept
+    {
+        return d_results_;
+    }
+};
+
+ldgr::log_entry_fmt_cp sample_entry()
+{
+    static const std::string message = "request served: id=42 bytes=1337";
+    const ldgr::log_entry entry{
+        ldgr::log_severity::info,
+        ldgr::fmtutil::to_view("BENCH.CAT"),
+        ldgr::fmtutil::to_view("src/server/handler.cpp"),
+        123,
+        std::chrono::system_clock::now(),
+        ldgr::fmtutil::to_view(message)};
+    return ldgr::log_entry_util::copy_log_entry(entry);
+}
+
+//! Route `BENCH.NULL` to a `null_sink` only.
+void use_null_logger()
+{
+    static const auto sink = ldgr::log_sink_factory::null_sink();
+    auto& l = ldgr::log_registry::get("BENCH.NULL");
+    l.remove_sink(ldgr::log_sink_factory::stderr_sink());
+    l.add_sink(sink);
+}
+
+void bench_calls(runner& r)
+{
+    auto& off = ldgr::log_registry::get("BENCH.OFF");
+    off.set_level(ldgr::log_severity::off);
+    r.run("call/disabled", 1, [](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) {
+            LDGR_CAT_INFO("BENCH.OFF", "value={}", i);
+        }
+    });
+
+    use_null_logger();
+    r.run("call/enabled_null_sink", 1, [](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) {
+            LDGR_CAT_INFO("BENCH.NULL", "value={}", i);
+        }
+    });
+
+    // Suppressed records kept in the backtrace ring, with raw and with
+    // eagerly formatted arguments.
+    auto& bt = ldgr::log_registry::get("BENCH.BACKTRACE");
+    bt.set_level(ldgr::log_severity::off);
+    bt.enable_backtrace(ldgr::log_severity::debug,
+                        ldgr::log_severity::off);
+    r.run("call/backtrace_raw", 1, [](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) {
+            LDGR_CAT_DEBUG("BENCH.BACKTRACE", "value={} {}", i, 0.5);
+        }
+    });
+    r.run("call/backtrace_string", 1, [](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) {
+            LDGR_CAT_DEBUG("BENCH.BACKTRACE", "value={} {}", i, "text");
+        }
+    });
+}
+
+void bench_clocks(runner& r)
+{
+    r.run("clock/system_clock", 1, [](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) {
+            keep(std::chrono::system_clock::now());
+        }
+    });
+    if (ldgr::log_clock::use_tsc(true)) {
+        r.run("clock/tsc", 1, [](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; ++i) {
+                keep(ldgr::log_clock::now());
+            }
+        });
+        ldgr::log_clock::use_tsc(false);
+    }
+}
+
+void bench_formatters(runner& r)
+{
+    const auto entry = sample_entry();
+    const struct {
+        const char* name;
+        ldgr::log_formatter formatter;
+    } formatters[] = {
+        {"format/default", {&ldgr::default_formatter}},
+        {"format/syslog", {&ldgr::syslog_formatter}},
+        {"format/json", {&ldgr::json_formatter}},
+        {"format/journald", {&ldgr::journald_formatter}},
+        {"format/pattern",
+         {ldgr::log_formatter::as_pattern{}, "%i %l %c %f:%n %m"}},
+    };
+    for (const auto& f : formatters) {
+        r.run(f.name, 1, [&](std::uint64_t n) {
+            ldgr::log_buffer_t buff;
+            for (std::uint64_t i = 0; i < n; ++i) {
+                buff.clear();
+                f.formatter.format(buff, entry);
+                keep(buff);
+            }
+        });
+    }
+}
+
+void bench_sink(runner& r,
+                const std::string& name,
+                const std::function<std::shared_ptr<ldgr::log_sink>()>& make)
+{
+    if (!r.selected(name) || r.listing()) {
+        r.run(name, 1, {});
+        return;
+    }
+    std::shared_ptr<ldgr::log_sink> sink;
+    try {
+        sink = make();
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "%s: skipped (%s)\n", name.c_str(), e.what());
+        return;
+    }
+    const auto entry = sample_entry();
+    r.run(name, 1, [&](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) {
+            sink->log(entry);
+        }
+        sink->flush();
+    });
+}
+
+void bench_sinks(runner& r, const options& opts)
+{
+    using factory = ldgr::log_sink_factory;
+    bench_sink(r, "sink/null", [] { return factory::null_sink(); });
+    bench_sink(
+        r, "sink/null_unformatted", [] { return factory::null_sink(false); });
+    bench_sink(r, "sink/counting", [] { return factory::counting_sink(); });
+    bench_sink(r, "sink/capture", [] { return factory::capture_sink(); });
+
+    const auto tmp = [&](const char* tag) {
+        const auto path =
+            fmt::format("{}/ldgr-bench-{}-{}.log",
+                        opts.tmp_dir,
+                        tag,
+                        std::chrono::steady_clock::now().time_since_epoch()
+                            .count());
+        std::remove(path.c_str());
+        return path;
+    };
+    for (const auto& [name, make] : {
+             std::make_pair("sink/stdio_file",
+                            &ldgr::log_sink_factory::file_sink),
+             std::make_pair("sink/async_file",
+                            &ldgr::log_sink_factory::async_file_sink),
+             std::make_pair("sink/direct_file",
+                            &ldgr::log_sink_factory::direct_file_sink),
+         }) {
+        const auto path = tmp(name + 5);
+        bench_sink(r, name, [&, make = make] { return make(path); });
+        std::remove(path.c_str());
+    }
+
+#if !defined(_WIN32)
+    const auto ring = fmt::format("/ldgr-bench-{}", ::getpid());
+    bench_sink(r, "sink/shm", [&] {
+        return ldgr::log_sink_factory::shm_sink(ring);
+    });
+    ldgr::shm_ring::unlink(ring);
+
+    // A collector that keeps the datagram socket drained.
+    const auto sock_path = tmp("dgram");
+    const int rx = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    sock_path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    if (rx >= 0 &&
+        ::bind(rx, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+        std::atomic<bool> stop{false};
+        std::thread drain([&] {
+            char buff[4096];
+            timeval tv{0, 10000};
+            ::setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            while (!stop) {
+                static_cast<void>(::recv(rx, buff, sizeof(buff), 0));
+            }
+        });
+        bench_sink(r, "sink/unix_dgram", [&] {
+            return ldgr::unix_dgram_sink::create(sock_path);
+        });
+        stop = true;
+        drain.join();
+    }
+    if (rx >= 0) {
+        ::close(rx);
+    }
+    std::remove(sock_path.c_str());
+#endif
+}
+
+void bench_pool(runner& r)
+{
+    auto pool = ldgr::pooled_log_buffer_factory::create();
+    for (const std::size_t size : {64, 512, 4096}) {
+        r.run(fmt::format("pool/allocate_release/{}", size),
+              1,
+              [&](std::uint64_t n) {
+                  for (std::uint64_t i = 0; i < n; ++i) {
+                      auto buff = (*pool)(size);
+                      keep(buff);
+                  }
+              });
+    }
+    r.run("pool/default_allocate_release", 1, [](std::uint64_t n) {
+        const ldgr::default_log_buffer_factory factory;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            auto buff = factory();
+            keep(buff);
+        }
+    });
+}
+
+void bench_contention(runner& r)
+{
+    use_null_logger();
+    for (const unsigned threads : {1u, 2u, 4u, 8u, 16u, 64u}) {
+        r.run(fmt::format("contention/{}_threads", threads),
+              threads,
+              [](std::uint64_t n) {
+                  for (std::uint64_t i = 0; i < n; ++i) {
+                      LDGR_CAT_INFO("BENCH.NULL", "value={}", i);
+                  }
+              });
+    }
+}
+
+std::string json_escape(const std::string& s)
+{
+    std::string out;
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+void print_json(const options& opts, const std::vector<result>& results)
+{
+    char date[32];
+    const auto now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+#if defined(NDEBUG)
+    const char* build = "release";
+#else
+    const char* build = "debug";
+#endif
+#if defined(LDGR_HAVE_METRICS)
+    const bool metrics = true;
+#else
+    const bool metrics = false;
+#endif
+    fmt::print("{{\n  \"context\": {{\n"
+               "    \"date\": \"{}\",\n"
+               "    \"ldgr_bench_version\": \"{}\",\n"
+               "    \"build\": \"{}\",\n"
+               "    \"metrics\": {},\n"
+               "    \"hardware_concurrency\": {},\n"
+               "    \"min_time_ms\": {},\n"
+               "    \"repetitions\": {}\n"
+               "  }},\n  \"benchmarks\": [",
+               date,
+               LDGR_BENCH_VER_STRING,
+               build,
+               metrics,
+               std::thread::hardware_concurrency(),
+               opts.min_ms,
+               opts.repetitions);
+    const char* sep = "\n";
+    for (const auto& res : results) {
+        fmt::print("{}    {{\"name\": \"{}\", \"threads\": {}, "
+                   "\"iterations\": {}, \"ns_per_op\": {:.3f}, "
+                   "\"ns_per_op_min\": {:.3f}, \"ns_per_op_max\": {:.3f}, "
+                   "\"ops_per_sec\": {:.0f}}}",
+                   sep,
+                   json_escape(res.name),
+                   res.threads,
+                   res.iterations,
+                   res.ns_per_op,
+                   res.ns_per_op_min,
+                   res.ns_per_op_max,
+                   1e9 / res.ns_per_op);
+        sep = ",\n";
+    }
+    fmt::print("\n  ]\n}}\n");
+}
+
+void print_csv(const std::vector<result>& results)
+{
+    fmt::print("name,threads,iterations,ns_per_op,ns_per_op_min,"
+               "ns_per_op_max,ops_per_sec\n");
+    for (const auto& res : results) {
+        fmt::print("{},{},{},{:.3f},{:.3f},{:.3f},{:.0f}\n",
+                   res.name,
+                   res.threads,
+                   res.iterations,
+                   res.ns_per_op,
+                   res.ns_per_op_min,
+                   res.ns_per_op_max,
+                   1e9 / res.ns_per_op);
+    }
+}
+
+void usage(const char* argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--filter TEXT] [--format json|csv] [--list]\n"
+                 "          [--min-ms N] [--repetitions N] [--tmp-dir DIR]\n"
+                 "\n"
+                 "  --filter       run benchmarks whose name contains TEXT\n"
+                 "  --format       results on stdout (default: json)\n"
+                 "  --list         print benchmark names and exit\n"
+                 "  --min-ms       shortest timed run (default: 200)\n"
+                 "  --repetitions  timed runs; the median is reported\n"
+                 "  --tmp-dir      where file sinks write (default: /tmp)\n",
+                 argv0);
+}
+
+bool parse(int argc, char** argv, options& opts)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_val = i + 1 < argc;
+        if (arg == "--filter" && has_val) {
+            opts.filter = argv[++i];
+        }
+        else if (arg == "--format" && has_val) {
+            opts.format = argv[++i];
+        }
+        else if (arg == "--min-ms" && has_val) {
+            opts.min_ms = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--repetitions" && has_val) {
+            opts.repetitions = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--tmp-dir" && has_val) {
+            opts.tmp_dir = argv[++i];
+        }
+        else if (arg == "--list") {
+            opts.list = true;
+        }
+        else {
+            return false;
+        }
+    }
+    return opts.format == "json" || opts.format == "csv";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse(argc, argv, opts)) {
+        usage(argv[0]);
+        return 2;
+    }
+    runner r{opts};
+    bench_calls(r);
+    bench_clocks(r);
+    bench_formatters(r);
+    bench_sinks(r, opts);
+    bench_pool(r);
+    bench_contention(r);
+
+    if (opts.list) {
+        return 0;
+    }
+    if (opts.format == "csv") {
+        print_csv(r.results());
+    }
+    else {
+        print_json(opts, r.results());
+    }
+    return 0;
+}
@@ -0,0 +1,464 @@
+//! @file main.cpp
+//! @brief ldgr-latency: fixed-rate tail-latency harness for ldgr sinks.
+
+#include <ldgr/dgramsink.hpp>
+#include <ldgr/logger.hpp>
+#include <ldgr/memsink.hpp>
+#include <ldgr/logmetrics.hpp>
+#include <ldgr/shmring.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+    std::string filter;
+    std::string format = "json";
+    std::string dir;
+    unsigned threads = 4;
+    unsigned rate = 50000; //!< calls per second per thread
+    double seconds = 2.0;
+    bool pin = true;
+};
+
+struct scenario {
+    std::string name;
+    std::function<std::shared_ptr<ldgr::log_sink>()> make;
+};
+
+struct result {
+    std::string name;
+    std::string mode;
+    std::uint64_t calls;
+    std::uint64_t late; //!< calls issued behind schedule
+    ldgr::log_histogram response; //!< from the intended start
+    ldgr::log_histogram service;  //!< from the actual start
+};
+
+void record(ldgr::log_histogram& h, clock_type::duration d)
+{
+    const auto ns = static_cast<std::uint64_t>(
+        std::max<std::int64_t>(0, std::chrono::nanoseconds(d).count()));
+    ++h.counts[ldgr::log_histogram::bucket_of(ns)];
+    ++h.count;
+    h.sum_ns += ns;
+    h.max_ns = std::max(h.max_ns, ns);
+}
+
+void pin_to_cpu(unsigned index)
+{
+#if defined(__linux__)
+    const auto cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cpus, &set);
+    ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+    static_cast<void>(index);
+#endif
+}
+
+//! Issue `op` at a fixed rate from every thread. Latency is measured from
+//! when each call was due, not when it started, so a stall is charged to
+//! every call queued behind it (no coordinated omission).
+result drive(const options& opts,
+             const std::string& name,
+             const std::string& mode,
+             const std::function<void()>& op)
+{
+    const auto interval =
+        std::chrono::nanoseconds(1000000000ull / std::max(1u, opts.rate));
+    const auto calls = static_cast<std::uint64_t>(
+        opts.seconds * std::max(1u, opts.rate));
+
+    std::vector<result> per_thread(opts.threads);
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    clock_type::time_point start;
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < opts.threads; ++t) {
+        pool.emplace_back([&, t] {
+            if (opts.pin) {
+                pin_to_cpu(t);
+            }
+            auto& res = per_thread[t];
+            ++ready;
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (std::uint64_t i = 0; i < calls; ++i) {
+                const auto due = start + interval * i;
+                auto now = clock_type::now();
+                if (now < due) {
+                    if (due - now > std::chrono::microseconds(200)) {
+                        std::this_thread::sleep_until(
+                            due - std::chrono::microseconds(100));
+                    }
+                    while ((now = clock_type::now()) < due) {
+                    }
+                }
+                else if (now - due > interval) {
+                    ++res.late;
+                }
+                op();
+                const auto done = clock_type::now();
+                record(res.response, done - due);
+                record(res.service, done - now);
+            }
+        });
+    }
+    while (ready.load() != opts.threads) {
+        std::this_thread::yield();
+    }
+    start = clock_type::now() + std::chrono::milliseconds(10);
+    go.store(true, std::memory_order_release);
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    result total{name, mode, calls * opts.threads, 0, {}, {}};
+    for (const auto& r : per_thread) {
+        total.late += r.late;
+        total.response.merge(r.response);
+        total.service.merge(r.service);
+    }
+    return total;
+}
+
+ldgr::log_entry_fmt_cp sample_entry()
+{
+    static const std::string message = "request served: id=42 bytes=1337";
+    const ldgr::log_entry entry{
+        ldgr::log_severity::info,
+        ldgr::fmtutil::to_view("LATENCY"),
+        ldgr::fmtutil::to_view("src/server/handler.cpp"),
+        123,
+        std::chrono::system_clock::now(),
+        ldgr::fmtutil::to_view(message)};
+    return ldgr::log_entry_util::copy_log_entry(entry);
+}
+
+std::string default_dir()
+{
+#if !defined(_WIN32)
+    struct stat st;
+    if (::stat("/dev/shm", &st) == 0 && S_ISDIR(st.st_mode)) {
+        return "/dev/shm";
+    }
+#endif
+    return "/tmp";
+}
+
+std::vector<scenario> scenarios(const options& opts)
+{
+    using factory = ldgr::log_sink_factory;
+    const auto file = [&](const char* tag) {
+        return fmt::format("{}/ldgr-latency-{}.log", opts.dir, tag);
+    };
+    std::vector<scenario> out{
+        {"null", [] { return factory::null_sink(); }},
+        {"stdio_devnull", [] { return factory::file_sink("/dev/null"); }},
+        {"stdio_file", [=] { return factory::file_sink(file("stdio")); }},
+        {"async_file",
+         [=] { return factory::async_file_sink(file("async")); }},
+        {"direct_file",
+         [=] { return factory::direct_file_sink(file("direct")); }},
+    };
+#if !defined(_WIN32)
+    out.push_back({"shm", [] {
+                       return factory::shm_sink(
+                           fmt::format("/ldgr-latency-{}", ::getpid()));
+                   }});
+#endif
+    return out;
+}
+
+//! Keeps a Unix datagram socket drained, standing in for syslogd.
+class dgram_collector {
+#if !defined(_WIN32)
+    std::string d_path_;
+    int d_fd_{-1};
+    std::atomic<bool> d_stop_{false};
+    std::thread d_thread_;
+
+  public:
+    explicit dgram_collector(std::string path): d_path_(std::move(path))
+    {
+        ::unlink(d_path_.c_str());
+        d_fd_ = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        d_path_.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+        if (d_fd_ < 0 || ::bind(d_fd_,
+                                reinterpret_cast<sockaddr*>(&addr),
+                                sizeof(addr)) != 0) {
+            return;
+        }
+        timeval tv{0, 10000};
+        ::setsockopt(d_fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        d_thread_ = std::thread([this] {
+            char buff[4096];
+            while (!d_stop_) {
+                static_cast<void>(::recv(d_fd_, buff, sizeof(buff), 0));
+            }
+        });
+    }
+
+    ~dgram_collector()
+    {
+        d_stop_ = true;
+        if (d_thread_.joinable()) {
+            d_thread_.join();
+        }
+        if (d_fd_ >= 0) {
+            ::close(d_fd_);
+        }
+        ::unlink(d_path_.c_str());
+    }
+
+    bool ok() const noexcept
+    {
+        return d_thread_.joinable();
+    }
+#else
+  public:
+    explicit dgram_collector(std::string)
+    {
+    }
+
+    bool ok() const noexcept
+    {
+        return false;
+    }
+#endif
+};
+
+void print_json(const options& opts, const std::vector<result>& results)
+{
+    fmt::print("{{\n  \"context\": {{\n"
+               "    \"threads\": {},\n"
+               "    \"rate_per_thread\": {},\n"
+               "    \"seconds\": {},\n"
+               "    \"pinned\": {},\n"
+               "    \"hardware_concurrency\": {}\n"
+               "  }},\n  \"results\": [",
+               opts.threads,
+               opts.rate,
+               opts.seconds,
+               opts.pin,
+               std::thread::hardware_concurrency());
+    const char* sep = "\n";
+    for (const auto& r : results) {
+        const auto& h = r.response;
+        fmt::print("{}    {{\"sink\": \"{}\", \"mode\": \"{}\", "
+                   "\"calls\": {}, \"late\": {}, "
+                   "\"p50_ns\": {}, \"p90_ns\": {}, \"p99_ns\": {}, "
+                   "\"p99_9_ns\": {}, \"p99_99_ns\": {}, \"max_ns\": {}, "
+                   "\"service_p99_ns\": {}, \"service_max_ns\": {}}}",
+                   sep,
+                   r.name,
+                   r.mode,
+                   r.calls,
+                   r.late,
+                   h.percentile(0.5),
+                   h.percentile(0.9),
+                   h.percentile(0.99),
+                   h.percentile(0.999),
+                   h.percentile(0.9999),
+                   h.max_ns,
+                   r.service.percentile(0.99),
+                   r.service.max_ns);
+        sep = ",\n";
+    }
+    fmt::print("\n  ]\n}}\n");
+}
+
+void print_csv(const std::vector<result>& results)
+{
+    fmt::print("sink,mode,calls,late,p50_ns,p90_ns,p99_ns,p99_9_ns,"
+               "p99_99_ns,max_ns,service_p99_ns,service_max_ns\n");
+    for (const auto& r : results) {
+        const auto& h = r.response;
+        fmt::print("{},{},{},{},{},{},{},{},{},{},{},{}\n",
+                   r.name,
+                   r.mode,
+                   r.calls,
+                   r.late,
+                   h.percentile(0.5),
+                   h.percentile(0.9),
+                   h.percentile(0.99),
+                   h.percentile(0.999),
+                   h.percentile(0.9999),
+                   h.max_ns,
+                   r.service.percentile(0.99),
+                   r.service.max_ns);
+    }
+}
+
+void usage(const char* argv0)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--threads N] [--rate N] [--seconds S] [--no-pin]\n"
+        "          [--filter TEXT] [--format json|csv] [--dir DIR]\n"
+        "\n"
+        "  --threads  logging threads (default: 4)\n"
+        "  --rate     calls per second per thread (default: 50000)\n"
+        "  --seconds  run length per scenario (default: 2)\n"
+        "  --no-pin   do not pin thread i to CPU i\n"
+        "  --filter   run scenarios whose `sink/mode` contains TEXT\n"
+        "  --format   results on stdout (default: json)\n"
+        "  --dir      where file sinks write (default: /dev/shm)\n",
+        argv0);
+}
+
+bool parse(int argc, char** argv, options& opts)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_val = i + 1 < argc;
+        if (arg == "--threads" && has_val) {
+            opts.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--rate" && has_val) {
+            opts.rate = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--seconds" && has_val) {
+            opts.seconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--filter" && has_val) {
+            opts.filter = argv[++i];
+        }
+        else if (arg == "--format" && has_val) {
+            opts.format = argv[++i];
+        }
+        else if (arg == "--dir" && has_val) {
+            opts.dir = argv[++i];
+        }
+        else if (arg == "--no-pin") {
+            opts.pin = false;
+        }
+        else {
+            return false;
+        }
+    }
+    if (opts.dir.empty()) {
+        opts.dir = default_dir();
+    }
+    return opts.threads > 0 && opts.seconds > 0 &&
+           (opts.format == "json" || opts.format == "csv");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse(argc, argv, opts)) {
+        usage(argv[0]);
+        return 2;
+    }
+    const auto selected = [&](const std::string& name) {
+        return name.find(opts.filter) != std::string::npos;
+    };
+    // Only the harness measures; keep self-instrumentation off the clock.
+    ldgr::log_metrics::set_sample_period(~0u);
+
+    auto scens = scenarios(opts);
+    const auto dgram_path = fmt::format("{}/ldgr-latency.sock", opts.dir);
+    dgram_collector collector{dgram_path};
+    if (collector.ok()) {
+        scens.push_back({"unix_dgram", [&] {
+                             return ldgr::unix_dgram_sink::create(dgram_path);
+                         }});
+    }
+
+    std::vector<result> results;
+    auto& l = ldgr::log_registry::get("LATENCY");
+    l.remove_sink(ldgr::log_sink_factory::stderr_sink());
+
+    if (selected("disabled/logger")) {
+        l.set_level(ldgr::log_severity::off);
+        results.push_back(drive(opts, "disabled", "logger", [] {
+            LDGR_CAT_INFO("LATENCY", "request served: id={}", 42);
+        }));
+        l.set_level(ldgr::log_severity::info);
+    }
+
+    const auto entry = sample_entry();
+    for (const auto& s : scens) {
+        const bool via_sink = selected(s.name + "/sink");
+        const bool via_logger = selected(s.name + "/logger");
+        if (!via_sink && !via_logger) {
+            continue;
+        }
+        std::shared_ptr<ldgr::log_sink> sink;
+        try {
+            sink = s.make();
+        }
+        catch (const std::exception& e) {
+            std::fprintf(
+                stderr, "%s: skipped (%s)\n", s.name.c_str(), e.what());
+            continue;
+        }
+        if (via_sink) {
+            results.push_back(
+                drive(opts, s.name, "sink", [&] { sink->log(entry); }));
+        }
+        if (via_logger) {
+            l.add_sink(sink);
+            results.push_back(drive(opts, s.name, "logger", [] {
+                LDGR_CAT_INFO("LATENCY", "request served: id={}", 42);
+            }));
+            l.remove_sink(sink);
+        }
+        sink->flush();
+        std::fprintf(stderr,
+                     "%-16s p99 %8llu ns  p99.99 %10llu ns\n",
+                     s.name.c_str(),
+                     static_cast<unsigned long long>(
+                         results.back().response.percentile(0.99)),
+                     static_cast<unsigned long long>(
+                         results.back().response.percentile(0.9999)));
+    }
+
+    for (const char* tag : {"stdio", "async", "direct"}) {
+        std::remove(
+            fmt::format("{}/ldgr-latency-{}.log", opts.dir, tag).c_str());
+    }
+#if !defined(_WIN32)
+    ldgr::shm_ring::unlink(fmt::format("/ldgr-latency-{}", ::getpid()));
+#endif
+
+    if (opts.format == "csv") {
+        print_csv(results);
+    }
+    else {
+        print_json(opts, results);
+    }
+    return 0;
+}
@@ -0,0 +1,282 @@
+//! @file main.cpp
+//! @brief ldgr-shmd: drain a shared-memory log ring to a file or stdout.
+
+#include <ldgr/shmring.hpp>
+
+#include <fmt/format.h>
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(LDGR_SHMD_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace {
+
+volatile std::sig_atomic_t s_stop = 0;
+
+extern "C" void on_stop(int)
+{
+    s_stop = 1;
+}
+
+struct options {
+    std::string name;
+    std::string out;
+    bool gzip = false;
+    bool once = false;
+    bool unlink = false;
+    unsigned poll_ms = 10;
+    unsigned stall_ms = 1000;
+};
+
+//! Where drained records go.
+class output {
+  public:
+    virtual ~output() = default;
+    virtual bool write(const char* data, std::size_t size) = 0;
+    virtual void flush() = 0;
+};
+
+class file_output final : public output {
+    std::FILE* d_file_;
+    bool d_owned_;
+
+  public:
+    file_output(std::FILE* file, bool owned): d_file_(file), d_owned_(owned)
+    {
+    }
+
+    ~file_output() override
+    {
+        if (d_owned_) {
+            std::fclose(d_file_);
+        }
+        else {
+            std::fflush(d_file_);
+        }
+    }
+
+    bool write(const char* data, std::size_t size) override
+    {
+        return std::fwrite(data, 1, size, d_file_) == size;
+    }
+
+    void flush() override
+    {
+        std::fflush(d_file_);
+    }
+};
+
+#if defined(LDGR_SHMD_HAVE_ZLIB)
+class gzip_output final : public output {
+    gzFile d_file_;
+
+  public:
+    explicit gzip_output(gzFile file): d_file_(file)
+    {
+    }
+
+    ~gzip_output() override
+    {
+        gzclose(d_file_);
+    }
+
+    bool write(const char* data, std::size_t size) override
+    {
+        return gzwrite(d_file_, data, static_cast<unsigned>(size)) ==
+               static_cast<int>(size);
+    }
+
+    void flush() override
+    {
+        gzflush(d_file_, Z_SYNC_FLUSH);
+    }
+};
+#endif
+
+void usage(const char* argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s --name /ring [--out PATH] [--gzip] [--once]\n"
+                 "          [--unlink] [--poll-ms N] [--stall-ms N]\n"
+                 "\n"
+                 "  --name      shared-memory ring to drain\n"
+                 "  --out       output file (default: stdout)\n"
+                 "  --gzip      gzip-compress the output file\n"
+                 "  --once      drain what is there and exit\n"
+                 "  --unlink    remove the ring's name on exit\n"
+                 "  --poll-ms   sleep between polls of an idle ring\n"
+                 "  --stall-ms  skip a record whose writer died mid-write\n",
+                 argv0);
+}
+
+bool parse(int argc, char** argv, options& opts)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_val = i + 1 < argc;
+        if (arg == "--name" && has_val) {
+            opts.name = argv[++i];
+        }
+        else if (arg == "--out" && has_val) {
+            opts.out = argv[++i];
+        }
+        else if (arg == "--poll-ms" && has_val) {
+            opts.poll_ms = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--stall-ms" && has_val) {
+            opts.stall_ms = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--gzip") {
+            opts.gzip = true;
+        }
+        else if (arg == "--once") {
+            opts.once = true;
+        }
+        else if (arg == "--unlink") {
+            opts.unlink = true;
+        }
+        else {
+            return false;
+        }
+    }
+    return !opts.name.empty() && !(opts.gzip && opts.out.empty());
+}
+
+std::unique_ptr<output> open_output(const options& opts)
+{
+    if (opts.out.empty()) {
+        return std::make_unique<file_output>(stdout, false);
+    }
+    if (opts.gzip) {
+#if defined(LDGR_SHMD_HAVE_ZLIB)
+        if (auto f = gzopen(opts.out.c_str(), "ab")) {
+            return std::make_unique<gzip_output>(f);
+        }
+#else
+        std::fprintf(stderr, "ldgr-shmd: built without zlib\n");
+        return nullptr;
+#endif
+    }
+    else if (auto f = std::fopen(opts.out.c_str(), "ab")) {
+        return std::make_unique<file_output>(f, true);
+    }
+    std::fprintf(stderr,
+                 "ldgr-shmd: cannot open %s: %s\n",
+                 opts.out.c_str(),
+                 std::strerror(errno));
+    return nullptr;
+}
+
+int drain(const options& opts, const ldgr::shm_ring& ring, output& out)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<char> record(ring.max_record_size());
+    std::uint64_t seq = 0;
+    auto stalled_since = clock::time_point{};
+
+    // Start at the oldest record still in the ring.
+    const auto ws = ring.write_seq();
+    if (ws > ring.slot_count()) {
+        seq = ws - ring.slot_count();
+    }
+
+    while (!s_stop) {
+        std::size_t size = 0;
+        std::uint32_t flags = 0;
+        std::uint64_t lost = 0;
+        switch (ring.read(seq, record.data(), size, flags, lost)) {
+            case ldgr::shm_ring::read_status::ok: {
+                stalled_since = clock::time_point{};
+                if (!out.write(record.data(), size)) {
+                    std::fprintf(stderr, "ldgr-shmd: write failed\n");
+                    return 1;
+                }
+                if (flags & ldgr::shm_ring_layout::truncated) {
+                    // Keep one record per line even when cut short.
+                    out.write("...\n", 4);
+                }
+            } break;
+            case ldgr::shm_ring::read_status::lost: {
+                stalled_since = clock::time_point{};
+                const auto marker =
+                    fmt::format("[ldgr-shmd] {} record(s) lost\n", lost);
+                out.write(marker.data(), marker.size());
+            } break;
+            case ldgr::shm_ring::read_status::empty: {
+                if (ring.write_seq() > seq) {
+                    // Claimed but not committed: give the writer a moment,
+                    // then assume it died and move past the record.
+                    const auto now = clock::now();
+                    if (stalled_since == clock::time_point{}) {
+                        stalled_since = now;
+                    }
+                    else if (now - stalled_since >
+                             std::chrono::milliseconds(opts.stall_ms)) {
+                        ++seq;
+                        stalled_since = clock::time_point{};
+                        const char marker[] =
+                            "[ldgr-shmd] 1 record(s) lost\n";
+                        out.write(marker, sizeof(marker) - 1);
+                        continue;
+                    }
+                }
+                else if (opts.once) {
+                    out.flush();
+                    return 0;
+                }
+                out.flush();
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(opts.poll_ms));
+            } break;
+        }
+    }
+    out.flush();
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse(argc, argv, opts)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::signal(SIGINT, on_stop);
+    std::signal(SIGTERM, on_stop);
+
+    std::unique_ptr<ldgr::shm_ring> ring;
+    try {
+        ring = ldgr::shm_ring::attach(opts.name);
+    }
+    catch (const std::system_error& e) {
+        std::fprintf(stderr, "ldgr-shmd: %s\n", e.what());
+        return 1;
+    }
+
+    auto out = open_output(opts);
+    if (!out) {
+        return 1;
+    }
+
+    const int rc = drain(opts, *ring, *out);
+    if (opts.unlink) {
+        ldgr::shm_ring::unlink(opts.name);
+    }
+    return rc;
+}
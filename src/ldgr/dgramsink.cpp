@@ -0,0 +1,301 @@
+//! @file dgramsink.cpp
+
+#include <ldgr/dgramsink.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace ldgr {
+
+#if !defined(_WIN32)
+
+struct unix_dgram_sink::impl {
+    std::string path;
+    dgram_sink_config config;
+    int fd{-1};
+
+    // Retry queue: a ring of record slots whose strings keep their capacity,
+    // so a warmed-up sink queues records without allocating.
+    std::vector<std::string> slots;
+    std::size_t head{0};
+    std::size_t count{0};
+
+    std::vector<struct iovec> iovs;
+#if defined(__linux__)
+    std::vector<struct mmsghdr> msgs;
+#endif
+
+    std::size_t sent{0};
+    std::size_t dropped{0};
+    std::size_t batches{0};
+    std::size_t retries{0};
+
+    impl(std::string p, const dgram_sink_config& cfg)
+    : path(std::move(p))
+    , config(cfg)
+    , slots(std::max<std::size_t>(cfg.max_queued, 1))
+    , iovs(std::max<std::size_t>(cfg.batch, 1))
+#if defined(__linux__)
+    , msgs(iovs.size())
+#endif
+    {
+        config.batch = iovs.size();
+    }
+
+    ~impl()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    int connect_socket() noexcept
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return ENAMETOOLONG;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        const int s = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (s < 0) {
+            return errno;
+        }
+        ::fcntl(s, F_SETFD, FD_CLOEXEC);
+        ::fcntl(s, F_SETFL, ::fcntl(s, F_GETFL) | O_NONBLOCK);
+        if (::connect(s, reinterpret_cast<const sockaddr*>(&addr),
+                      sizeof(addr)) != 0) {
+            const int err = errno;
+            ::close(s);
+            return err;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = s;
+        return 0;
+    }
+
+    void push(const char* data, std::size_t size)
+    {
+        if (count == slots.size()) {
+            head = (head + 1) % slots.size();
+            --count;
+            ++dropped;
+        }
+        slots[(head + count) % slots.size()].assign(data, size);
+        ++count;
+    }
+
+    void pop(std::size_t n) noexcept
+    {
+        head = (head + n) % slots.size();
+        count -= n;
+    }
+
+    //! Send up to one batch; returns the number of records sent or -1 with
+    //! `errno` set.
+    int send_batch() noexcept
+    {
+        const auto n = std::min(count, config.batch);
+        for (std::size_t i = 0; i < n; ++i) {
+            auto& rec = slots[(head + i) % slots.size()];
+            iovs[i].iov_base = &rec[0];
+            iovs[i].iov_len = rec.size();
+        }
+#if defined(__linux__)
+        for (std::size_t i = 0; i < n; ++i) {
+            msgs[i] = mmsghdr{};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        return ::sendmmsg(
+            fd, msgs.data(), static_cast<unsigned>(n), MSG_DONTWAIT);
+#else
+        std::size_t done = 0;
+        for (; done < n; ++done) {
+            if (::send(fd, iovs[done].iov_base, iovs[done].iov_len, 0) < 0) {
+                return done ? static_cast<int>(done) : -1;
+            }
+        }
+        return static_cast<int>(done);
+#endif
+    }
+
+    //! Send queued records until the queue is empty or the socket is full.
+    void drain() noexcept
+    {
+        bool reconnected = false;
+        while (count > 0) {
+            const int r = send_batch();
+            if (r > 0) {
+                pop(static_cast<std::size_t>(r));
+                sent += static_cast<std::size_t>(r);
+                ++batches;
+                continue;
+            }
+            const int err = r < 0 ? errno : EAGAIN;
+            if (err == EINTR) {
+                continue;
+            }
+            if (err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS) {
+                ++retries;
+                return;
+            }
+            // The collector may have restarted; reconnect once per drain,
+            // otherwise give up on the record at the head of the queue.
+            if (!reconnected &&
+                (err == ECONNREFUSED || err == ENOTCONN || err == ENOENT)) {
+                reconnected = true;
+                if (connect_socket() == 0) {
+                    continue;
+                }
+            }
+            pop(1);
+            ++dropped;
+        }
+    }
+};
+
+unix_dgram_sink::unix_dgram_sink(std::unique_ptr<impl> impl) noexcept
+: d_impl_(std::move(impl))
+, d_mutex_()
+{
+}
+
+std::shared_ptr<unix_dgram_sink>
+unix_dgram_sink::create(const std::string& path,
+                        log_formatter::format_fn format,
+                        const dgram_sink_config& config)
+{
+    auto im = std::make_unique<impl>(path, config);
+    if (const int err = im->connect_socket()) {
+        throw std::system_error(
+            err, std::generic_category(), "connect " + path);
+    }
+    std::shared_ptr<unix_dgram_sink> sink{
+        new unix_dgram_sink(std::move(im))};
+    sink->set_formatter(std::make_shared<log_formatter>(format));
+    return sink;
+}
+
+unix_dgram_sink::~unix_dgram_sink()
+{
+    retire();
+    std::lock_guard<dtl::sink_mutex> guard{d_mutex_};
+    d_impl_->drain();
+}
+
+void unix_dgram_sink::do_log(const log_buffer_t& buff)
+{
+    std::lock_guard<dtl::sink_mutex> guard{d_mutex_};
+    // Batch only under backpressure: a quiet program's records must not
+    // wait for more to come along.
+    auto& im = *d_impl_;
+    const bool was_empty = im.count == 0;
+    im.push(buff.data(), buff.size());
+    if (was_empty || im.count >= im.config.batch) {
+        im.drain();
+    }
+}
+
+void unix_dgram_sink::do_flush()
+{
+    std::lock_guard<dtl::sink_mutex> guard{d_mutex_};
+    d_impl_->drain();
+}
+
+void unix_dgram_sink::do_emergency_flush() noexcept
+{
+    // Another thread may hold the lock, or this one crashed holding it;
+    // better to lose the queue than to deadlock in a signal handler.
+    if (d_mutex_.try_lock_from_crash()) {
+        d_impl_->drain();
+        d_mutex_.unlock();
+    }
+}
+
+std::size_t unix_dgram_sink::queued() const noexcept
+{
+    std::lock_guard<dtl::sink_mutex> guard{d_mutex_};
+    return d_impl_->count;
+}
+
+dgram_sink_stats unix_dgram_sink::stats() const noexcept
+{
+    std::lock_guard<dtl::sink_mutex> guard{d_mutex_};
+    const auto& im = *d_impl_;
+    return dgram_sink_stats{im.sent, im.dropped, im.batches, im.retries};
+}
+
+#else
+
+struct unix_dgram_sink::impl {
+};
+
+unix_dgram_sink::unix_dgram_sink(std::unique_ptr<impl> impl) noexcept
+: d_impl_(std::move(impl))
+, d_mutex_()
+{
+}
+
+std::shared_ptr<unix_dgram_sink>
+unix_dgram_sink::create(const std::string& path,
+                        log_formatter::format_fn,
+                        const dgram_sink_config&)
+{
+    throw std::system_error(
+        ENOSYS, std::generic_category(), "unix datagram sink: " + path);
+}
+
+unix_dgram_sink::~unix_dgram_sink()
+{
+}
+
+void unix_dgram_sink::do_log(const log_buffer_t&)
+{
+}
+
+void unix_dgram_sink::do_flush()
+{
+}
+
+void unix_dgram_sink::do_emergency_flush() noexcept
+{
+}
+
+std::size_t unix_dgram_sink::queued() const noexcept
+{
+    return 0;
+}
+
+dgram_sink_stats unix_dgram_sink::stats() const noexcept
+{
+    return dgram_sink_stats{};
+}
+
+#endif
+
+std::shared_ptr<log_sink>
+log_sink_factory::syslog_sink(const std::string& path)
+{
+    return unix_dgram_sink::create(path, &syslog_formatter);
+}
+
+std::shared_ptr<log_sink>
+log_sink_factory::journald_sink(const std::string& path)
+{
+    return unix_dgram_sink::create(path, &journald_formatter);
+}
+
+} // namespace ldgr
@@ -0,0 +1,326 @@
+//! @file directsink.cpp
+
+#include <ldgr/directsink.hpp>
+
+#include "sinkutil.hpp"
+
+#include <cerrno>
+#include <system_error>
+
+#if !defined(_WIN32)
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ldgr {
+
+#if !defined(_WIN32)
+
+struct direct_file_sink::impl {
+    struct buffer {
+        char* data;
+        std::size_t len;      //!< record bytes in the buffer
+        std::uint64_t offset; //!< block-aligned file offset of `data`
+    };
+
+    static constexpr unsigned none = ~0u;
+
+    direct_sink_config config;
+    int fd{-1};
+    bool direct{false};
+    char* arena{nullptr};
+    std::vector<buffer> buffers;
+
+    dtl::sink_mutex mutex;
+    std::condition_variable_any writer_cv; //!< wakes the writer thread
+    std::condition_variable_any free_cv;   //!< wakes producers and flushers
+    std::vector<unsigned> free_bufs;
+    std::deque<unsigned> ready;
+    unsigned current{none};
+    std::size_t writing{0};
+    std::uint64_t next_offset{0};
+    bool stop{false};
+    direct_sink_stats stats{};
+
+    std::thread thread;
+
+    ~impl()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        std::free(arena);
+    }
+
+    //! Make sure there is a buffer to copy into. Call with `lk` held.
+    void acquire(std::unique_lock<dtl::sink_mutex>& lk)
+    {
+        if (current != none) {
+            return;
+        }
+        if (free_bufs.empty()) {
+            ++stats.buffer_waits;
+            free_cv.wait(lk, [this] { return !free_bufs.empty(); });
+        }
+        current = free_bufs.back();
+        free_bufs.pop_back();
+        auto& b = buffers[current];
+        b.len = 0;
+        b.offset = next_offset;
+        next_offset += config.buffer_size;
+    }
+
+    //! Write the partial current buffer padded to whole blocks, then cut
+    //! the file back to its logical size. Call with `mutex` held and the
+    //! writer idle.
+    void write_tail() noexcept
+    {
+        if (current == none || buffers[current].len == 0) {
+            return;
+        }
+        auto& b = buffers[current];
+        const auto mask = config.block_size - 1;
+        const auto padded = (b.len + mask) & ~mask;
+        std::memset(b.data + b.len, 0, padded - b.len);
+        if (dtl::pwrite_all(fd, b.data, padded, b.offset)) {
+            ::ftruncate(fd, static_cast<off_t>(b.offset + b.len));
+        }
+        ++stats.padded_writes;
+    }
+
+    void run()
+    {
+        std::unique_lock<dtl::sink_mutex> lk{mutex};
+        for (;;) {
+            writer_cv.wait(lk, [this] { return !ready.empty() || stop; });
+            if (ready.empty()) {
+                break;
+            }
+            const auto idx = ready.front();
+            ready.pop_front();
+            ++writing;
+            lk.unlock();
+
+            const auto& b = buffers[idx];
+            dtl::pwrite_all(fd, b.data, config.buffer_size, b.offset);
+
+            lk.lock();
+            --writing;
+            ++stats.buffers_written;
+            free_bufs.push_back(idx);
+            free_cv.notify_all();
+        }
+    }
+};
+
+direct_file_sink::direct_file_sink(std::unique_ptr<impl> impl) noexcept
+: d_impl_(std::move(impl))
+{
+}
+
+std::shared_ptr<direct_file_sink>
+direct_file_sink::create(const std::string& path,
+                         const direct_sink_config& config)
+{
+    auto im = std::make_unique<impl>();
+    auto& cfg = im->config;
+    cfg = config;
+    if (cfg.block_size < 512 || (cfg.block_size & (cfg.block_size - 1))) {
+        throw std::system_error(
+            EINVAL, std::generic_category(), "direct sink block size");
+    }
+    const auto mask = cfg.block_size - 1;
+    cfg.buffer_size =
+        (std::max(cfg.buffer_size, cfg.block_size) + mask) & ~mask;
+    cfg.buffer_count = std::max<std::size_t>(cfg.buffer_count, 1);
+
+    // Read access lets the sink pick up a partial last block.
+    const int flags = O_RDWR | O_CREAT | O_CLOEXEC;
+#if defined(O_DIRECT)
+    im->fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    im->direct = im->fd >= 0;
+    if (im->fd < 0 && errno == EINVAL) {
+        im->fd = ::open(path.c_str(), flags, 0644);
+    }
+#else
+    im->fd = ::open(path.c_str(), flags, 0644);
+#if defined(F_NOCACHE)
+    im->direct = im->fd >= 0 && ::fcntl(im->fd, F_NOCACHE, 1) == 0;
+#endif
+#endif
+    if (im->fd < 0) {
+        throw std::system_error(
+            errno, std::generic_category(), "open " + path);
+    }
+    im->stats.direct = im->direct;
+
+    void* arena = nullptr;
+    if (const int err = ::posix_memalign(
+            &arena, cfg.block_size, cfg.buffer_size * cfg.buffer_count)) {
+        throw std::system_error(
+            err, std::generic_category(), "direct sink buffers");
+    }
+    im->arena = static_cast<char*>(arena);
+    im->buffers.resize(cfg.buffer_count);
+    for (std::size_t i = 0; i < cfg.buffer_count; ++i) {
+        im->buffers[i] = impl::buffer{im->arena + i * cfg.buffer_size, 0, 0};
+        im->free_bufs.push_back(
+            static_cast<unsigned>(cfg.buffer_count - 1 - i));
+    }
+
+    // Start at the last block boundary, carrying any partial block over
+    // into the first buffer so it is rewritten whole.
+    struct stat st {};
+    if (::fstat(im->fd, &st) != 0) {
+        throw std::system_error(
+            errno, std::generic_category(), "stat " + path);
+    }
+    const auto size = static_cast<std::uint64_t>(st.st_size);
+    im->next_offset = size & ~static_cast<std::uint64_t>(mask);
+    if (const auto tail = static_cast<std::size_t>(size - im->next_offset)) {
+        std::unique_lock<dtl::sink_mutex> lk{im->mutex};
+        im->acquire(lk);
+        auto& b = im->buffers[im->current];
+        const auto r = ::pread(
+            im->fd, b.data, cfg.block_size, static_cast<off_t>(b.offset));
+        if (r != static_cast<ssize_t>(tail)) {
+            throw std::system_error(
+                r < 0 ? errno : EIO, std::generic_category(), "read " + path);
+        }
+        b.len = tail;
+    }
+
+    auto* raw = im.get();
+    im->thread = std::thread([raw] { raw->run(); });
+    return std::shared_ptr<direct_file_sink>{
+        new direct_file_sink(std::move(im))};
+}
+
+direct_file_sink::~direct_file_sink()
+{
+    retire();
+    auto& im = *d_impl_;
+    {
+        std::lock_guard<dtl::sink_mutex> guard{im.mutex};
+        im.stop = true;
+    }
+    im.writer_cv.notify_one();
+    im.thread.join();
+    std::lock_guard<dtl::sink_mutex> guard{im.mutex};
+    im.write_tail();
+}
+
+void direct_file_sink::do_log(const log_buffer_t& buff)
+{
+    auto& im = *d_impl_;
+    const char* data = buff.data();
+    std::size_t size = buff.size();
+
+    std::unique_lock<dtl::sink_mutex> lk{im.mutex};
+    im.stats.bytes_logged += size;
+    // Records are packed back to back and may straddle buffers.
+    while (size > 0) {
+        im.acquire(lk);
+        auto& b = im.buffers[im.current];
+        const auto n = std::min(size, im.config.buffer_size - b.len);
+        std::memcpy(b.data + b.len, data, n);
+        b.len += n;
+        data += n;
+        size -= n;
+        if (b.len == im.config.buffer_size) {
+            im.ready.push_back(im.current);
+            im.current = impl::none;
+            im.writer_cv.notify_one();
+        }
+    }
+}
+
+void direct_file_sink::do_flush()
+{
+    auto& im = *d_impl_;
+    std::unique_lock<dtl::sink_mutex> lk{im.mutex};
+    im.free_cv.wait(
+        lk, [&im] { return im.ready.empty() && im.writing == 0; });
+    im.write_tail();
+}
+
+void direct_file_sink::do_emergency_flush() noexcept
+{
+    // Write queued buffers from here rather than wait for the writer; a
+    // buffer it is writing at the same time just gets written twice.
+    auto& im = *d_impl_;
+    if (!im.mutex.try_lock_from_crash()) {
+        return;
+    }
+    for (const auto idx : im.ready) {
+        const auto& b = im.buffers[idx];
+        dtl::pwrite_all(im.fd, b.data, im.config.buffer_size, b.offset);
+    }
+    im.write_tail();
+    im.mutex.unlock();
+}
+
+direct_sink_stats direct_file_sink::stats() const noexcept
+{
+    std::lock_guard<dtl::sink_mutex> guard{d_impl_->mutex};
+    return d_impl_->stats;
+}
+
+#else
+
+struct direct_file_sink::impl {
+};
+
+direct_file_sink::direct_file_sink(std::unique_ptr<impl> impl) noexcept
+: d_impl_(std::move(impl))
+{
+}
+
+std::shared_ptr<direct_file_sink>
+direct_file_sink::create(const std::string& path, const direct_sink_config&)
+{
+    throw std::system_error(
+        ENOSYS, std::generic_category(), "direct file sink: " + path);
+}
+
+direct_file_sink::~direct_file_sink()
+{
+}
+
+void direct_file_sink::do_log(const log_buffer_t&)
+{
+}
+
+void direct_file_sink::do_flush()
+{
+}
+
+void direct_file_sink::do_emergency_flush() noexcept
+{
+}
+
+direct_sink_stats direct_file_sink::stats() const noexcept
+{
+    return direct_sink_stats{};
+}
+
+#endif
+
+std::shared_ptr<log_sink>
+log_sink_factory::direct_file_sink(const std::string& path)
+{
+    return ldgr::direct_file_sink::create(path);
+}
+
+} // namespace ldgr
@@ -0,0 +1,250 @@
+//! @file logclock.cpp
+
+#include <ldgr/logclock.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LDGR_CLOCK_HAVE_TSC
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+namespace ldgr {
+
+#if defined(LDGR_CLOCK_HAVE_TSC)
+
+namespace {
+
+namespace chr = std::chrono;
+
+//! Fixed-point ns per tick.
+constexpr unsigned k_mult_shift = 32;
+
+//! How far apart calibration anchors are, in ns.
+constexpr std::int64_t k_refresh_ns = 1000000000;
+
+//! Shortest span the tick rate is measured over; a closer anchor only
+//! moves the offset.
+constexpr std::int64_t k_min_slope_ns = 1000000;
+
+struct anchor {
+    std::uint64_t tsc;
+    std::int64_t ns; //!< `system_clock` ns since the epoch at `tsc`
+};
+
+//! The published calibration, read under a sequence lock so readers never
+//! block. Fields are atomics only to keep concurrent reads well defined.
+struct calibration {
+    std::atomic<std::uint32_t> seq{0};
+    std::atomic<std::uint64_t> tsc{0};
+    std::atomic<std::int64_t> ns{0};
+    std::atomic<std::uint64_t> mult{0};
+    std::atomic<std::uint64_t> refresh_at{0};
+    //! Serializes writers; readers never take it.
+    std::mutex mutex;
+    anchor last{};
+};
+
+calibration s_cal;
+
+std::int64_t system_ns() noexcept
+{
+    return chr::duration_cast<chr::nanoseconds>(
+               chr::system_clock::now().time_since_epoch())
+        .count();
+}
+
+//! A TSC reading and the `system_clock` time it corresponds to. Retries
+//! when preempted between the reads, which would blur the pairing.
+anchor sample() noexcept
+{
+    anchor best{0, 0};
+    std::uint64_t best_span = ~std::uint64_t{0};
+    for (int i = 0; i < 8; ++i) {
+        const auto t0 = __rdtsc();
+        const auto ns = system_ns();
+        const auto t1 = __rdtsc();
+        if (t1 - t0 < best_span) {
+            best_span = t1 - t0;
+            best = {t0 + (t1 - t0) / 2, ns};
+        }
+    }
+    return best;
+}
+
+std::int64_t scale(std::uint64_t ticks, std::uint64_t mult) noexcept
+{
+    return static_cast<std::int64_t>(
+        (static_cast<unsigned __int128>(ticks) * mult) >> k_mult_shift);
+}
+
+//! Anchor the calibration at a fresh sample, measuring the tick rate
+//! since `prev`. Requires the writer mutex.
+void publish(const anchor& prev) noexcept
+{
+    const auto now = sample();
+    const auto ticks = now.tsc - prev.tsc;
+    const auto span_ns = now.ns - prev.ns;
+    auto mult = s_cal.mult.load(std::memory_order_relaxed);
+    // A short or negative span (the system clock was stepped) says little
+    // about the rate; keep the old one and only move the anchor.
+    if (ticks != 0 && span_ns >= k_min_slope_ns) {
+        mult = static_cast<std::uint64_t>(
+            (static_cast<unsigned __int128>(span_ns) << k_mult_shift) /
+            ticks);
+    }
+    if (mult == 0) {
+        return;
+    }
+    const auto refresh_ticks = static_cast<std::uint64_t>(
+        (static_cast<unsigned __int128>(k_refresh_ns) << k_mult_shift) /
+        mult);
+
+    const auto seq = s_cal.seq.load(std::memory_order_relaxed);
+    s_cal.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s_cal.tsc.store(now.tsc, std::memory_order_relaxed);
+    s_cal.ns.store(now.ns, std::memory_order_relaxed);
+    s_cal.mult.store(mult, std::memory_order_relaxed);
+    s_cal.refresh_at.store(now.tsc + refresh_ticks,
+                           std::memory_order_relaxed);
+    s_cal.seq.store(seq + 2, std::memory_order_release);
+    s_cal.last = now;
+}
+
+void refresh() noexcept
+{
+    std::unique_lock<std::mutex> lock{s_cal.mutex, std::try_to_lock};
+    if (lock.owns_lock() &&
+        __rdtsc() >= s_cal.refresh_at.load(std::memory_order_relaxed)) {
+        publish(s_cal.last);
+    }
+}
+
+bool kernel_uses_tsc()
+{
+#if defined(__linux__)
+    std::ifstream in{
+        "/sys/devices/system/clocksource/clocksource0/current_clocksource"};
+    std::string source;
+    // Without sysfs there is nothing to go on but the CPU flag.
+    return !(in >> source) || source == "tsc";
+#else
+    return true;
+#endif
+}
+
+} // namespace
+
+namespace dtl {
+
+std::chrono::system_clock::time_point tsc_now() noexcept
+{
+    std::uint64_t tsc0, mult, refresh_at;
+    std::int64_t ns0;
+    for (;;) {
+        const auto seq = s_cal.seq.load(std::memory_order_acquire);
+        tsc0 = s_cal.tsc.load(std::memory_order_relaxed);
+        ns0 = s_cal.ns.load(std::memory_order_relaxed);
+        mult = s_cal.mult.load(std::memory_order_relaxed);
+        refresh_at = s_cal.refresh_at.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!(seq & 1) && s_cal.seq.load(std::memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+    const auto now = __rdtsc();
+    if (now >= refresh_at) {
+        refresh();
+    }
+    // Another core's TSC may read a little behind the anchor.
+    const auto ns = now >= tsc0 ? ns0 + scale(now - tsc0, mult)
+                                : ns0 - scale(tsc0 - now, mult);
+    return chr::system_clock::time_point{
+        chr::duration_cast<chr::system_clock::duration>(
+            chr::nanoseconds{ns})};
+}
+
+} // namespace dtl
+
+bool log_clock::tsc_available() noexcept
+{
+    static const bool s_available = [] {
+        unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+            !(edx & (1u << 8))) {
+            return false;
+        }
+        try {
+            return kernel_uses_tsc();
+        }
+        catch (...) {
+            return false;
+        }
+    }();
+    return s_available;
+}
+
+bool log_clock::use_tsc(bool enable) noexcept
+{
+    if (!enable) {
+        dtl::s_use_tsc.store(false, std::memory_order_relaxed);
+        return false;
+    }
+    if (!tsc_available()) {
+        return false;
+    }
+    {
+        const std::lock_guard<std::mutex> guard{s_cal.mutex};
+        if (s_cal.mult.load(std::memory_order_relaxed) == 0) {
+            // Spin rather than sleep; the span only has to be measured.
+            const auto first = sample();
+            while (system_ns() - first.ns < 5000000) {
+            }
+            publish(first);
+        }
+    }
+    dtl::s_use_tsc.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void log_clock::recalibrate() noexcept
+{
+    const std::lock_guard<std::mutex> guard{s_cal.mutex};
+    if (s_cal.mult.load(std::memory_order_relaxed) != 0) {
+        publish(s_cal.last);
+    }
+}
+
+#else
+
+namespace dtl {
+
+std::chrono::system_clock::time_point tsc_now() noexcept
+{
+    return std::chrono::system_clock::now();
+}
+
+} // namespace dtl
+
+bool log_clock::tsc_available() noexcept
+{
+    return false;
+}
+
+bool log_clock::use_tsc(bool) noexcept
+{
+    return false;
+}
+
+void log_clock::recalibrate() noexcept
+{
+}
+
+#endif
+
+} // namespace ldgr
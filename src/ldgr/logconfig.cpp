@@ -0,0 +1,361 @@
+//! @file logconfig.cpp
+
+#include <ldgr/logconfig.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+
+#if defined(LDGR_HAVE_CONFIG)
+#include <configmsg.hpp>
+#endif
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace ldgr {
+
+namespace {
+
+std::string read_file(const std::string& path)
+{
+    std::ifstream in{path, std::ios::binary};
+    if (!in) {
+        throw std::system_error(
+            errno, std::generic_category(), "open " + path);
+    }
+    return std::string{std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>()};
+}
+
+#if defined(LDGR_HAVE_CONFIG)
+
+log_severity parse_level(const std::string& name)
+{
+    static constexpr log_severity levels[] = {log_severity::trace,
+                                              log_severity::debug,
+                                              log_severity::info,
+                                              log_severity::warn,
+                                              log_severity::error,
+                                              log_severity::fatal,
+                                              log_severity::off};
+    for (const auto lvl : levels) {
+        const auto view = fmtutil::to_view(lvl);
+        if (view.size() == name.size() &&
+            std::equal(view.begin(),
+                       view.end(),
+                       name.begin(),
+                       [](char a, char b) {
+                           return a == (b & ~0x20); // ASCII upper-case
+                       })) {
+            return lvl;
+        }
+    }
+    throw std::runtime_error("ldgr config: unknown level '" + name + "'");
+}
+
+std::shared_ptr<log_sink> make_sink(const std::string& type,
+                                    const std::string* path)
+{
+    auto need_path = [&]() -> const std::string& {
+        if (!path) {
+            throw std::runtime_error(
+                "ldgr config: sink type '" + type + "' needs a path");
+        }
+        return *path;
+    };
+    // Sinks of their own, so the configured level and layout don't leak
+    // into the shared `stdout_sink()` and `stderr_sink()`.
+    if (type == "stdout") {
+        return log_sink_factory::fd_sink(1);
+    }
+    if (type == "stderr") {
+        return log_sink_factory::fd_sink(2);
+    }
+    if (type == "file") {
+        return log_sink_factory::file_sink(need_path());
+    }
+    if (type == "async_file") {
+        return log_sink_factory::async_file_sink(need_path());
+    }
+    if (type == "direct_file") {
+        return log_sink_factory::direct_file_sink(need_path());
+    }
+    if (type == "syslog") {
+        return path ? log_sink_factory::syslog_sink(*path)
+                    : log_sink_factory::syslog_sink();
+    }
+    if (type == "journald") {
+        return path ? log_sink_factory::journald_sink(*path)
+                    : log_sink_factory::journald_sink();
+    }
+    throw std::runtime_error("ldgr config: unknown sink type '" + type + "'");
+}
+
+#endif
+
+} // namespace
+
+void log_registry::apply_config(const std::string& json)
+{
+#if defined(LDGR_HAVE_CONFIG)
+    ldgr_cfg::Config cfg;
+    std::istringstream is{json};
+    if (!ldgr_cfg::fromJson(is, cfg)) {
+        throw std::runtime_error(
+            "ldgr config: malformed JSON or unexpected field");
+    }
+
+    // One reload at a time, so sink reuse sees the previous configuration.
+    static std::mutex s_apply_mutex;
+    const std::lock_guard<std::mutex> apply_guard{s_apply_mutex};
+    auto& s = instance();
+    std::shared_ptr<const dtl::log_config_state> prev;
+    {
+        const std::lock_guard<std::mutex> guard{s.d_config_mutex_};
+        prev = s.d_config_;
+    }
+
+    auto state = std::make_shared<dtl::log_config_state>();
+    for (const auto& lv : cfg.levels) {
+        state->levels.push_back({lv.category, parse_level(lv.level)});
+    }
+
+    // Sinks are set up completely before anything is published. A sink
+    // whose type and path are unchanged is reused rather than reopened, so
+    // sinks that track their own file offsets never share a file.
+    std::unordered_set<std::string> names;
+    for (const auto& sc : cfg.sinks) {
+        if (!names.insert(sc.name).second) {
+            throw std::runtime_error(
+                "ldgr config: duplicate sink name '" + sc.name + "'");
+        }
+        const auto* path = sc.path ? &*sc.path : nullptr;
+        dtl::log_config_state::sink_route route;
+        route.key = sc.type + '\n' + (path ? *path : std::string{});
+        if (prev) {
+            for (const auto& old : prev->sinks) {
+                if (old.key == route.key) {
+                    route.sink = old.sink;
+                    route.base_formatter = old.base_formatter;
+                    break;
+                }
+            }
+        }
+        if (!route.sink) {
+            route.sink = make_sink(sc.type, path);
+            route.base_formatter = route.sink->formatter();
+        }
+        route.formatter =
+            sc.pattern ? std::make_shared<log_formatter>(
+                             log_formatter::as_pattern{}, *sc.pattern)
+                       : route.base_formatter;
+        route.level =
+            sc.level ? parse_level(*sc.level) : log_severity::trace;
+        route.categories = sc.categories;
+        if (route.categories.empty()) {
+            route.categories.emplace_back("*");
+        }
+        state->sinks.push_back(std::move(route));
+    }
+
+    {
+        // Reused sinks are live; they change layout and level together
+        // with the generation, never ahead of it.
+        const std::lock_guard<std::mutex> guard{s.d_config_mutex_};
+        for (const auto& route : state->sinks) {
+            route.sink->set_formatter(route.formatter);
+            route.sink->set_level(route.level);
+        }
+        s.d_config_ = std::move(state);
+        s.d_config_gen_.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // Loggers pick the new configuration up on their next call; syncing
+    // them now as well lets replaced sinks close promptly.
+    std::vector<std::shared_ptr<logger>> loggers;
+    {
+        const std::lock_guard<std::mutex> guard{s.d_logger_mutex_};
+        for (const auto& kv : s.d_loggers_) {
+            loggers.push_back(kv.second);
+        }
+    }
+    for (const auto& l : loggers) {
+        l->sync_config();
+    }
+#else
+    static_cast<void>(json);
+    throw std::system_error(ENOSYS,
+                            std::generic_category(),
+                            "ldgr was built without configuration support");
+#endif
+}
+
+void log_registry::load_config(const std::string& path)
+{
+    apply_config(read_file(path));
+}
+
+#if defined(__linux__)
+
+struct log_config_watcher::impl {
+    std::string path;
+    std::string dir;
+    std::string base;
+    error_handler on_error;
+    std::string applied; //!< contents last applied, to skip no-op events
+    int inotify_fd{-1};
+    int stop_fd{-1};
+    std::atomic<std::size_t> reloads{0};
+    std::atomic<std::size_t> failures{0};
+    std::thread thread;
+
+    ~impl()
+    {
+        if (inotify_fd >= 0) {
+            ::close(inotify_fd);
+        }
+        if (stop_fd >= 0) {
+            ::close(stop_fd);
+        }
+    }
+
+    void reload()
+    {
+        try {
+            auto text = read_file(path);
+            if (text == applied) {
+                return;
+            }
+            log_registry::apply_config(text);
+            applied = std::move(text);
+            ++reloads;
+        }
+        catch (const std::exception& ex) {
+            ++failures;
+            if (on_error) {
+                on_error(ex.what());
+            }
+        }
+    }
+
+    void run()
+    {
+        alignas(inotify_event) char buff[4096];
+        for (;;) {
+            pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            if (fds[1].revents) {
+                return;
+            }
+            const auto n = ::read(inotify_fd, buff, sizeof(buff));
+            if (n <= 0) {
+                continue;
+            }
+            bool hit = false;
+            for (ssize_t off = 0; off < n;) {
+                const auto* ev =
+                    reinterpret_cast<const inotify_event*>(buff + off);
+                if (ev->len && base == ev->name) {
+                    hit = true;
+                }
+                off += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+            }
+            if (hit) {
+                reload();
+            }
+        }
+    }
+};
+
+log_config_watcher::log_config_watcher(std::string path,
+                                       error_handler on_error)
+: d_impl_(std::make_unique<impl>())
+{
+    auto& im = *d_impl_;
+    im.path = std::move(path);
+    im.on_error = std::move(on_error);
+    const auto slash = im.path.rfind('/');
+    im.dir = slash == std::string::npos ? "." : im.path.substr(0, slash + 1);
+    im.base = slash == std::string::npos ? im.path
+                                          : im.path.substr(slash + 1);
+
+    im.applied = read_file(im.path);
+    log_registry::apply_config(im.applied);
+
+    im.inotify_fd = ::inotify_init1(IN_CLOEXEC);
+    im.stop_fd = ::eventfd(0, EFD_CLOEXEC);
+    if (im.inotify_fd < 0 || im.stop_fd < 0 ||
+        ::inotify_add_watch(
+            im.inotify_fd, im.dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        throw std::system_error(
+            errno, std::generic_category(), "inotify " + im.dir);
+    }
+    auto* raw = d_impl_.get();
+    im.thread = std::thread([raw] { raw->run(); });
+}
+
+log_config_watcher::~log_config_watcher()
+{
+    const std::uint64_t one = 1;
+    if (::write(d_impl_->stop_fd, &one, sizeof(one)) < 0) {
+        // eventfd writes only fail on counter overflow
+    }
+    d_impl_->thread.join();
+}
+
+std::size_t log_config_watcher::reloads() const noexcept
+{
+    return d_impl_->reloads.load();
+}
+
+std::size_t log_config_watcher::failures() const noexcept
+{
+    return d_impl_->failures.load();
+}
+
+#else
+
+struct log_config_watcher::impl {
+};
+
+log_config_watcher::log_config_watcher(std::string path, error_handler)
+{
+    throw std::system_error(
+        ENOSYS, std::generic_category(), "config watcher: " + path);
+}
+
+log_config_watcher::~log_config_watcher()
+{
+}
+
+std::size_t log_config_watcher::reloads() const noexcept
+{
+    return 0;
+}
+
+std::size_t log_config_watcher::failures() const noexcept
+{
+    return 0;
+}
+
+#endif
+
+} // namespace ldgr
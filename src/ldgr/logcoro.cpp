@@ -0,0 +1,97 @@
+//! @file logcoro.cpp
+
+#include <ldgr/logcoro.hpp>
+
+#if defined(LDGR_HAVE_COROUTINES) && defined(__cpp_impl_coroutine)
+#include <ldgr/logger.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace ldgr {
+
+namespace dtl {
+
+//! Runs the flushes requested by `log_flush_awaitable` one at a time and
+//! resumes each waiting coroutine afterwards.
+struct log_flush_worker {
+    struct request {
+        log_flush_awaitable* awaitable;
+        std::coroutine_handle<> handle;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<request> queue;
+    bool stop{false};
+    std::thread thread{[this] { run(); }};
+
+    ~log_flush_worker()
+    {
+        {
+            const std::lock_guard<std::mutex> guard{mutex};
+            stop = true;
+        }
+        cv.notify_one();
+        thread.join();
+    }
+
+    void post(request req)
+    {
+        {
+            const std::lock_guard<std::mutex> guard{mutex};
+            queue.push_back(req);
+        }
+        cv.notify_one();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        for (;;) {
+            cv.wait(lock, [this] { return stop || !queue.empty(); });
+            if (queue.empty()) {
+                return; // stopping, and every waiter has been resumed
+            }
+            const auto req = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            try {
+                if (req.awaitable->d_target_) {
+                    req.awaitable->d_target_->flush();
+                }
+                else {
+                    log_registry::flush_all();
+                }
+            }
+            catch (...) {
+                req.awaitable->d_error_ = std::current_exception();
+            }
+            req.handle.resume();
+            lock.lock();
+        }
+    }
+};
+
+} // namespace dtl
+
+namespace {
+
+dtl::log_flush_worker& flush_worker()
+{
+    static dtl::log_flush_worker s_worker;
+    return s_worker;
+}
+
+} // namespace
+
+void log_flush_awaitable::await_suspend(std::coroutine_handle<> h)
+{
+    flush_worker().post({this, h});
+}
+
+} // namespace ldgr
+
+#endif
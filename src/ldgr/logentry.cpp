@@ -2,32 +2,216 @@
 
 #include <ldgr/logentry.hpp>
 
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 namespace ldgr {
 
+namespace {
+
+//! Parse a sysfs cpu list such as "0-3,8-11" into `out`.
+void parse_cpu_list(const std::string& list, std::vector<std::size_t>& out)
+{
+    std::size_t pos = 0;
+    while (pos < list.size()) {
+        auto end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        const auto range = list.substr(pos, end - pos);
+        const auto dash = range.find('-');
+        try {
+            const auto lo = std::stoul(range.substr(0, dash));
+            const auto hi = dash == std::string::npos
+                                ? lo
+                                : std::stoul(range.substr(dash + 1));
+            for (auto cpu = lo; cpu <= hi; ++cpu) {
+                out.push_back(cpu);
+            }
+        }
+        catch (const std::exception&) {
+            // Ignore malformed ranges; the CPU just maps to shard 0.
+        }
+        pos = end + 1;
+    }
+}
+
+//! NUMA node of each CPU, indexed by CPU number. Empty if the topology is
+//! not available or there is only one node.
+std::vector<std::uint32_t> numa_cpu_nodes()
+{
+    std::vector<std::uint32_t> cpu_nodes;
+#if defined(__linux__)
+    std::uint32_t node = 0;
+    for (;; ++node) {
+        std::ifstream in{"/sys/devices/system/node/node" +
+                         std::to_string(node) + "/cpulist"};
+        if (!in) {
+            break;
+        }
+        std::string list;
+        std::getline(in, list);
+        std::vector<std::size_t> cpus;
+        parse_cpu_list(list, cpus);
+        for (auto cpu : cpus) {
+            if (cpu >= cpu_nodes.size()) {
+                cpu_nodes.resize(cpu + 1, 0);
+            }
+            cpu_nodes[cpu] = node;
+        }
+    }
+    if (node < 2) {
+        cpu_nodes.clear();
+    }
+#endif
+    return cpu_nodes;
+}
+
+} // namespace
+
+pooled_log_buffer_factory::pooled_log_buffer_factory(
+    const log_buffer_pool_config& config)
+: d_config_(config)
+, d_shard_count_(1)
+, d_shards_()
+, d_cpu_shards_()
+, d_hits_(0)
+, d_misses_(0)
+, d_bytes_resident_(0)
+, d_peak_bytes_(0)
+, d_bytes_trimmed_(0)
+, d_spilled_(0)
+, d_bytes_spilled_(0)
+, d_truncated_(0)
+, d_capped_(0)
+, d_remote_frees_(0)
+{
+    switch (d_config_.sharding) {
+        case log_pool_sharding::none: break;
+        case log_pool_sharding::numa_node: {
+            d_cpu_shards_ = numa_cpu_nodes();
+            if (!d_cpu_shards_.empty()) {
+                d_shard_count_ = *std::max_element(d_cpu_shards_.begin(),
+                                                   d_cpu_shards_.end()) +
+                                 1;
+            }
+        } break;
+        case log_pool_sharding::cpu: {
+            const auto cpus = std::thread::hardware_concurrency();
+            if (cpus > 1) {
+                d_shard_count_ = cpus;
+                d_cpu_shards_.resize(cpus);
+                for (std::uint32_t i = 0; i < cpus; ++i) {
+                    d_cpu_shards_[i] = i;
+                }
+            }
+        } break;
+    }
+    if (d_shard_count_ == 1 || current_cpu() < 0) {
+        d_shard_count_ = 1;
+        d_cpu_shards_.clear();
+    }
+    d_shards_.reset(new shard[d_shard_count_]);
+}
+
 pooled_log_buffer_factory::~pooled_log_buffer_factory() noexcept
 {
-    node* n = nullptr;
-    mem_block* b = nullptr;
-    {
-        std::lock_guard<std::mutex> guard{d_free_list_mutex_};
-        n = d_free_list_;
-        d_free_list_ = nullptr;
-    }
-    {
-        std::lock_guard<std::mutex> guard{d_free_ctrl_blocks_mutex_};
-        b = d_free_ctrl_blocks_;
-        d_free_ctrl_blocks_ = nullptr;
+    for (std::size_t i = 0; i < d_shard_count_; ++i) {
+        auto& sh = d_shards_[i];
+        drain_remote(sh);
+        for (auto& fl : sh.free_lists) {
+            node* n = nullptr;
+            {
+                std::lock_guard<std::mutex> guard{fl.mutex};
+                n = fl.head;
+                fl.head = nullptr;
+            }
+            while (n) {
+                auto* next = n->next;
+                delete n;
+                n = next;
+            }
+        }
     }
+}
+
+int pooled_log_buffer_factory::current_cpu() noexcept
+{
+#if defined(__linux__)
+    return ::sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+void pooled_log_buffer_factory::drain_remote(shard& sh) noexcept
+{
+    auto* n = sh.remote_free.exchange(nullptr, std::memory_order_acquire);
+    std::array<node*, size_classes.size()> heads{};
+    std::array<node*, size_classes.size()> tails{};
     while (n) {
         auto* next = n->next;
-        delete n;
+        const auto cls = n->size_class;
+        n->next = heads[cls];
+        if (!heads[cls]) {
+            tails[cls] = n;
+        }
+        heads[cls] = n;
         n = next;
     }
-    while (b) {
-        auto* next = b->next;
-        ::operator delete(b);
-        b = next;
+    for (std::size_t cls = 0; cls < size_classes.size(); ++cls) {
+        if (!heads[cls]) {
+            continue;
+        }
+        auto& fl = sh.free_lists[cls];
+        std::lock_guard<std::mutex> guard{fl.mutex};
+        tails[cls]->next = fl.head;
+        fl.head = heads[cls];
     }
 }
 
+std::size_t pooled_log_buffer_factory::trim(std::size_t target) noexcept
+{
+    for (std::size_t i = 0; i < d_shard_count_; ++i) {
+        drain_remote(d_shards_[i]);
+    }
+
+    std::size_t freed = 0;
+    for (auto cls = size_classes.size(); cls-- > 0;) {
+        for (std::size_t i = 0; i < d_shard_count_; ++i) {
+            auto& fl = d_shards_[i].free_lists[cls];
+            node* victims = nullptr;
+            {
+                std::lock_guard<std::mutex> guard{fl.mutex};
+                while (fl.head &&
+                       d_bytes_resident_.load(std::memory_order_relaxed) >
+                           target) {
+                    auto* n = fl.head;
+                    fl.head = n->next;
+                    const auto bytes = node_bytes(*n);
+                    d_bytes_resident_.fetch_sub(bytes,
+                                                std::memory_order_relaxed);
+                    freed += bytes;
+                    n->next = victims;
+                    victims = n;
+                }
+            }
+            while (victims) {
+                auto* next = victims->next;
+                delete victims;
+                victims = next;
+            }
+        }
+    }
+
+    d_bytes_trimmed_.fetch_add(freed, std::memory_order_relaxed);
+    return freed;
+}
+
 } // namespace ldgr
@@ -0,0 +1,210 @@
+//! @file logfilter.cpp
+
+#include <ldgr/logfilter.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <regex>
+
+namespace ldgr {
+
+namespace {
+
+std::uint32_t severity_bit(log_severity sev) noexcept
+{
+    return std::uint32_t{1} << (static_cast<unsigned>(sev) / 4 % 32);
+}
+
+//! Bits for every severity in [lo, hi].
+std::uint32_t severity_mask(log_severity lo, log_severity hi) noexcept
+{
+    std::uint32_t mask = 0;
+    for (auto sev : {log_severity::trace,
+                     log_severity::debug,
+                     log_severity::info,
+                     log_severity::warn,
+                     log_severity::error,
+                     log_severity::fatal}) {
+        if (sev >= lo && sev <= hi) {
+            mask |= severity_bit(sev);
+        }
+    }
+    return mask;
+}
+
+bool contains(fmt::string_view haystack, const std::string& needle) noexcept
+{
+    return needle.empty() ||
+           std::search(haystack.begin(),
+                       haystack.end(),
+                       needle.begin(),
+                       needle.end()) != haystack.end();
+}
+
+} // namespace
+
+struct log_filter::node {
+    std::uint32_t first_child;
+    std::uint32_t child_count;
+    std::uint32_t first_slow;
+    std::uint32_t slow_count;
+    char ch;
+    //! Severity masks for rules matching every category below this node
+    //! (`prefix_*`) or only the category ending here (`exact_*`).
+    std::uint32_t prefix_accept;
+    std::uint32_t prefix_reject;
+    std::uint32_t exact_accept;
+    std::uint32_t exact_reject;
+};
+
+struct log_filter::slow_rule {
+    log_filter_action action;
+    bool exact;
+    std::uint32_t severities;
+    std::string file;
+    std::string message;
+    std::unique_ptr<std::regex> regex;
+
+    bool matches(const log_entry_fmt& entry) const
+    {
+        return contains(entry.file, file) &&
+               contains(entry.message, message) &&
+               (!regex ||
+                std::regex_search(
+                    entry.message.begin(), entry.message.end(), *regex));
+    }
+};
+
+log_filter::log_filter(const std::vector<log_filter_rule>& rules)
+{
+    // Build a pointer-free trie first, then lay it out breadth first so
+    // that each node's children are contiguous and sorted.
+    struct build_node {
+        std::map<unsigned char, std::size_t> next;
+        node masks{};
+        std::vector<slow_rule> slow;
+    };
+    std::vector<build_node> tree(1);
+
+    for (const auto& rule : rules) {
+        std::string cat = rule.category;
+        bool exact = true;
+        if (cat.empty() || cat.back() == '*') {
+            exact = false;
+            if (!cat.empty()) {
+                cat.pop_back();
+            }
+        }
+        std::size_t at = 0;
+        for (const unsigned char c : cat) {
+            auto it = tree[at].next.find(c);
+            if (it == tree[at].next.end()) {
+                it = tree[at].next.emplace(c, tree.size()).first;
+                tree.emplace_back();
+            }
+            at = it->second;
+        }
+
+        const auto mask = severity_mask(rule.min_severity, rule.max_severity);
+        const bool accept = rule.action == log_filter_action::accept;
+        d_has_accept_ = d_has_accept_ || accept;
+        auto& target = tree[at];
+        if (rule.file.empty() && rule.message.empty() &&
+            rule.message_regex.empty()) {
+            auto& m = target.masks;
+            (exact ? (accept ? m.exact_accept : m.exact_reject)
+                   : (accept ? m.prefix_accept : m.prefix_reject)) |= mask;
+            continue;
+        }
+        slow_rule slow{rule.action, exact, mask, rule.file, rule.message, {}};
+        if (!rule.message_regex.empty()) {
+            slow.regex = std::make_unique<std::regex>(
+                rule.message_regex,
+                std::regex::ECMAScript | std::regex::optimize);
+        }
+        target.slow.push_back(std::move(slow));
+    }
+
+    std::deque<std::pair<std::size_t, char>> queue{{0, '\0'}};
+    d_nodes_.reserve(tree.size());
+    std::uint32_t next_child = 1;
+    while (!queue.empty()) {
+        const auto [idx, ch] = queue.front();
+        queue.pop_front();
+        auto& b = tree[idx];
+        node n = b.masks;
+        n.ch = ch;
+        n.first_child = next_child;
+        n.child_count = static_cast<std::uint32_t>(b.next.size());
+        n.first_slow = static_cast<std::uint32_t>(d_slow_.size());
+        n.slow_count = static_cast<std::uint32_t>(b.slow.size());
+        next_child += n.child_count;
+        for (auto& s : b.slow) {
+            d_slow_.push_back(std::move(s));
+        }
+        for (const auto& [c, child] : b.next) {
+            queue.emplace_back(child, static_cast<char>(c));
+        }
+        d_nodes_.push_back(n);
+    }
+}
+
+log_filter::~log_filter() = default;
+
+bool log_filter::accepts(const log_entry_fmt& entry) const noexcept
+{
+    const auto bit = severity_bit(entry.severity);
+    const auto& cat = entry.name;
+    bool accepted = !d_has_accept_;
+    std::uint32_t at = 0;
+    for (std::size_t i = 0;; ++i) {
+        const auto& n = d_nodes_[at];
+        const bool at_end = i == cat.size();
+        const auto reject = n.prefix_reject | (at_end ? n.exact_reject : 0);
+        if (reject & bit) {
+            return false;
+        }
+        accepted = accepted ||
+                   ((n.prefix_accept | (at_end ? n.exact_accept : 0)) & bit);
+        for (auto s = n.first_slow; s < n.first_slow + n.slow_count; ++s) {
+            const auto& rule = d_slow_[s];
+            if ((rule.exact && !at_end) || !(rule.severities & bit)) {
+                continue;
+            }
+            const bool rejects = rule.action == log_filter_action::reject;
+            if (accepted && !rejects) {
+                continue;
+            }
+            bool hit = false;
+            try {
+                hit = rule.matches(entry);
+            }
+            catch (...) {
+                // e.g. regex complexity limits; treat as no match.
+            }
+            if (hit && rejects) {
+                return false;
+            }
+            accepted = accepted || hit;
+        }
+        if (at_end) {
+            break;
+        }
+        const auto first = d_nodes_.begin() + n.first_child;
+        const auto last = first + n.child_count;
+        const auto child = std::lower_bound(
+            first, last, cat[i], [](const node& c, char ch) {
+                return static_cast<unsigned char>(c.ch) <
+                       static_cast<unsigned char>(ch);
+            });
+        if (child == last || child->ch != cat[i]) {
+            break;
+        }
+        at = static_cast<std::uint32_t>(child - d_nodes_.begin());
+    }
+    return accepted;
+}
+
+} // namespace ldgr
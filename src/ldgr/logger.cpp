@@ -2,12 +2,416 @@
 
 #include <ldgr/logger.hpp>
 
+#include <memory>
+#include <new>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <ctime>
+
+#include <signal.h>
+#include <unistd.h>
+#endif
+
 namespace ldgr {
 
+namespace dtl {
+
+backtrace_ring* thread_backtrace_ring(bool create) noexcept
+{
+    // Allocated on first capture, so threads that never capture pay
+    // nothing for it.
+    thread_local std::unique_ptr<backtrace_ring> t_ring;
+    if (!t_ring && create) {
+        t_ring.reset(new (std::nothrow) backtrace_ring());
+    }
+    return t_ring.get();
+}
+
+} // namespace dtl
+
 log_registry& log_registry::instance()
 {
     static log_registry f;
     return f;
 }
 
+void log_registry::flush_all()
+{
+    // Flushes may block on I/O, and sinks may log while flushing; neither
+    // may hold up `get`.
+    auto& s = instance();
+    std::vector<std::shared_ptr<logger>> loggers;
+    {
+        const std::lock_guard<std::mutex> guard{s.d_logger_mutex_};
+        for (const auto& kv : s.d_loggers_) {
+            loggers.push_back(kv.second);
+        }
+    }
+    for (const auto& l : loggers) {
+        l->flush();
+    }
+}
+
+namespace {
+
+//! How specifically `pattern` matches `name`, or -1 if it does not: `*`
+//! (or empty) matches anything, `X*` any name starting with `X`, and
+//! anything else only itself. Longer patterns are more specific, and an
+//! exact match beats a prefix of the same length.
+long category_match(const std::string& pattern, fmt::string_view name)
+{
+    if (pattern.empty() || pattern == "*") {
+        return 0;
+    }
+    const auto n = static_cast<long>(pattern.size());
+    if (pattern.back() == '*') {
+        const auto prefix = pattern.size() - 1;
+        const bool hit = name.size() >= prefix &&
+                         pattern.compare(0, prefix, name.data(), prefix) == 0;
+        return hit ? 2 * n - 1 : -1;
+    }
+    const bool hit = pattern.size() == name.size() &&
+                     pattern.compare(0, name.size(), name.data(),
+                                     name.size()) == 0;
+    return hit ? 2 * n + 2 : -1;
+}
+
+} // namespace
+
+void logger::emit_backtrace()
+{
+    auto* ring = dtl::thread_backtrace_ring(false);
+    if (!ring) {
+        return;
+    }
+    ring->drain(this, [this](const dtl::backtrace_record& rec) {
+        log_buffer_t buff;
+        if (rec.format) {
+            rec.format(buff, rec.site->format, rec.payload);
+        }
+        else {
+            fmtutil::append(
+                buff,
+                fmt::string_view{reinterpret_cast<const char*>(rec.payload),
+                                 rec.size});
+        }
+        auto entry = log_entry_util::from_site(
+            *rec.site, rec.when, fmtutil::to_view(buff), name());
+        entry.context = {}; // the context has moved on since
+        const auto cp =
+            d_copy_entries_
+                ? log_entry_util::copy_log_entry(entry, true, *d_factory_)
+                : log_entry_util::view_log_entry(entry, true);
+        for (const auto& s : d_sinks_) {
+            s->log(cp);
+        }
+    });
+}
+
+void logger::sync_config() noexcept
+{
+    auto& reg = log_registry::instance();
+    try {
+        const std::lock_guard<std::mutex> guard{d_sinks_mutex_};
+        std::shared_ptr<const dtl::log_config_state> cfg;
+        std::uint64_t gen = 0;
+        {
+            const std::lock_guard<std::mutex> cfg_guard{reg.d_config_mutex_};
+            cfg = reg.d_config_;
+            gen = reg.d_config_gen_.load(std::memory_order_relaxed);
+        }
+        if (gen == d_config_gen_.load(std::memory_order_relaxed) || !cfg) {
+            return;
+        }
+
+        auto level = log_severity::info;
+        long best = -1;
+        for (const auto& rule : cfg->levels) {
+            const auto m = category_match(rule.category, name());
+            if (m > best) {
+                best = m;
+                level = rule.level;
+            }
+        }
+        if (cfg->sinks.empty()) {
+            if (d_config_routed_) {
+                d_sinks_ = std::move(d_code_sinks_);
+                d_code_sinks_.clear();
+                d_config_routed_ = false;
+                update_copy_entries();
+            }
+        }
+        else {
+            std::vector<std::shared_ptr<log_sink>> sinks;
+            for (const auto& route : cfg->sinks) {
+                const bool routed = std::any_of(
+                    route.categories.begin(),
+                    route.categories.end(),
+                    [this](const auto& c) {
+                        return category_match(c, name()) >= 0;
+                    });
+                if (routed) {
+                    sinks.push_back(route.sink);
+                }
+            }
+            if (!d_config_routed_) {
+                d_code_sinks_ = d_sinks_;
+                d_config_routed_ = true;
+            }
+            d_sinks_ = std::move(sinks);
+            update_copy_entries();
+        }
+        d_level_.store(level, std::memory_order_release);
+        d_config_gen_.store(gen, std::memory_order_release);
+    }
+    catch (...) {
+        // Out of memory; keep the old setup and retry on the next call.
+    }
+}
+
+#if !defined(_WIN32)
+
+namespace {
+
+constexpr int k_fatal_signals[] = {SIGSEGV, SIGABRT, SIGBUS, SIGILL, SIGFPE};
+constexpr std::size_t k_num_fatal_signals =
+    sizeof(k_fatal_signals) / sizeof(k_fatal_signals[0]);
+
+struct sigaction s_prev_actions[k_num_fatal_signals];
+volatile sig_atomic_t s_crash_fd = 2;
+volatile sig_atomic_t s_installed = 0;
+std::atomic<bool> s_crashing{false};
+std::atomic<bool> s_crash_flushed{false};
+
+//! How long a second crashing thread waits for the first one's flush.
+constexpr int k_crash_wait_ms = 1000;
+
+//! Minimal fixed-size writer; nothing here may allocate or lock.
+struct crash_line {
+    char data[512];
+    std::size_t size = 0;
+
+    void put(char ch) noexcept
+    {
+        if (size < sizeof(data)) {
+            data[size++] = ch;
+        }
+    }
+
+    void put(const char* str) noexcept
+    {
+        while (*str) {
+            put(*str++);
+        }
+    }
+
+    void put_dec(unsigned long long v, int width = 0) noexcept
+    {
+        char tmp[24];
+        int n = 0;
+        do {
+            tmp[n++] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v);
+        while (width-- > n) {
+            put('0');
+        }
+        while (n) {
+            put(tmp[--n]);
+        }
+    }
+
+    void put_hex(std::uintptr_t v) noexcept
+    {
+        put("0x");
+        char tmp[2 * sizeof(v)];
+        int n = 0;
+        do {
+            tmp[n++] = "0123456789abcdef"[v & 0xf];
+            v >>= 4;
+        } while (v);
+        while (n) {
+            put(tmp[--n]);
+        }
+    }
+
+    //! `YYYY-MM-DD HH:MM:SS.uuuuuuZ`, like the default formatter, computed
+    //! by hand because `gmtime_r` is not async-signal-safe.
+    void put_time(const timespec& ts) noexcept
+    {
+        const long long secs = ts.tv_sec;
+        long long days = secs / 86400;
+        long long rem = secs % 86400;
+        // Civil-from-days, after H. Hinnant.
+        days += 719468;
+        const long long era = (days >= 0 ? days : days - 146096) / 146097;
+        const long long doe = days - era * 146097;
+        const long long yoe =
+            (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const long long mp = (5 * doy + 2) / 153;
+        const long long day = doy - (153 * mp + 2) / 5 + 1;
+        const long long month = mp < 10 ? mp + 3 : mp - 9;
+        const long long year = yoe + era * 400 + (month <= 2);
+        put_dec(static_cast<unsigned long long>(year), 4);
+        put('-');
+        put_dec(static_cast<unsigned long long>(month), 2);
+        put('-');
+        put_dec(static_cast<unsigned long long>(day), 2);
+        put(' ');
+        put_dec(static_cast<unsigned long long>(rem / 3600), 2);
+        put(':');
+        put_dec(static_cast<unsigned long long>((rem % 3600) / 60), 2);
+        put(':');
+        put_dec(static_cast<unsigned long long>(rem % 60), 2);
+        put('.');
+        put_dec(static_cast<unsigned long long>(ts.tv_nsec / 1000), 6);
+        put('Z');
+    }
+};
+
+const char* signal_name(int sig) noexcept
+{
+    switch (sig) {
+        case SIGSEGV: return "SIGSEGV";
+        case SIGABRT: return "SIGABRT";
+        case SIGBUS: return "SIGBUS";
+        case SIGILL: return "SIGILL";
+        case SIGFPE: return "SIGFPE";
+    }
+    return "signal";
+}
+
+void write_all(int fd, const char* data, std::size_t size) noexcept
+{
+    while (size) {
+        const auto n = ::write(fd, data, size);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+}
+
+void emergency_flush_sink(log_sink& sink) noexcept
+{
+    sink.emergency_flush();
+}
+
+void restore_actions() noexcept
+{
+    for (std::size_t i = 0; i < k_num_fatal_signals; ++i) {
+        ::sigaction(k_fatal_signals[i], &s_prev_actions[i], nullptr);
+    }
+}
+
+void crash_handler(int sig, siginfo_t* info, void*)
+{
+    const int saved_errno = errno;
+    if (!s_crashing.exchange(true)) {
+        log_sink::for_each_live(&emergency_flush_sink);
+
+        timespec ts{};
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+        crash_line line;
+        line.put_time(ts);
+        line.put(" [FATAL] ldgr caught ");
+        line.put(signal_name(sig));
+        line.put(" (");
+        line.put_dec(static_cast<unsigned>(sig));
+        line.put(")");
+        if (info && sig != SIGABRT) {
+            line.put(" at ");
+            line.put_hex(reinterpret_cast<std::uintptr_t>(info->si_addr));
+        }
+        line.put(" pid=");
+        line.put_dec(static_cast<unsigned long long>(::getpid()));
+        line.put('\n');
+        write_all(s_crash_fd, line.data, line.size);
+        s_crash_flushed.store(true);
+    }
+    else {
+        // Re-raising now could end the process while the first crashing
+        // thread is still flushing; give it a moment.
+        for (int ms = 0; ms < k_crash_wait_ms && !s_crash_flushed.load();
+             ++ms) {
+            timespec pause{0, 1000000};
+            ::nanosleep(&pause, nullptr);
+        }
+    }
+    errno = saved_errno;
+
+    // Hand the signal to whoever had it before us (usually the default
+    // action, which terminates and dumps core).
+    restore_actions();
+    s_installed = 0;
+    ::raise(sig);
+}
+
+} // namespace
+
+void log_registry::install_crash_handler(int fd)
+{
+    s_crash_fd = fd;
+    if (s_installed) {
+        return;
+    }
+
+    // sigaltstack is per thread: this one gets its stack now, others on
+    // their first record.
+    dtl::s_crash_stacks.store(true, std::memory_order_relaxed);
+    dtl::install_crash_stack();
+
+    struct sigaction sa{};
+    sa.sa_sigaction = &crash_handler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    ::sigemptyset(&sa.sa_mask);
+    for (std::size_t i = 0; i < k_num_fatal_signals; ++i) {
+        ::sigaction(k_fatal_signals[i], &sa, &s_prev_actions[i]);
+    }
+    s_crashing = false;
+    s_crash_flushed = false;
+    s_installed = 1;
+}
+
+void log_registry::uninstall_crash_handler()
+{
+    if (!s_installed) {
+        return;
+    }
+    restore_actions();
+    dtl::s_crash_stacks.store(false, std::memory_order_relaxed);
+    s_installed = 0;
+}
+
+void log_registry::install_crash_stack()
+{
+    dtl::install_crash_stack();
+}
+
+#else
+
+void log_registry::install_crash_handler(int)
+{
+}
+
+void log_registry::uninstall_crash_handler()
+{
+}
+
+void log_registry::install_crash_stack()
+{
+}
+
+#endif
+
 } // namespace ldgr
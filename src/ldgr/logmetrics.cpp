@@ -0,0 +1,346 @@
+//! @file logmetrics.cpp
+
+#include <ldgr/logger.hpp>
+#include <ldgr/logmetrics.hpp>
+
+#include <fmt/format.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
+
+namespace ldgr {
+
+namespace {
+
+struct slot_pool {
+    std::mutex mutex;
+    std::vector<unsigned> free;
+    unsigned next{0};
+};
+
+slot_pool& pool()
+{
+    static auto* p = new slot_pool; // outlives every thread's release
+    return *p;
+}
+
+//! Owns the thread's slot and hands it back on thread exit. Anything the
+//! thread logs from later TLS destructors still lands in the old slot;
+//! that can only race with the slot's next owner over a few counts.
+struct slot_holder {
+    unsigned slot{log_metrics::thread_slots};
+    bool acquired{false};
+
+    ~slot_holder()
+    {
+        if (slot < log_metrics::thread_slots) {
+            auto& p = pool();
+            const std::lock_guard<std::mutex> guard{p.mutex};
+            p.free.push_back(slot);
+        }
+    }
+};
+
+thread_local slot_holder t_slot_holder;
+
+std::string format_ns(std::uint64_t ns)
+{
+    if (ns < 10000) {
+        return fmt::format("{}ns", ns);
+    }
+    if (ns < 10000000) {
+        return fmt::format("{:.1f}us", ns / 1e3);
+    }
+    if (ns < 10000000000) {
+        return fmt::format("{:.1f}ms", ns / 1e6);
+    }
+    return fmt::format("{:.1f}s", ns / 1e9);
+}
+
+void append_histogram(std::string& line,
+                      const char* name,
+                      const log_histogram& h)
+{
+    if (!h.count) {
+        return;
+    }
+    line += fmt::format(" {}[p50={} p99={} max={} n={}]",
+                        name,
+                        format_ns(h.percentile(0.5)),
+                        format_ns(h.percentile(0.99)),
+                        format_ns(h.max_ns),
+                        h.count);
+}
+
+} // namespace
+
+namespace dtl {
+
+unsigned acquire_metrics_slot() noexcept
+{
+    auto& h = t_slot_holder;
+    if (!h.acquired) {
+        h.acquired = true;
+        auto& p = pool();
+        const std::lock_guard<std::mutex> guard{p.mutex};
+        if (!p.free.empty()) {
+            h.slot = p.free.back();
+            p.free.pop_back();
+        }
+        else if (p.next < log_metrics::thread_slots) {
+            h.slot = p.next++;
+        }
+    }
+    return h.slot;
+}
+
+} // namespace dtl
+
+std::uint64_t log_histogram::bucket_upper(std::size_t idx) noexcept
+{
+    constexpr std::uint64_t sub = std::uint64_t{1} << sub_bucket_bits;
+    if (idx < sub) {
+        return idx;
+    }
+    const auto e = idx / sub + sub_bucket_bits - 1;
+    const auto width = std::uint64_t{1} << (e - sub_bucket_bits);
+    return ((sub + idx % sub) << (e - sub_bucket_bits)) + width - 1;
+}
+
+std::uint64_t log_histogram::percentile(double q) const noexcept
+{
+    if (!count) {
+        return 0;
+    }
+    const auto rank = static_cast<std::uint64_t>(q * (count - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucket_upper(i), max_ns);
+        }
+    }
+    return max_ns;
+}
+
+void log_histogram::merge(const log_histogram& other) noexcept
+{
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum_ns += other.sum_ns;
+    max_ns = std::max(max_ns, other.max_ns);
+}
+
+std::atomic<unsigned> log_metrics::s_sample_period{16};
+
+log_metrics::log_metrics() noexcept
+{
+    for (auto& p : d_shards_) {
+        p.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+log_metrics::~log_metrics()
+{
+    for (auto& p : d_shards_) {
+        delete p.load(std::memory_order_relaxed);
+    }
+}
+
+log_metrics::shard* log_metrics::make_shard(std::atomic<shard*>& p) noexcept
+{
+    // Value-initialized, so every counter starts at zero.
+    auto* fresh = new (std::nothrow) shard();
+    shard* expected = nullptr;
+    if (fresh && !p.compare_exchange_strong(expected,
+                                            fresh,
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+        delete fresh;
+        return expected;
+    }
+    return fresh;
+}
+
+log_metrics_snapshot log_metrics::snapshot() const
+{
+    log_metrics_snapshot out;
+    std::uint64_t* counters[counter_count] = {
+        &out.logged, &out.filtered, &out.bytes};
+    log_histogram* timers[timer_count] = {&out.call, &out.format, &out.write};
+    for (const auto& p : d_shards_) {
+        const auto* s = p.load(std::memory_order_acquire);
+        if (!s) {
+            continue;
+        }
+        for (unsigned c = 0; c < counter_count; ++c) {
+            *counters[c] += s->counters[c].load(std::memory_order_relaxed);
+        }
+        for (unsigned t = 0; t < timer_count; ++t) {
+            const auto& src = s->timers[t];
+            auto& dst = *timers[t];
+            for (std::size_t i = 0; i < log_histogram::bucket_count; ++i) {
+                dst.counts[i] +=
+                    src.buckets[i].load(std::memory_order_relaxed);
+            }
+            dst.count += src.count.load(std::memory_order_relaxed);
+            dst.sum_ns += src.sum_ns.load(std::memory_order_relaxed);
+            dst.max_ns = std::max(
+                dst.max_ns, src.max_ns.load(std::memory_order_relaxed));
+        }
+    }
+    return out;
+}
+
+log_metrics_report log_registry::metrics()
+{
+    auto& s = instance();
+    std::vector<std::shared_ptr<logger>> loggers;
+    {
+        const std::lock_guard<std::mutex> guard{s.d_logger_mutex_};
+        for (const auto& kv : s.d_loggers_) {
+            loggers.push_back(kv.second);
+        }
+    }
+    std::sort(
+        loggers.begin(), loggers.end(), [](const auto& a, const auto& b) {
+            return a->name() < b->name();
+        });
+
+    log_metrics_report report;
+    std::unordered_map<const log_sink*, std::size_t> sink_index;
+    for (const auto& l : loggers) {
+        std::string name{l->name().data(), l->name().size()};
+        report.loggers.push_back({name, l->d_metrics_.snapshot()});
+        const std::lock_guard<std::mutex> guard{l->d_sinks_mutex_};
+        for (const auto& sink : l->d_sinks_) {
+            const auto ins = sink_index.emplace(sink.get(), sink_index.size());
+            if (ins.second) {
+                auto snap = sink->metrics().snapshot();
+                snap.dropped = sink->dropped_records();
+                report.sinks.push_back({sink, {}, std::move(snap)});
+            }
+            report.sinks[ins.first->second].loggers.push_back(name);
+        }
+    }
+    return report;
+}
+
+std::vector<std::string>
+format_metrics_report(const log_metrics_report& report)
+{
+    std::vector<std::string> lines;
+    for (const auto& l : report.loggers) {
+        const auto& m = l.metrics;
+        if (!m.logged && !m.filtered) {
+            continue;
+        }
+        auto line = fmt::format(
+            "logger {} logged={} filtered={}", l.name, m.logged, m.filtered);
+        append_histogram(line, "call", m.call);
+        lines.push_back(std::move(line));
+    }
+    for (std::size_t i = 0; i < report.sinks.size(); ++i) {
+        const auto& sink = report.sinks[i];
+        const auto& m = sink.metrics;
+        if (!m.logged && !m.filtered && !m.dropped) {
+            continue;
+        }
+        std::string feeds;
+        for (const auto& name : sink.loggers) {
+            feeds += feeds.empty() ? name : "," + name;
+        }
+        auto line = fmt::format(
+            "sink {} ({}) logged={} filtered={} dropped={} bytes={}",
+            i,
+            feeds,
+            m.logged,
+            m.filtered,
+            m.dropped,
+            m.bytes);
+        append_histogram(line, "format", m.format);
+        append_histogram(line, "write", m.write);
+        lines.push_back(std::move(line));
+    }
+    return lines;
+}
+
+struct log_metrics_reporter::impl {
+    std::shared_ptr<log_sink> out;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop{false};
+    std::thread thread;
+
+    void emit()
+    {
+        static constexpr char category[] = "LDGR.METRICS";
+        const auto now = std::chrono::system_clock::now();
+        for (const auto& line : format_metrics_report(log_registry::metrics()))
+        {
+            const log_entry entry{log_severity::info,
+                                  fmtutil::to_view(category),
+                                  fmtutil::to_view(__FILE__),
+                                  0,
+                                  now,
+                                  fmtutil::to_view(line)};
+            out->log(log_entry_util::copy_log_entry(entry));
+        }
+        out->flush();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        while (!cv.wait_for(lock, interval, [this] { return stop; })) {
+            lock.unlock();
+            try {
+                emit();
+            }
+            catch (...) {
+                // A throw here would terminate the host; try again next
+                // interval.
+            }
+            lock.lock();
+        }
+    }
+};
+
+log_metrics_reporter::log_metrics_reporter(std::shared_ptr<log_sink> out,
+                                           std::chrono::milliseconds interval)
+: d_impl_(std::make_unique<impl>())
+{
+    d_impl_->out = std::move(out);
+    d_impl_->interval = interval;
+    auto* raw = d_impl_.get();
+    d_impl_->thread = std::thread([raw] { raw->run(); });
+}
+
+log_metrics_reporter::~log_metrics_reporter()
+{
+    {
+        const std::lock_guard<std::mutex> guard{d_impl_->mutex};
+        d_impl_->stop = true;
+    }
+    d_impl_->cv.notify_one();
+    d_impl_->thread.join();
+    try {
+        d_impl_->emit();
+    }
+    catch (...) {
+        // Nothing sensible to do with a failed final report.
+    }
+}
+
+void log_metrics_reporter::report()
+{
+    d_impl_->emit();
+}
+
+} // namespace ldgr
@@ -2,54 +2,615 @@
 
 #include <ldgr/logsink.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <thread>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace ldgr {
 
-void default_formatter(log_buffer_t& buff,
-                       const log_entry_fmt_cp& ent,
-                       std::time_t& cached_time,
-                       std::string& cached_str)
+namespace {
+
+//! Append the context fields as `k=v k2=v2`.
+void append_context(log_buffer_t& buff, log_context_view ctx)
 {
-    const auto& e = ent.entry;
+    bool first = true;
+    for (const auto field : ctx) {
+        if (!first) {
+            fmtutil::append(buff, ' ');
+        }
+        first = false;
+        fmtutil::append(buff, field.key);
+        fmtutil::append(buff, '=');
+        fmtutil::append(buff, field.value);
+    }
+}
+
+//! Append the thread as `id`, `id:name`, and `@cpu` when captured.
+void append_thread(log_buffer_t& buff, const log_entry_fmt& e)
+{
+    fmtutil::append(buff, e.thread_id);
+    if (e.thread_name.size() != 0) {
+        fmtutil::append(buff, ':');
+        fmtutil::append(buff, e.thread_name);
+    }
+    if (e.cpu >= 0) {
+        fmtutil::append(buff, '@');
+        fmtutil::append(buff, e.cpu);
+    }
+}
 
+//! `YYYY-MM-DD HH:MM:SS`, reusing the text of the previous record when it
+//! falls in the same second.
+void append_seconds(log_buffer_t& buff,
+                    const log_entry_fmt& e,
+                    std::time_t& cached_time,
+                    std::string& cached_str)
+{
     if (e.time != cached_time) {
+        const auto start = buff.size();
         fmtutil::append(buff, e.time_struct);
         cached_time = e.time;
-        cached_str.assign(buff.begin(), buff.end());
+        cached_str.assign(buff.begin() + start, buff.end());
     }
     else {
         fmtutil::append(buff, cached_str);
     }
-    fmtutil::append(buff, '.');
-    fmtutil::append_pad_int<6>(buff, e.microseconds);
+}
+
+//! `%d`: the seconds, `PREC` sub-second digits and `Z` for UTC.
+template <time_precision PREC>
+void append_timestamp(log_buffer_t& buff,
+                      const log_entry_fmt& e,
+                      std::time_t& cached_time,
+                      std::string& cached_str)
+{
+    append_seconds(buff, e, cached_time, cached_str);
+    fmtutil::append_fraction<PREC>(buff, e.nanoseconds);
     if (!e.is_local) {
         fmtutil::append(buff, 'Z');
     }
+}
+
+} // namespace
+
+template <time_precision PREC>
+void default_formatter_at(log_buffer_t& buff,
+                          const log_entry_fmt_cp& ent,
+                          std::time_t& cached_time,
+                          std::string& cached_str)
+{
+    const auto& e = ent.entry;
+
+    append_timestamp<PREC>(buff, e, cached_time, cached_str);
     fmtutil::append(buff, " [");
     fmtutil::append(buff, e.severity);
+    fmtutil::append(buff, "] [");
+    append_thread(buff, e);
     fmtutil::append(buff, "] ");
     fmtutil::append(buff, e.name);
     fmtutil::append(buff, ' ');
-    fmtutil::append(buff, fmtutil::trunc_file(e.file));
+    fmtutil::append(buff, e.short_file());
     fmtutil::append(buff, ':');
     fmtutil::append(buff, e.line);
     fmtutil::append(buff, ' ');
+    const auto ctx = e.context();
+    if (!ctx.empty()) {
+        fmtutil::append(buff, '{');
+        append_context(buff, ctx);
+        fmtutil::append(buff, "} ");
+    }
     fmtutil::append(buff, e.message);
     fmtutil::append_eol(buff);
 }
 
-log_sink::~log_sink() = default;
+void default_formatter(log_buffer_t& buff,
+                       const log_entry_fmt_cp& ent,
+                       std::time_t& cached_time,
+                       std::string& cached_str)
+{
+    default_formatter_at<time_precision::microseconds>(
+        buff, ent, cached_time, cached_str);
+}
+
+namespace {
+
+int syslog_severity(log_severity sev) noexcept
+{
+    switch (sev) {
+        case log_severity::trace:
+        case log_severity::debug: return 7;
+        case log_severity::info: return 6;
+        case log_severity::warn: return 4;
+        case log_severity::error: return 3;
+        case log_severity::fatal: return 2;
+        case log_severity::off: break;
+    }
+    return 5;
+}
+
+//! Append an RFC 5424 header field: printable ASCII only, at most `max`
+//! characters, `-` when empty.
+void append_header_field(log_buffer_t& buff,
+                         fmt::string_view val,
+                         std::size_t max)
+{
+    if (val.size() == 0) {
+        fmtutil::append(buff, '-');
+        return;
+    }
+    const auto n = std::min(val.size(), max);
+    for (std::size_t i = 0; i < n; ++i) {
+        const char ch = val.data()[i];
+        fmtutil::append(buff, (ch > 32 && ch < 127) ? ch : '_');
+    }
+}
+
+const std::string& host_name()
+{
+    static const std::string s_host = [] {
+        char host[256] = {};
+#if !defined(_WIN32)
+        if (::gethostname(host, sizeof(host) - 1) != 0) {
+            host[0] = '\0';
+        }
+#endif
+        return std::string(host);
+    }();
+    return s_host;
+}
+
+fmt::string_view app_name() noexcept
+{
+#if defined(__GLIBC__)
+    return fmt::string_view{program_invocation_short_name};
+#else
+    return fmt::string_view{};
+#endif
+}
+
+long process_id() noexcept
+{
+#if defined(_WIN32)
+    return 0;
+#else
+    return static_cast<long>(::getpid());
+#endif
+}
+
+//! RFC 3339 timestamp with `PREC` sub-second digits; the seconds part is
+//! cached the same way `default_formatter` caches it.
+template <time_precision PREC>
+void append_iso8601(log_buffer_t& buff,
+                    const log_entry_fmt& e,
+                    std::time_t& cached_time,
+                    std::string& cached_str)
+{
+    const auto start = buff.size();
+    append_seconds(buff, e, cached_time, cached_str);
+    buff[start + 10] = 'T';
+    fmtutil::append_fraction<PREC>(buff, e.nanoseconds);
+#if !defined(_WIN32)
+    if (e.is_local) {
+        const long off = e.time_struct.tm_gmtoff / 60;
+        fmtutil::append(buff, off < 0 ? '-' : '+');
+        fmtutil::append_pad_int<2>(buff, std::labs(off) / 60);
+        fmtutil::append(buff, ':');
+        fmtutil::append_pad_int<2>(buff, std::labs(off) % 60);
+    }
+    else
+#endif
+    {
+        fmtutil::append(buff, 'Z');
+    }
+}
+
+//! Append `val` as a quoted JSON string.
+void append_json_string(log_buffer_t& buff, fmt::string_view val)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    fmtutil::append(buff, '"');
+    for (const char ch : val) {
+        switch (ch) {
+            case '"': fmtutil::append(buff, "\\\""); break;
+            case '\\': fmtutil::append(buff, "\\\\"); break;
+            case '\n': fmtutil::append(buff, "\\n"); break;
+            case '\r': fmtutil::append(buff, "\\r"); break;
+            case '\t': fmtutil::append(buff, "\\t"); break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20) {
+                    fmtutil::append(buff, "\\u00");
+                    fmtutil::append(buff, hex[(ch >> 4) & 0xf]);
+                    fmtutil::append(buff, hex[ch & 0xf]);
+                }
+                else {
+                    fmtutil::append(buff, ch);
+                }
+        }
+    }
+    fmtutil::append(buff, '"');
+}
+
+//! Append one journald field, switching to the binary form (name, newline,
+//! little-endian 64-bit length, data) when the value spans lines.
+void append_journal_field(log_buffer_t& buff,
+                          fmt::string_view key,
+                          fmt::string_view val)
+{
+    fmtutil::append(buff, key);
+    if (std::memchr(val.data(), '\n', val.size()) == nullptr) {
+        fmtutil::append(buff, '=');
+    }
+    else {
+        fmtutil::append(buff, '\n');
+        std::uint64_t len = val.size();
+        for (int i = 0; i < 8; ++i, len >>= 8) {
+            fmtutil::append(buff, static_cast<char>(len & 0xff));
+        }
+    }
+    fmtutil::append(buff, val);
+    fmtutil::append(buff, '\n');
+}
+
+} // namespace
 
-struct file_sink final : public log_sink {
+void syslog_formatter(log_buffer_t& buff,
+                      const log_entry_fmt_cp& ent,
+                      std::time_t& cached_time,
+                      std::string& cached_str)
+{
+    const auto& e = ent.entry;
+
+    fmtutil::append(buff, '<');
+    fmtutil::append(buff, 8 + syslog_severity(e.severity));
+    fmtutil::append(buff, ">1 ");
+
+    // RFC 5424 allows at most six fraction digits.
+    append_iso8601<time_precision::microseconds>(
+        buff, e, cached_time, cached_str);
+    fmtutil::append(buff, ' ');
+    append_header_field(buff, fmtutil::to_view(host_name()), 255);
+    fmtutil::append(buff, ' ');
+    append_header_field(buff, app_name(), 48);
+    fmtutil::append(buff, ' ');
+    fmtutil::append(buff, process_id());
+    fmtutil::append(buff, ' ');
+    append_header_field(buff, e.name, 32);
+    fmtutil::append(buff, " - ");
+    fmtutil::append(buff, e.short_file());
+    fmtutil::append(buff, ':');
+    fmtutil::append(buff, e.line);
+    fmtutil::append(buff, ' ');
+    fmtutil::append(buff, e.message);
+}
+
+template <time_precision PREC>
+void json_formatter_at(log_buffer_t& buff,
+                       const log_entry_fmt_cp& ent,
+                       std::time_t& cached_time,
+                       std::string& cached_str)
+{
+    const auto& e = ent.entry;
+
+    fmtutil::append(buff, "{\"time\":\"");
+    append_iso8601<PREC>(buff, e, cached_time, cached_str);
+    fmtutil::append(buff, "\",\"level\":\"");
+    fmtutil::append(buff, fmtutil::to_view(e.severity));
+    fmtutil::append(buff, "\",\"category\":");
+    append_json_string(buff, e.name);
+    fmtutil::append(buff, ",\"file\":");
+    append_json_string(buff, e.short_file());
+    fmtutil::append(buff, ",\"line\":\"");
+    fmtutil::append(buff, e.line);
+    fmtutil::append(buff, '"');
+    fmtutil::append(buff, ",\"message\":");
+    append_json_string(buff, e.message);
+    const auto ctx = e.context();
+    if (!ctx.empty()) {
+        // Nested scopes may repeat a key; the innermost comes last.
+        fmtutil::append(buff, ",\"context\":{");
+        bool first = true;
+        for (const auto field : ctx) {
+            if (!first) {
+                fmtutil::append(buff, ',');
+            }
+            first = false;
+            append_json_string(buff, field.key);
+            fmtutil::append(buff, ':');
+            append_json_string(buff, field.value);
+        }
+        fmtutil::append(buff, '}');
+    }
+    fmtutil::append(buff, '}');
+}
+
+void json_formatter(log_buffer_t& buff,
+                    const log_entry_fmt_cp& ent,
+                    std::time_t& cached_time,
+                    std::string& cached_str)
+{
+    json_formatter_at<time_precision::microseconds>(
+        buff, ent, cached_time, cached_str);
+}
+
+#define LDGR__INSTANTIATE_FORMATTERS(PREC)                                    \
+    template void default_formatter_at<PREC>(                                 \
+        log_buffer_t&, const log_entry_fmt_cp&, std::time_t&, std::string&);  \
+    template void json_formatter_at<PREC>(                                    \
+        log_buffer_t&, const log_entry_fmt_cp&, std::time_t&, std::string&)
+
+LDGR__INSTANTIATE_FORMATTERS(time_precision::seconds);
+LDGR__INSTANTIATE_FORMATTERS(time_precision::milliseconds);
+LDGR__INSTANTIATE_FORMATTERS(time_precision::microseconds);
+LDGR__INSTANTIATE_FORMATTERS(time_precision::nanoseconds);
+
+#undef LDGR__INSTANTIATE_FORMATTERS
+
+void journald_formatter(log_buffer_t& buff,
+                        const log_entry_fmt_cp& ent,
+                        std::time_t&,
+                        std::string&)
+{
+    const auto& e = ent.entry;
+
+    fmtutil::append(buff, "PRIORITY=");
+    fmtutil::append(buff, syslog_severity(e.severity));
+    fmtutil::append(buff, '\n');
+    if (app_name().size() != 0) {
+        append_journal_field(buff, "SYSLOG_IDENTIFIER", app_name());
+    }
+    append_journal_field(buff, "LDGR_CATEGORY", e.name);
+    append_journal_field(buff, "CODE_FILE", e.file);
+    const fmt::format_int line{e.line};
+    append_journal_field(
+        buff, "CODE_LINE", fmt::string_view{line.data(), line.size()});
+    append_journal_field(buff, "MESSAGE", e.message);
+    // Journal field names are upper case letters, digits and underscores.
+    std::string key;
+    for (const auto field : e.context()) {
+        key = "LDGR_CTX_";
+        for (const char ch : field.key) {
+            const auto uch = static_cast<unsigned char>(ch);
+            key += std::isalnum(uch) ? static_cast<char>(std::toupper(uch))
+                                     : '_';
+        }
+        append_journal_field(buff, key, field.value);
+    }
+}
+
+namespace {
+
+//! Parse the optional `{s}`, `{ms}`, `{us}` or `{ns}` that may follow a
+//! timestamp directive at `p`, setting `next` past whatever was consumed.
+//! Anything else leaves the default of microseconds.
+time_precision
+parse_precision(const char* p, const char* end, const char*& next) noexcept
+{
+    next = p;
+    if (p == end || *p != '{') {
+        return time_precision::microseconds;
+    }
+    const char* close = std::find(p + 1, end, '}');
+    if (close == end) {
+        return time_precision::microseconds;
+    }
+    const fmt::string_view unit{p + 1,
+                                static_cast<std::size_t>(close - (p + 1))};
+    time_precision prec;
+    if (unit == fmtutil::to_view("s")) {
+        prec = time_precision::seconds;
+    }
+    else if (unit == fmtutil::to_view("ms")) {
+        prec = time_precision::milliseconds;
+    }
+    else if (unit == fmtutil::to_view("us")) {
+        prec = time_precision::microseconds;
+    }
+    else if (unit == fmtutil::to_view("ns")) {
+        prec = time_precision::nanoseconds;
+    }
+    else {
+        return time_precision::microseconds;
+    }
+    next = close + 1;
+    return prec;
+}
+
+//! `%d` (`directive` `d`) or `%i` timestamp at `PREC`.
+template <time_precision PREC>
+void append_time(log_buffer_t& buff,
+                 char directive,
+                 const log_entry_fmt& e,
+                 std::time_t& cached_time,
+                 std::string& cached_str)
+{
+    if (directive == 'd') {
+        append_timestamp<PREC>(buff, e, cached_time, cached_str);
+    }
+    else {
+        append_iso8601<PREC>(buff, e, cached_time, cached_str);
+    }
+}
+
+} // namespace
+
+void pattern_formatter(log_buffer_t& buff,
+                       const log_entry_fmt_cp& ent,
+                       fmt::string_view pattern,
+                       std::time_t& cached_time,
+                       std::string& cached_str)
+{
+    const auto& e = ent.entry;
+    const char* p = pattern.data();
+    const char* const end = p + pattern.size();
+
+    while (p != end) {
+        const char* pct = std::find(p, end, '%');
+        fmtutil::append(
+            buff, fmt::string_view{p, static_cast<std::size_t>(pct - p)});
+        if (pct == end || pct + 1 == end) {
+            if (pct != end) {
+                fmtutil::append(buff, '%');
+            }
+            break;
+        }
+        switch (pct[1]) {
+            case 'd':
+            case 'i': {
+                const auto prec = parse_precision(pct + 2, end, p);
+                switch (prec) {
+                    case time_precision::seconds:
+                        append_time<time_precision::seconds>(
+                            buff, pct[1], e, cached_time, cached_str);
+                        break;
+                    case time_precision::milliseconds:
+                        append_time<time_precision::milliseconds>(
+                            buff, pct[1], e, cached_time, cached_str);
+                        break;
+                    case time_precision::microseconds:
+                        append_time<time_precision::microseconds>(
+                            buff, pct[1], e, cached_time, cached_str);
+                        break;
+                    case time_precision::nanoseconds:
+                        append_time<time_precision::nanoseconds>(
+                            buff, pct[1], e, cached_time, cached_str);
+                        break;
+                }
+                continue;
+            }
+            case 'l':
+                fmtutil::append(buff, fmtutil::to_view(e.severity));
+                break;
+            case 'c': fmtutil::append(buff, e.name); break;
+            case 'f':
+                fmtutil::append(buff, e.short_file());
+                break;
+            case 'F': fmtutil::append(buff, e.file); break;
+            case 'n': fmtutil::append(buff, e.line); break;
+            case 'm': fmtutil::append(buff, e.message); break;
+            case 't': fmtutil::append(buff, e.thread_id); break;
+            case 'T': fmtutil::append(buff, e.thread_name); break;
+            case 'P': fmtutil::append(buff, e.cpu); break;
+            case 'X':
+                // `%X{key}` is one context field's value, `%X` all of them.
+                if (pct + 2 != end && pct[2] == '{') {
+                    const char* close = std::find(pct + 3, end, '}');
+                    if (close != end) {
+                        const auto key = fmt::string_view{
+                            pct + 3,
+                            static_cast<std::size_t>(close - (pct + 3))};
+                        if (const auto val = e.context().find(key)) {
+                            fmtutil::append(buff, *val);
+                        }
+                        p = close + 1;
+                        continue;
+                    }
+                }
+                append_context(buff, e.context());
+                break;
+            case '%': fmtutil::append(buff, '%'); break;
+            default: fmtutil::append(buff, fmt::string_view{pct, 2}); break;
+        }
+        p = pct + 2;
+    }
+    fmtutil::append_eol(buff);
+}
+
+namespace {
+
+// Sinks are tracked in a fixed table so that crash handlers can reach them
+// without locks or allocation. Sinks beyond the table's capacity simply
+// miss out on emergency flushing. A crash handler tags the slot's low bit
+// while it flushes the sink, and `retire` waits for the tag to clear.
+constexpr std::size_t k_max_live_sinks = 256;
+constexpr std::uintptr_t k_flushing_tag = 1;
+std::atomic<std::uintptr_t> s_live_sinks[k_max_live_sinks];
+
+} // namespace
+
+log_sink::log_sink() noexcept
+{
+    const auto self = reinterpret_cast<std::uintptr_t>(this);
+    for (auto& slot : s_live_sinks) {
+        std::uintptr_t expected = 0;
+        if (slot.compare_exchange_strong(
+                expected, self, std::memory_order_acq_rel)) {
+            break;
+        }
+    }
+}
+
+log_sink::~log_sink()
+{
+    retire();
+}
+
+void log_sink::retire() noexcept
+{
+    const auto self = reinterpret_cast<std::uintptr_t>(this);
+    for (auto& slot : s_live_sinks) {
+        auto expected = self;
+        while (!slot.compare_exchange_weak(
+            expected, 0, std::memory_order_acq_rel)) {
+            if (expected == (self | k_flushing_tag)) {
+                std::this_thread::yield();
+                expected = self;
+            }
+            else if (expected != self) {
+                break; // not this slot
+            }
+        }
+        if (expected == self) {
+            return;
+        }
+    }
+}
+
+void log_sink::set_filter(std::shared_ptr<const log_filter> filter)
+{
+    std::lock_guard<std::mutex> guard{d_formatter_mutex_};
+    const auto* raw = filter.get();
+    if (raw && std::find(d_filters_.begin(), d_filters_.end(), filter) ==
+                   d_filters_.end()) {
+        d_filters_.push_back(std::move(filter));
+    }
+    d_filter_.store(raw, std::memory_order_release);
+}
+
+void log_sink::for_each_live(void (*fn)(log_sink&) noexcept) noexcept
+{
+    for (auto& slot : s_live_sinks) {
+        auto raw = slot.load(std::memory_order_acquire);
+        if (raw == 0 || (raw & k_flushing_tag) != 0 ||
+            !slot.compare_exchange_strong(
+                raw, raw | k_flushing_tag, std::memory_order_acq_rel)) {
+            continue; // empty, retiring, or another handler has it
+        }
+        fn(*reinterpret_cast<log_sink*>(raw));
+        slot.store(raw, std::memory_order_release);
+    }
+}
+
+struct stdio_sink final : public log_sink {
     std::FILE* d_file_{nullptr};
     mutable std::mutex d_write_mutex_{};
 
-    explicit file_sink(std::FILE* f): d_file_(f), d_write_mutex_()
+    explicit stdio_sink(std::FILE* f): d_file_(f), d_write_mutex_()
     {
     }
 
-    ~file_sink()
+    ~stdio_sink()
     {
         if (d_file_ != stdout && d_file_ != stderr) {
             std::fclose(d_file_);
@@ -70,6 +631,42 @@ struct file_sink final : public log_sink {
     }
 };
 
+struct fd_sink final : public log_sink {
+    int d_fd_;
+    mutable std::mutex d_write_mutex_{};
+
+    explicit fd_sink(int fd): d_fd_(fd), d_write_mutex_()
+    {
+    }
+
+    void do_log(const log_buffer_t& buff) override
+    {
+        std::lock_guard<std::mutex> guard{d_write_mutex_};
+        const char* data = buff.data();
+        std::size_t size = buff.size();
+        while (size > 0) {
+#if defined(_WIN32)
+            const auto r =
+                ::_write(d_fd_, data, static_cast<unsigned>(size));
+#else
+            const auto r = ::write(d_fd_, data, size);
+#endif
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return; // nowhere to report it
+            }
+            data += r;
+            size -= static_cast<std::size_t>(r);
+        }
+    }
+
+    void do_flush() override
+    {
+    }
+};
+
 std::shared_ptr<const log_formatter> log_sink::default_fmt()
 {
     static const std::shared_ptr<const log_formatter> s_fmt{
@@ -80,15 +677,30 @@ std::shared_ptr<const log_formatter> log_sink::default_fmt()
 std::shared_ptr<log_sink> log_sink_factory::stdout_sink()
 {
     static std::shared_ptr<log_sink> s_err{
-        std::make_shared<file_sink>(stdout)};
+        std::make_shared<stdio_sink>(stdout)};
     return s_err;
 }
 
 std::shared_ptr<log_sink> log_sink_factory::stderr_sink()
 {
     static std::shared_ptr<log_sink> s_err{
-        std::make_shared<file_sink>(stderr)};
+        std::make_shared<stdio_sink>(stderr)};
     return s_err;
 }
 
+std::shared_ptr<log_sink> log_sink_factory::fd_sink(int fd)
+{
+    return std::make_shared<ldgr::fd_sink>(fd);
+}
+
+std::shared_ptr<log_sink> log_sink_factory::file_sink(const std::string& path)
+{
+    auto* f = std::fopen(path.c_str(), "ab");
+    if (!f) {
+        throw std::system_error(
+            errno, std::generic_category(), "open " + path);
+    }
+    return std::make_shared<stdio_sink>(f);
+}
+
 } // namespace ldgr
@@ -0,0 +1,182 @@
+//! @file logsite.cpp
+
+#include <ldgr/logsite.hpp>
+
+#include <fmt/format.h>
+
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+
+namespace ldgr {
+
+namespace {
+
+//! `*` matches any run of characters and `?` any one; everything else
+//! matches itself. Backtracks only to the most recent `*`.
+bool glob_match(fmt::string_view pattern, fmt::string_view text) noexcept
+{
+    std::size_t p = 0;
+    std::size_t t = 0;
+    constexpr auto no_star = static_cast<std::size_t>(-1);
+    std::size_t star = no_star;
+    std::size_t resume = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() &&
+            (pattern[p] == '?' || pattern[p] == text[t])) {
+            ++p;
+            ++t;
+        }
+        else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = t;
+        }
+        else if (star != no_star) {
+            p = star + 1;
+            t = ++resume;
+        }
+        else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+struct site_rule {
+    std::string glob;
+    std::unique_ptr<std::regex> regex;
+    log_site_mode mode;
+
+    bool matches(fmt::string_view key) const
+    {
+        return regex ? std::regex_search(key.begin(), key.end(), *regex)
+                     : glob_match(fmt::string_view{glob}, key);
+    }
+
+    bool matches(const log_site& site) const
+    {
+        if (matches(site.category)) {
+            return true;
+        }
+        const auto line = fmt::format(":{}", site.line);
+        const auto file = site.short_file();
+        const auto short_key = std::string(file.data(), file.size()) + line;
+        if (matches(fmt::string_view{short_key})) {
+            return true;
+        }
+        if (site.file_base == 0) {
+            return false;
+        }
+        const auto full_key =
+            std::string(site.file.data(), site.file.size()) + line;
+        return matches(fmt::string_view{full_key});
+    }
+};
+
+struct site_registry {
+    std::mutex mutex;
+    std::vector<log_site*> sites;
+    std::vector<site_rule> rules;
+};
+
+site_registry& registry()
+{
+    static auto* r = new site_registry; // sites may log during exit
+    return *r;
+}
+
+//! The mode the rules give `site`; the last matching rule wins.
+log_site_mode mode_for(const site_registry& r, const log_site& site)
+{
+    for (auto it = r.rules.rbegin(); it != r.rules.rend(); ++it) {
+        if (it->matches(site)) {
+            return it->mode;
+        }
+    }
+    return log_site_mode::level;
+}
+
+std::size_t add_rule(site_rule rule)
+{
+    auto& r = registry();
+    const std::lock_guard<std::mutex> guard{r.mutex};
+    std::size_t hits = 0;
+    for (auto* site : r.sites) {
+        if (rule.matches(*site)) {
+            site->mode.store(static_cast<std::uint8_t>(rule.mode),
+                             std::memory_order_relaxed);
+            ++hits;
+        }
+    }
+    r.rules.push_back(std::move(rule));
+    return hits;
+}
+
+} // namespace
+
+namespace dtl {
+
+log_site_mode register_log_site(log_site& site) noexcept
+{
+    auto& r = registry();
+    const std::lock_guard<std::mutex> guard{r.mutex};
+    // Another thread may have registered it while this one waited.
+    if (const auto mode = site.mode.load(std::memory_order_relaxed)) {
+        return static_cast<log_site_mode>(mode);
+    }
+    try {
+        r.sites.push_back(&site);
+        const auto mode = mode_for(r, site);
+        site.mode.store(static_cast<std::uint8_t>(mode),
+                        std::memory_order_relaxed);
+        return mode;
+    }
+    catch (...) {
+        if (!r.sites.empty() && r.sites.back() == &site) {
+            r.sites.pop_back();
+        }
+        return log_site_mode::level;
+    }
+}
+
+} // namespace dtl
+
+std::size_t log_sites::set(fmt::string_view pattern, log_site_mode mode)
+{
+    return add_rule(site_rule{
+        std::string(pattern.data(), pattern.size()), nullptr, mode});
+}
+
+std::size_t log_sites::set_regex(const std::string& regex,
+                                 log_site_mode mode)
+{
+    return add_rule(site_rule{
+        {},
+        std::make_unique<std::regex>(
+            regex, std::regex::ECMAScript | std::regex::optimize),
+        mode});
+}
+
+void log_sites::reset()
+{
+    auto& r = registry();
+    const std::lock_guard<std::mutex> guard{r.mutex};
+    r.rules.clear();
+    for (auto* site : r.sites) {
+        site->mode.store(static_cast<std::uint8_t>(log_site_mode::level),
+                         std::memory_order_relaxed);
+    }
+}
+
+std::vector<const log_site*> log_sites::list()
+{
+    auto& r = registry();
+    const std::lock_guard<std::mutex> guard{r.mutex};
+    return {r.sites.begin(), r.sites.end()};
+}
+
+} // namespace ldgr
@@ -0,0 +1,163 @@
+//! @file logthread.cpp
+
+#include <ldgr/logthread.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#endif
+#endif
+
+#if !defined(_WIN32)
+#include <signal.h>
+#endif
+
+namespace ldgr {
+
+namespace {
+
+void store_name(dtl::thread_info& info, fmt::string_view name) noexcept
+{
+    const auto n = std::min(name.size(), sizeof(info.name));
+    std::memcpy(info.name, name.data(), n);
+    info.name_size = static_cast<std::uint32_t>(n);
+}
+
+#if defined(__linux__)
+//! A forked child keeps the forking thread's cache, which holds the
+//! parent's thread id; look the id up again on the child's next record.
+void reset_after_fork() noexcept
+{
+    dtl::t_thread_info.id = 0;
+}
+
+const int s_atfork_registered =
+    ::pthread_atfork(nullptr, nullptr, &reset_after_fork);
+#endif
+
+#if !defined(_WIN32)
+//! Room for the crash handler to run when the fault is a stack overflow.
+constexpr std::size_t k_crash_stack_size = 64 * 1024;
+
+//! The calling thread's crash stack, taken down at thread exit.
+struct crash_stack {
+    char* data{nullptr};
+
+    ~crash_stack()
+    {
+        if (!data) {
+            return;
+        }
+        stack_t cur{};
+        if (::sigaltstack(nullptr, &cur) == 0 && cur.ss_sp == data) {
+            stack_t off{};
+            off.ss_flags = SS_DISABLE;
+            ::sigaltstack(&off, nullptr);
+        }
+        delete[] data;
+    }
+};
+
+thread_local crash_stack t_crash_stack;
+#endif
+
+} // namespace
+
+namespace dtl {
+
+std::uint32_t init_thread_info() noexcept
+{
+    auto& info = t_thread_info;
+#if defined(__linux__)
+    info.id = static_cast<std::uint32_t>(::syscall(SYS_gettid));
+    char name[16] = {};
+    if (info.name_size == 0 &&
+        ::pthread_getname_np(::pthread_self(), name, sizeof(name)) == 0) {
+        // A thread nobody named still carries the name of the process.
+        const char* process = program_invocation_short_name;
+        if (std::strncmp(name, process, sizeof(name) - 1) != 0) {
+            store_name(info, fmt::string_view{name, std::strlen(name)});
+        }
+    }
+#else
+    static std::atomic<std::uint32_t> s_next{1};
+    info.id = s_next.fetch_add(1, std::memory_order_relaxed);
+#endif
+    if (s_crash_stacks.load(std::memory_order_relaxed)) {
+        install_crash_stack();
+    }
+    return info.id;
+}
+
+void install_crash_stack() noexcept
+{
+#if !defined(_WIN32)
+    auto& cs = t_crash_stack;
+    stack_t cur{};
+    if (cs.data || ::sigaltstack(nullptr, &cur) != 0 ||
+        (cur.ss_flags & SS_DISABLE) == 0) {
+        return; // ours, or one the application set up
+    }
+    cs.data = new (std::nothrow) char[k_crash_stack_size];
+    if (!cs.data) {
+        return;
+    }
+    stack_t ss{};
+    ss.ss_sp = cs.data;
+    ss.ss_size = k_crash_stack_size;
+    if (::sigaltstack(&ss, nullptr) != 0) {
+        delete[] cs.data;
+        cs.data = nullptr;
+    }
+#endif
+}
+
+int current_cpu() noexcept
+{
+#if defined(__linux__)
+#if defined(RSEQ_SIG) && defined(__GNUC__) && !defined(__clang__) &&       \
+    (defined(__x86_64__) || defined(__aarch64__))
+    // glibc registers rseq for every thread; the kernel keeps the current
+    // CPU in it, so reading it is a plain load.
+    if (__rseq_size) {
+        const auto* rs = reinterpret_cast<const volatile struct rseq*>(
+            static_cast<char*>(__builtin_thread_pointer()) + __rseq_offset);
+        const auto cpu = static_cast<int>(rs->cpu_id);
+        if (cpu >= 0) {
+            return cpu;
+        }
+    }
+#endif
+    return ::sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+} // namespace dtl
+
+void log_thread::set_name(fmt::string_view name) noexcept
+{
+    auto& info = dtl::t_thread_info;
+    if (!info.id) {
+        dtl::init_thread_info();
+    }
+    store_name(info, name);
+#if defined(__linux__)
+    char os_name[16] = {};
+    std::memcpy(
+        os_name, name.data(), std::min(name.size(), sizeof(os_name) - 1));
+    ::pthread_setname_np(::pthread_self(), os_name);
+#endif
+}
+
+} // namespace ldgr
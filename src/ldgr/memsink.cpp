@@ -0,0 +1,153 @@
+//! @file memsink.cpp
+
+#include <ldgr/memsink.hpp>
+
+#include <algorithm>
+
+namespace ldgr {
+
+namespace {
+
+void skip_formatting(log_buffer_t&,
+                     const log_entry_fmt_cp&,
+                     std::time_t&,
+                     std::string&)
+{
+}
+
+std::shared_ptr<const log_formatter> no_format()
+{
+    static const auto s_fmt =
+        std::make_shared<log_formatter>(&skip_formatting);
+    return s_fmt;
+}
+
+} // namespace
+
+null_sink::null_sink(bool format)
+{
+    if (!format) {
+        set_formatter(no_format());
+    }
+}
+
+void null_sink::do_log(const log_buffer_t&)
+{
+}
+
+void null_sink::do_flush()
+{
+}
+
+capture_sink::capture_sink(std::size_t capacity)
+: d_ring_(std::max<std::size_t>(capacity, 1))
+{
+}
+
+void capture_sink::do_log(const log_buffer_t& buff)
+{
+    const std::lock_guard<std::mutex> guard{d_mutex_};
+    // Reuses the slot's storage once the ring has wrapped.
+    d_ring_[d_total_ % d_ring_.size()].assign(buff.data(), buff.size());
+    ++d_total_;
+}
+
+void capture_sink::do_flush()
+{
+}
+
+std::uint64_t capture_sink::total() const noexcept
+{
+    const std::lock_guard<std::mutex> guard{d_mutex_};
+    return d_total_;
+}
+
+std::vector<std::string> capture_sink::records() const
+{
+    const std::lock_guard<std::mutex> guard{d_mutex_};
+    const auto n = std::min<std::uint64_t>(d_total_, d_ring_.size());
+    std::vector<std::string> out;
+    out.reserve(static_cast<std::size_t>(n));
+    for (auto seq = d_total_ - n; seq < d_total_; ++seq) {
+        out.push_back(d_ring_[seq % d_ring_.size()]);
+    }
+    return out;
+}
+
+void capture_sink::dump(std::FILE* out) const
+{
+    for (const auto& rec : records()) {
+        std::fwrite(rec.data(), 1, rec.size(), out);
+    }
+    std::fflush(out);
+}
+
+void capture_sink::clear() noexcept
+{
+    const std::lock_guard<std::mutex> guard{d_mutex_};
+    d_total_ = 0;
+}
+
+counting_sink::counting_sink(bool format)
+{
+    if (!format) {
+        set_formatter(no_format());
+    }
+}
+
+void counting_sink::do_log(const log_buffer_t& buff)
+{
+    const auto slot = dtl::metrics_thread_slot();
+    auto& c = d_cells_[slot];
+    if (slot < log_metrics::thread_slots) {
+        // Only this thread writes the cell.
+        c.records.store(c.records.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+        c.bytes.store(c.bytes.load(std::memory_order_relaxed) + buff.size(),
+                      std::memory_order_relaxed);
+    }
+    else {
+        c.records.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add(buff.size(), std::memory_order_relaxed);
+    }
+}
+
+void counting_sink::do_flush()
+{
+}
+
+std::uint64_t counting_sink::records() const noexcept
+{
+    std::uint64_t total = 0;
+    for (const auto& c : d_cells_) {
+        total += c.records.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::uint64_t counting_sink::bytes() const noexcept
+{
+    std::uint64_t total = 0;
+    for (const auto& c : d_cells_) {
+        total += c.bytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::shared_ptr<log_sink> log_sink_factory::null_sink(bool format)
+{
+    return std::make_shared<ldgr::null_sink>(format);
+}
+
+std::shared_ptr<capture_sink>
+log_sink_factory::capture_sink(std::size_t capacity)
+{
+    return std::make_shared<ldgr::capture_sink>(capacity);
+}
+
+std::shared_ptr<counting_sink> log_sink_factory::counting_sink(bool format)
+{
+    return std::make_shared<ldgr::counting_sink>(format);
+}
+
+} // namespace ldgr
@@ -0,0 +1,631 @@
+//! @file netsink.cpp
+
+#include <ldgr/netsink.hpp>
+
+#include "sinkutil.hpp"
+
+#include <cerrno>
+#include <system_error>
+
+#if defined(LDGR_HAVE_LIBUV) && !defined(_WIN32)
+#define LDGR_NETSINK_ENABLED 1
+#endif
+
+#if defined(LDGR_NETSINK_ENABLED)
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <uv.h>
+#endif
+
+namespace ldgr {
+
+#if defined(LDGR_NETSINK_ENABLED)
+
+namespace {
+
+//! One connection attempt. Heap-allocated because libuv needs the handle to
+//! outlive `uv_close` until its close callback runs.
+struct connection {
+    union {
+        uv_handle_t handle;
+        uv_stream_t stream;
+        uv_tcp_t tcp;
+        uv_pipe_t pipe;
+    } h;
+    uv_connect_t connect_req;
+    uv_write_t write_req;
+    void* owner;
+    bool up;
+};
+
+constexpr std::size_t k_replay_chunk = 64 * 1024;
+
+} // namespace
+
+struct net_sink::impl {
+    net_sink_config config;
+    bool is_tcp{false};
+    sockaddr_storage addr{};
+    std::string path;
+
+    // Shared with producers, guarded by `mutex`.
+    mutable dtl::sink_mutex mutex;
+    std::condition_variable_any idle_cv;
+    std::string spool;
+    std::size_t spool_records{0};
+    bool stop_requested{false};
+    bool idle{true};
+    net_sink_stats stats{};
+
+    // Owned by the event-loop thread.
+    uv_loop_t loop;
+    uv_async_t wake;
+    uv_timer_t timer;
+    connection* conn{nullptr};
+    std::string inflight;
+    std::size_t inflight_records{0};
+    bool inflight_from_spill{false};
+    std::string spill_buf;
+    std::chrono::milliseconds backoff;
+    int spill_fd{-1};
+    std::uint64_t spill_read{0};
+    std::uint64_t spill_size{0};
+    bool stopping{false};
+    bool closing{false};
+
+    std::thread thread;
+
+    explicit impl(const net_sink_config& cfg)
+    : config(cfg)
+    , backoff(cfg.backoff_min)
+    {
+    }
+
+    ~impl()
+    {
+        if (spill_fd >= 0) {
+            ::close(spill_fd);
+        }
+    }
+
+    void open_spill()
+    {
+        if (config.spill_path.empty()) {
+            return;
+        }
+        spill_fd = ::open(
+            config.spill_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        struct stat st{};
+        if (spill_fd < 0 || ::fstat(spill_fd, &st) != 0) {
+            throw std::system_error(
+                errno, std::generic_category(), "open " + config.spill_path);
+        }
+        spill_size = static_cast<std::uint64_t>(st.st_size);
+    }
+
+    void start()
+    {
+        uv_loop_init(&loop);
+        uv_async_init(&loop, &wake, &impl::on_wake);
+        wake.data = this;
+        uv_timer_init(&loop, &timer);
+        timer.data = this;
+        thread = std::thread([this] {
+            connect();
+            uv_run(&loop, UV_RUN_DEFAULT);
+            uv_loop_close(&loop);
+        });
+    }
+
+    // ----- producer side -----
+
+    void enqueue(const char* data, std::size_t size)
+    {
+        const bool json = config.framing == net_framing::json_lines;
+        if (json && size > 0 && data[size - 1] == '\n') {
+            --size;
+        }
+        const auto framed = size + (json ? 1 : 4);
+        {
+            std::lock_guard<dtl::sink_mutex> guard{mutex};
+            if (spool.size() + framed > config.spool_bytes) {
+                ++stats.dropped;
+                return;
+            }
+            if (!json) {
+                const auto len = static_cast<std::uint32_t>(size);
+                const char prefix[4] = {static_cast<char>(len >> 24),
+                                        static_cast<char>(len >> 16),
+                                        static_cast<char>(len >> 8),
+                                        static_cast<char>(len)};
+                spool.append(prefix, sizeof(prefix));
+            }
+            spool.append(data, size);
+            if (json) {
+                spool.push_back('\n');
+            }
+            ++spool_records;
+            ++stats.enqueued;
+            stats.spool_bytes = spool.size();
+            stats.spool_peak = std::max(stats.spool_peak, spool.size());
+            idle = false;
+        }
+        uv_async_send(&wake);
+    }
+
+    // ----- event-loop side -----
+
+    static void on_wake(uv_async_t* h)
+    {
+        auto* self = static_cast<impl*>(h->data);
+        bool stop = false;
+        {
+            std::lock_guard<dtl::sink_mutex> guard{self->mutex};
+            stop = self->stop_requested;
+        }
+        if (stop && !self->stopping) {
+            self->begin_stop();
+        }
+        else if (self->conn && self->conn->up) {
+            self->pump();
+        }
+        else if (!self->stopping) {
+            self->spill_spool();
+        }
+    }
+
+    static void on_timer(uv_timer_t* h)
+    {
+        auto* self = static_cast<impl*>(h->data);
+        if (self->stopping) {
+            self->finish();
+        }
+        else {
+            self->connect();
+        }
+    }
+
+    static void on_connect(uv_connect_t* req, int status)
+    {
+        auto* c = static_cast<connection*>(req->data);
+        auto* self = static_cast<impl*>(c->owner);
+        if (self->conn != c) {
+            return; // cancelled by drop_connection
+        }
+        if (status < 0) {
+            self->connect_failed();
+            return;
+        }
+        c->up = true;
+        self->backoff = self->config.backoff_min;
+        {
+            std::lock_guard<dtl::sink_mutex> guard{self->mutex};
+            ++self->stats.connects;
+            self->stats.connected = true;
+        }
+        self->pump();
+    }
+
+    static void on_write(uv_write_t* req, int status)
+    {
+        auto* c = static_cast<connection*>(req->data);
+        auto* self = static_cast<impl*>(c->owner);
+        if (self->conn != c) {
+            return; // the batch was already put back by drop_connection
+        }
+        if (status < 0) {
+            self->connect_failed();
+            return;
+        }
+        const auto n = self->inflight.size();
+        {
+            std::lock_guard<dtl::sink_mutex> guard{self->mutex};
+            self->stats.bytes_sent += n;
+            if (self->inflight_from_spill) {
+                self->stats.bytes_replayed += n;
+            }
+        }
+        if (self->inflight_from_spill) {
+            self->spill_read += n;
+            if (self->spill_read >= self->spill_size) {
+                self->reset_spill();
+            }
+        }
+        self->inflight.clear();
+        self->inflight_records = 0;
+        self->pump();
+    }
+
+    void connect()
+    {
+        auto* c = new connection{};
+        c->owner = this;
+        c->connect_req.data = c;
+        int rc = 0;
+        if (is_tcp) {
+            rc = uv_tcp_init(&loop, &c->h.tcp);
+            if (rc == 0) {
+                c->h.handle.data = c;
+                uv_tcp_nodelay(&c->h.tcp, 1);
+                rc = uv_tcp_connect(&c->connect_req,
+                                    &c->h.tcp,
+                                    reinterpret_cast<const sockaddr*>(&addr),
+                                    &impl::on_connect);
+            }
+        }
+        else {
+            rc = uv_pipe_init(&loop, &c->h.pipe, 0);
+            if (rc == 0) {
+                c->h.handle.data = c;
+                uv_pipe_connect(&c->connect_req,
+                                &c->h.pipe,
+                                path.c_str(),
+                                &impl::on_connect);
+            }
+        }
+        if (c->h.handle.data != c) {
+            delete c; // the handle was never initialised
+            schedule_reconnect();
+            return;
+        }
+        conn = c;
+        if (rc != 0) {
+            connect_failed();
+        }
+    }
+
+    void connect_failed()
+    {
+        {
+            std::lock_guard<dtl::sink_mutex> guard{mutex};
+            ++stats.connect_failures;
+        }
+        drop_connection();
+        schedule_reconnect();
+    }
+
+    //! Close the current connection, putting an unacknowledged batch back
+    //! at the head of the spool (or leaving it in the spill file).
+    void drop_connection()
+    {
+        if (!conn) {
+            return;
+        }
+        auto* c = conn;
+        conn = nullptr;
+        {
+            std::lock_guard<dtl::sink_mutex> guard{mutex};
+            if (!inflight.empty() && !inflight_from_spill) {
+                spool.insert(0, inflight);
+                spool_records += inflight_records;
+                stats.spool_bytes = spool.size();
+            }
+            stats.connected = false;
+            idle_cv.notify_all();
+        }
+        inflight.clear();
+        inflight_records = 0;
+        uv_close(&c->h.handle, [](uv_handle_t* h) {
+            delete static_cast<connection*>(h->data);
+        });
+    }
+
+    void schedule_reconnect()
+    {
+        if (stopping) {
+            finish();
+            return;
+        }
+        spill_spool();
+        uv_timer_start(&timer,
+                       &impl::on_timer,
+                       static_cast<std::uint64_t>(backoff.count()),
+                       0);
+        backoff = std::min(backoff * 2, config.backoff_max);
+    }
+
+    //! Write the next batch: left-over spilled bytes first, then the spool.
+    void pump()
+    {
+        if (!conn || !conn->up || !inflight.empty() || closing) {
+            return;
+        }
+        if (spill_read < spill_size) {
+            const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(
+                k_replay_chunk, spill_size - spill_read));
+            inflight.resize(n);
+            const auto r = ::pread(spill_fd,
+                                   &inflight[0],
+                                   n,
+                                   static_cast<off_t>(spill_read));
+            if (r > 0) {
+                inflight.resize(static_cast<std::size_t>(r));
+                inflight_from_spill = true;
+            }
+            else {
+                // Unreadable spill file: give up on it rather than stall.
+                inflight.clear();
+                reset_spill();
+            }
+        }
+        if (inflight.empty()) {
+            std::lock_guard<dtl::sink_mutex> guard{mutex};
+            inflight.swap(spool);
+            inflight_records = spool_records;
+            inflight_from_spill = false;
+            spool_records = 0;
+            stats.spool_bytes = 0;
+            if (inflight.empty()) {
+                idle = true;
+                idle_cv.notify_all();
+            }
+        }
+        if (inflight.empty()) {
+            if (stopping) {
+                finish();
+            }
+            return;
+        }
+
+        auto buf = uv_buf_init(&inflight[0],
+                               static_cast<unsigned>(inflight.size()));
+        conn->write_req.data = conn;
+        if (uv_write(&conn->write_req, &conn->h.stream, &buf, 1, on_write) <
+            0) {
+            connect_failed();
+        }
+    }
+
+    //! While the peer is down, move the spool to the spill file.
+    void spill_spool()
+    {
+        if (spill_fd < 0) {
+            return;
+        }
+        std::size_t records = 0;
+        {
+            std::lock_guard<dtl::sink_mutex> guard{mutex};
+            spill_buf.swap(spool);
+            records = spool_records;
+            spool_records = 0;
+            stats.spool_bytes = 0;
+        }
+        if (spill_buf.empty()) {
+            return;
+        }
+
+        const bool ok =
+            spill_size + spill_buf.size() <= config.spill_bytes &&
+            dtl::pwrite_all(
+                spill_fd, spill_buf.data(), spill_buf.size(), spill_size);
+        {
+            std::lock_guard<dtl::sink_mutex> guard{mutex};
+            if (ok) {
+                stats.bytes_spilled += spill_buf.size();
+            }
+            else {
+                stats.dropped += records;
+            }
+        }
+        if (ok) {
+            spill_size += spill_buf.size();
+        }
+        else if (::ftruncate(spill_fd, static_cast<off_t>(spill_size)) !=
+                 0) {
+            // Nothing more to do; the next replay stops at `spill_size`.
+        }
+        spill_buf.clear();
+    }
+
+    void reset_spill()
+    {
+        if (::ftruncate(spill_fd, 0) == 0) {
+            spill_read = 0;
+            spill_size = 0;
+        }
+        else {
+            spill_read = spill_size;
+        }
+    }
+
+    void begin_stop()
+    {
+        stopping = true;
+        uv_timer_stop(&timer);
+        if (conn && conn->up) {
+            uv_timer_start(
+                &timer,
+                &impl::on_timer,
+                static_cast<std::uint64_t>(config.shutdown_timeout.count()),
+                0);
+            pump();
+        }
+        else {
+            finish();
+        }
+    }
+
+    //! Last step on the loop thread: keep what can be kept, close handles.
+    void finish()
+    {
+        if (closing) {
+            return;
+        }
+        closing = true;
+        drop_connection();
+        spill_spool();
+        {
+            std::lock_guard<dtl::sink_mutex> guard{mutex};
+            stats.dropped += spool_records;
+            spool.clear();
+            spool_records = 0;
+            stats.spool_bytes = 0;
+            idle = true;
+            idle_cv.notify_all();
+        }
+        uv_timer_stop(&timer);
+        uv_close(reinterpret_cast<uv_handle_t*>(&timer), nullptr);
+        uv_close(reinterpret_cast<uv_handle_t*>(&wake), nullptr);
+    }
+};
+
+net_sink::net_sink(std::unique_ptr<impl> impl) noexcept
+: d_impl_(std::move(impl))
+{
+}
+
+std::shared_ptr<net_sink> net_sink::tcp(const std::string& host,
+                                        unsigned short port,
+                                        const net_sink_config& config)
+{
+    auto im = std::make_unique<impl>(config);
+    im->is_tcp = true;
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    const int rc = ::getaddrinfo(
+        host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (rc != 0 || !res) {
+        throw std::system_error(EHOSTUNREACH,
+                                std::generic_category(),
+                                "resolve " + host + ": " + gai_strerror(rc));
+    }
+    std::memcpy(&im->addr, res->ai_addr, res->ai_addrlen);
+    ::freeaddrinfo(res);
+
+    im->open_spill();
+    im->start();
+    std::shared_ptr<net_sink> sink{new net_sink(std::move(im))};
+    if (config.framing == net_framing::json_lines) {
+        sink->set_formatter(std::make_shared<log_formatter>(&json_formatter));
+    }
+    return sink;
+}
+
+std::shared_ptr<net_sink> net_sink::unix_socket(const std::string& path,
+                                                const net_sink_config& config)
+{
+    auto im = std::make_unique<impl>(config);
+    im->path = path;
+    im->open_spill();
+    im->start();
+    std::shared_ptr<net_sink> sink{new net_sink(std::move(im))};
+    if (config.framing == net_framing::json_lines) {
+        sink->set_formatter(std::make_shared<log_formatter>(&json_formatter));
+    }
+    return sink;
+}
+
+net_sink::~net_sink()
+{
+    retire();
+    {
+        std::lock_guard<dtl::sink_mutex> guard{d_impl_->mutex};
+        d_impl_->stop_requested = true;
+    }
+    uv_async_send(&d_impl_->wake);
+    d_impl_->thread.join();
+}
+
+void net_sink::do_log(const log_buffer_t& buff)
+{
+    d_impl_->enqueue(buff.data(), buff.size());
+}
+
+void net_sink::do_flush()
+{
+    auto& im = *d_impl_;
+    uv_async_send(&im.wake);
+    std::unique_lock<dtl::sink_mutex> lock{im.mutex};
+    im.idle_cv.wait_for(lock, im.config.flush_timeout, [&im] {
+        return im.idle || !im.stats.connected;
+    });
+}
+
+void net_sink::do_emergency_flush() noexcept
+{
+    // Append the spool to the spill file, where the next run replays it
+    // from. Sockets are left alone: the loop thread may be part-way
+    // through a write, and interleaving would corrupt the stream.
+    auto& im = *d_impl_;
+    if (im.spill_fd < 0 || !im.mutex.try_lock_from_crash()) {
+        return;
+    }
+    struct stat st{};
+    if (::fstat(im.spill_fd, &st) == 0) {
+        dtl::pwrite_all(im.spill_fd,
+                        im.spool.data(),
+                        im.spool.size(),
+                        static_cast<std::uint64_t>(st.st_size));
+    }
+    im.mutex.unlock();
+}
+
+net_sink_stats net_sink::stats() const noexcept
+{
+    std::lock_guard<dtl::sink_mutex> guard{d_impl_->mutex};
+    return d_impl_->stats;
+}
+
+#else
+
+struct net_sink::impl {
+};
+
+net_sink::net_sink(std::unique_ptr<impl> impl) noexcept
+: d_impl_(std::move(impl))
+{
+}
+
+std::shared_ptr<net_sink> net_sink::tcp(const std::string& host,
+                                        unsigned short,
+                                        const net_sink_config&)
+{
+    throw std::system_error(
+        ENOSYS, std::generic_category(), "ldgr built without libuv: " + host);
+}
+
+std::shared_ptr<net_sink> net_sink::unix_socket(const std::string& path,
+                                                const net_sink_config&)
+{
+    throw std::system_error(
+        ENOSYS, std::generic_category(), "ldgr built without libuv: " + path);
+}
+
+net_sink::~net_sink()
+{
+}
+
+void net_sink::do_log(const log_buffer_t&)
+{
+}
+
+void net_sink::do_flush()
+{
+}
+
+void net_sink::do_emergency_flush() noexcept
+{
+}
+
+net_sink_stats net_sink::stats() const noexcept
+{
+    return net_sink_stats{};
+}
+
+#endif
+
+} // namespace ldgr
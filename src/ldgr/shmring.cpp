@@ -0,0 +1,279 @@
+//! @file shmring.cpp
+
+#include <ldgr/shmring.hpp>
+
+#include <ldgr/logsink.hpp>
+
+#include "sinkutil.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ldgr {
+
+namespace {
+
+constexpr std::size_t k_header_bytes =
+    (sizeof(shm_ring_layout::header) + 63) & ~std::size_t{63};
+
+unsigned char* payload(const shm_ring_layout::slot& sl) noexcept
+{
+    return const_cast<unsigned char*>(
+               reinterpret_cast<const unsigned char*>(&sl)) +
+           sizeof(shm_ring_layout::slot);
+}
+
+[[noreturn]] void throw_errno(int err, const std::string& what)
+{
+    throw std::system_error(err, std::generic_category(), what);
+}
+
+} // namespace
+
+shm_ring::shm_ring(std::string name, void* base, std::size_t map_size) noexcept
+: d_name_(std::move(name))
+, d_base_(base)
+, d_map_size_(map_size)
+, d_header_(static_cast<shm_ring_layout::header*>(base))
+, d_slots_(static_cast<unsigned char*>(base) + k_header_bytes)
+, d_mask_(d_header_->slot_count - 1)
+{
+}
+
+#if !defined(_WIN32)
+
+std::unique_ptr<shm_ring> shm_ring::open(const std::string& name,
+                                         std::size_t slot_count,
+                                         std::size_t slot_size)
+{
+    const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        if (errno == EEXIST) {
+            return attach(name);
+        }
+        throw_errno(errno, "shm_open " + name);
+    }
+
+    slot_count = dtl::round_up_pow2(std::max<std::size_t>(slot_count, 2));
+    slot_size = std::max(slot_size, sizeof(shm_ring_layout::slot) + 16);
+    slot_size = (slot_size + 63) & ~std::size_t{63};
+    const auto map_size = k_header_bytes + slot_count * slot_size;
+
+    if (::ftruncate(fd, static_cast<off_t>(map_size)) != 0) {
+        const int err = errno;
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw_errno(err, "ftruncate " + name);
+    }
+    void* base =
+        ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int err = errno;
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        throw_errno(err, "mmap " + name);
+    }
+
+    // The segment is zero-filled, so every slot starts out "never written".
+    auto* h = static_cast<shm_ring_layout::header*>(base);
+    h->magic = shm_ring_layout::magic;
+    h->version = shm_ring_layout::version;
+    h->slot_size = static_cast<std::uint32_t>(slot_size);
+    h->slot_count = slot_count;
+    h->write_seq.store(0, std::memory_order_relaxed);
+    h->ready.store(1, std::memory_order_release);
+    return std::unique_ptr<shm_ring>(new shm_ring(name, base, map_size));
+}
+
+std::unique_ptr<shm_ring> shm_ring::attach(const std::string& name)
+{
+    const int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        throw_errno(errno, "shm_open " + name);
+    }
+
+    // The creator may still be sizing and initialising the segment.
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    struct stat st{};
+    while (true) {
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            throw_errno(err, "fstat " + name);
+        }
+        if (static_cast<std::size_t>(st.st_size) >= k_header_bytes) {
+            break;
+        }
+        if (std::chrono::steady_clock::now() > deadline) {
+            ::close(fd);
+            throw_errno(ETIMEDOUT, "shm_ring not initialised: " + name);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    const auto map_size = static_cast<std::size_t>(st.st_size);
+    void* base =
+        ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int err = errno;
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        throw_errno(err, "mmap " + name);
+    }
+
+    auto* h = static_cast<shm_ring_layout::header*>(base);
+    while (!h->ready.load(std::memory_order_acquire)) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            ::munmap(base, map_size);
+            throw_errno(ETIMEDOUT, "shm_ring not initialised: " + name);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (h->magic != shm_ring_layout::magic ||
+        h->version != shm_ring_layout::version ||
+        k_header_bytes + h->slot_count * h->slot_size > map_size) {
+        ::munmap(base, map_size);
+        throw_errno(EINVAL, "not an ldgr shm_ring: " + name);
+    }
+    return std::unique_ptr<shm_ring>(new shm_ring(name, base, map_size));
+}
+
+void shm_ring::unlink(const std::string& name) noexcept
+{
+    ::shm_unlink(name.c_str());
+}
+
+shm_ring::~shm_ring() noexcept
+{
+    ::munmap(d_base_, d_map_size_);
+}
+
+#else
+
+std::unique_ptr<shm_ring>
+shm_ring::open(const std::string& name, std::size_t, std::size_t)
+{
+    throw_errno(ENOSYS, "shm_ring unsupported: " + name);
+}
+
+std::unique_ptr<shm_ring> shm_ring::attach(const std::string& name)
+{
+    throw_errno(ENOSYS, "shm_ring unsupported: " + name);
+}
+
+void shm_ring::unlink(const std::string&) noexcept
+{
+}
+
+shm_ring::~shm_ring() noexcept
+{
+}
+
+#endif
+
+void shm_ring::write(const char* data, std::size_t size) noexcept
+{
+    const auto seq =
+        d_header_->write_seq.fetch_add(1, std::memory_order_relaxed);
+    auto& sl = slot_at(seq);
+    const auto busy = 2 * seq + 1;
+
+    auto cur = sl.state.load(std::memory_order_relaxed);
+    do {
+        if (cur >= busy) {
+            // A writer a whole lap ahead already owns the slot.
+            return;
+        }
+    } while (!sl.state.compare_exchange_weak(
+        cur, busy, std::memory_order_relaxed, std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const auto max = max_record_size();
+    sl.flags = size > max ? shm_ring_layout::truncated : 0u;
+    size = std::min(size, max);
+    sl.size = static_cast<std::uint32_t>(size);
+    std::memcpy(payload(sl), data, size);
+
+    auto expected = busy;
+    sl.state.compare_exchange_strong(expected,
+                                     busy + 1,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed);
+}
+
+shm_ring::read_status shm_ring::read(std::uint64_t& seq,
+                                     char* out,
+                                     std::size_t& size,
+                                     std::uint32_t& flags,
+                                     std::uint64_t& lost_count) const noexcept
+{
+    const auto& sl = slot_at(seq);
+    const auto committed = 2 * seq + 2;
+    const auto st = sl.state.load(std::memory_order_acquire);
+    if (st < committed) {
+        return read_status::empty;
+    }
+    if (st == committed) {
+        size = std::min<std::size_t>(sl.size, max_record_size());
+        flags = sl.flags;
+        std::memcpy(out, payload(sl), size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sl.state.load(std::memory_order_relaxed) == committed) {
+            ++seq;
+            return read_status::ok;
+        }
+    }
+
+    // The writers lapped us; resume at the oldest record still present.
+    const auto ws = write_seq();
+    const auto count = d_header_->slot_count;
+    const auto oldest = ws > count ? ws - count : 0;
+    const auto next = std::max(seq + 1, oldest);
+    lost_count = next - seq;
+    seq = next;
+    return read_status::lost;
+}
+
+namespace {
+
+struct shm_ring_sink final : public log_sink {
+    std::unique_ptr<shm_ring> d_ring_;
+
+    explicit shm_ring_sink(std::unique_ptr<shm_ring> ring)
+    : d_ring_(std::move(ring))
+    {
+    }
+
+    void do_log(const log_buffer_t& buff) override
+    {
+        d_ring_->write(buff.data(), buff.size());
+    }
+
+    void do_flush() override
+    {
+        // Records are in shared memory as soon as they are written.
+    }
+};
+
+} // namespace
+
+std::shared_ptr<log_sink> log_sink_factory::shm_sink(const std::string& name,
+                                                     std::size_t slot_count,
+                                                     std::size_t slot_size)
+{
+    return std::make_shared<shm_ring_sink>(
+        shm_ring::open(name, slot_count, slot_size));
+}
+
+} // namespace ldgr
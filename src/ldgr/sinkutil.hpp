@@ -0,0 +1,57 @@
+//! @file sinkutil.hpp
+//! @brief Helpers shared by the sink implementations; not installed.
+
+#ifndef INCLUDED_LDGR_SINKUTIL_HPP
+#define INCLUDED_LDGR_SINKUTIL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(_WIN32)
+#include <cerrno>
+
+#include <unistd.h>
+#endif
+
+namespace ldgr {
+namespace dtl {
+
+//! Smallest power of two that is at least `v` (and at least 1).
+inline std::size_t round_up_pow2(std::size_t v) noexcept
+{
+    std::size_t p = 1;
+    while (p < v) {
+        p <<= 1;
+    }
+    return p;
+}
+
+#if !defined(_WIN32)
+
+//! Write all of `data` at `offset`; false on error.
+inline bool pwrite_all(int fd,
+                       const char* data,
+                       std::size_t size,
+                       std::uint64_t offset) noexcept
+{
+    while (size > 0) {
+        const auto r = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += r;
+        size -= static_cast<std::size_t>(r);
+        offset += static_cast<std::uint64_t>(r);
+    }
+    return true;
+}
+
+#endif
+
+} // namespace dtl
+} // namespace ldgr
+
+#endif /*INCLUDED_LDGR_SINKUTIL_HPP*/
@@ -0,0 +1,622 @@
+//! @file uringsink.cpp
+
+#include <ldgr/uringsink.hpp>
+
+#include "sinkutil.hpp"
+
+#include <cerrno>
+#include <system_error>
+
+#if defined(__linux__)
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace ldgr {
+
+#if defined(__linux__)
+
+namespace {
+
+//! Just enough of io_uring for one submitter thread, over the raw syscalls.
+class uring {
+    int d_fd_{-1};
+    void* d_sq_ptr_{MAP_FAILED};
+    std::size_t d_sq_size_{0};
+    void* d_cq_ptr_{MAP_FAILED};
+    std::size_t d_cq_size_{0};
+    io_uring_sqe* d_sqes_{nullptr};
+    std::size_t d_sqes_size_{0};
+
+    unsigned* d_sq_head_{nullptr};
+    unsigned* d_sq_tail_{nullptr};
+    unsigned* d_sq_array_{nullptr};
+    unsigned d_sq_mask_{0};
+    unsigned d_sq_entries_{0};
+    unsigned* d_cq_head_{nullptr};
+    unsigned* d_cq_tail_{nullptr};
+    io_uring_cqe* d_cqes_{nullptr};
+    unsigned d_cq_mask_{0};
+
+    unsigned d_prepared_{0};  //!< SQEs queued since the last tail update
+    unsigned d_to_submit_{0}; //!< SQEs published but not yet consumed
+
+  public:
+    uring() = default;
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+    ~uring()
+    {
+        if (d_sqes_) {
+            ::munmap(d_sqes_, d_sqes_size_);
+        }
+        if (d_cq_ptr_ != MAP_FAILED && d_cq_ptr_ != d_sq_ptr_) {
+            ::munmap(d_cq_ptr_, d_cq_size_);
+        }
+        if (d_sq_ptr_ != MAP_FAILED) {
+            ::munmap(d_sq_ptr_, d_sq_size_);
+        }
+        if (d_fd_ >= 0) {
+            ::close(d_fd_);
+        }
+    }
+
+    //! Returns 0 or an errno value.
+    int init(unsigned entries) noexcept
+    {
+        io_uring_params p{};
+        const long fd = ::syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0) {
+            return errno;
+        }
+        d_fd_ = static_cast<int>(fd);
+
+        d_sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        d_cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            d_sq_size_ = d_cq_size_ = std::max(d_sq_size_, d_cq_size_);
+        }
+        d_sq_ptr_ = ::mmap(nullptr,
+                           d_sq_size_,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE,
+                           d_fd_,
+                           IORING_OFF_SQ_RING);
+        if (d_sq_ptr_ == MAP_FAILED) {
+            return errno;
+        }
+        d_cq_ptr_ = single ? d_sq_ptr_
+                           : ::mmap(nullptr,
+                                    d_cq_size_,
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE,
+                                    d_fd_,
+                                    IORING_OFF_CQ_RING);
+        if (d_cq_ptr_ == MAP_FAILED) {
+            return errno;
+        }
+        d_sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr,
+                            d_sqes_size_,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE,
+                            d_fd_,
+                            IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return errno;
+        }
+        d_sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        auto* sq = static_cast<char*>(d_sq_ptr_);
+        d_sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        d_sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        d_sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        d_sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        d_sq_entries_ = p.sq_entries;
+
+        auto* cq = static_cast<char*>(d_cq_ptr_);
+        d_cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        d_cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        d_cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        d_cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        return 0;
+    }
+
+    int register_buffers(const iovec* iovs, unsigned count) noexcept
+    {
+        const long rc = ::syscall(__NR_io_uring_register,
+                                  d_fd_,
+                                  IORING_REGISTER_BUFFERS,
+                                  iovs,
+                                  count);
+        return rc < 0 ? errno : 0;
+    }
+
+    //! Next free SQE (zeroed), or null if the submission queue is full.
+    io_uring_sqe* get_sqe() noexcept
+    {
+        const unsigned head = __atomic_load_n(d_sq_head_, __ATOMIC_ACQUIRE);
+        const unsigned tail = *d_sq_tail_ + d_prepared_;
+        if (tail - head >= d_sq_entries_) {
+            return nullptr;
+        }
+        const unsigned idx = tail & d_sq_mask_;
+        d_sq_array_[idx] = idx;
+        ++d_prepared_;
+        auto* sqe = &d_sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    //! Submit prepared SQEs and wait for `wait_nr` completions.
+    void submit_and_wait(unsigned wait_nr) noexcept
+    {
+        if (d_prepared_) {
+            __atomic_store_n(
+                d_sq_tail_, *d_sq_tail_ + d_prepared_, __ATOMIC_RELEASE);
+            d_to_submit_ += d_prepared_;
+            d_prepared_ = 0;
+        }
+        if (d_to_submit_ == 0 && wait_nr == 0) {
+            return;
+        }
+        for (;;) {
+            const long r = ::syscall(__NR_io_uring_enter,
+                                     d_fd_,
+                                     d_to_submit_,
+                                     wait_nr,
+                                     wait_nr ? IORING_ENTER_GETEVENTS : 0,
+                                     nullptr,
+                                     0);
+            if (r >= 0) {
+                d_to_submit_ -= std::min<unsigned>(
+                    d_to_submit_, static_cast<unsigned>(r));
+                return;
+            }
+            if (errno != EINTR) {
+                return;
+            }
+        }
+    }
+
+    template <class FN>
+    void reap(FN&& fn)
+    {
+        unsigned head = *d_cq_head_;
+        const unsigned tail = __atomic_load_n(d_cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            fn(d_cqes_[head & d_cq_mask_]);
+        }
+        __atomic_store_n(d_cq_head_, head, __ATOMIC_RELEASE);
+    }
+};
+
+} // namespace
+
+struct uring_file_sink::impl {
+    struct slot {
+        char* data;
+        std::size_t len;       //!< bytes in the batch
+        std::size_t done;      //!< bytes already written
+        std::uint64_t offset;  //!< file offset reserved when sealed
+        iovec iov;             //!< for unregistered writes
+    };
+
+    static constexpr unsigned none = ~0u;
+
+    uring_sink_config config;
+    int fd{-1};
+    uring ring;
+    bool registered{false};
+    std::unique_ptr<char[]> arena;
+    std::vector<slot> slots;
+
+    dtl::sink_mutex mutex;
+    std::condition_variable_any io_cv;   //!< wakes the submitter thread
+    std::condition_variable_any free_cv; //!< wakes producers and flushers
+    std::vector<unsigned> free_slots;
+    std::deque<unsigned> ready;
+    unsigned current{none};
+    std::size_t inflight{0};
+    std::uint64_t next_offset{0};
+    bool stop{false};
+    uring_sink_stats stats{};
+    std::size_t in_ring{0}; //!< SQEs awaiting a CQE; submitter thread only
+
+    std::thread thread;
+
+    explicit impl(const uring_sink_config& cfg): config(cfg)
+    {
+        config.buffer_size = std::max<std::size_t>(config.buffer_size, 1);
+        config.buffer_count = std::max<std::size_t>(config.buffer_count, 1);
+    }
+
+    ~impl()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    //! Hand the current batch to the submitter, or give it back if it is
+    //! empty, so `current` is always `none` afterwards. Call with `mutex`
+    //! held.
+    void seal_current() noexcept
+    {
+        if (current == none) {
+            return;
+        }
+        auto& s = slots[current];
+        if (s.len == 0) {
+            free_slots.push_back(current); // never beyond its reserve
+            current = none;
+            return;
+        }
+        s.offset = next_offset;
+        s.done = 0;
+        next_offset += s.len;
+        ready.push_back(current);
+        current = none;
+    }
+
+    //! Queue a write for the unwritten part of slot `idx`.
+    bool prep(unsigned idx) noexcept
+    {
+        auto& s = slots[idx];
+        auto* sqe = ring.get_sqe();
+        if (!sqe) {
+            return false;
+        }
+        sqe->fd = fd;
+        sqe->off = s.offset + s.done;
+        sqe->user_data = idx;
+        if (registered) {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->addr = reinterpret_cast<std::uint64_t>(s.data + s.done);
+            sqe->len = static_cast<std::uint32_t>(s.len - s.done);
+            sqe->buf_index = static_cast<std::uint16_t>(idx);
+        }
+        else {
+            s.iov.iov_base = s.data + s.done;
+            s.iov.iov_len = s.len - s.done;
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->addr = reinterpret_cast<std::uint64_t>(&s.iov);
+            sqe->len = 1;
+        }
+        return true;
+    }
+
+    //! Submitter thread: turn sealed batches into SQEs, reap completions.
+    void run()
+    {
+        std::vector<unsigned> batch;
+        std::vector<unsigned> done;
+        std::unique_lock<dtl::sink_mutex> lk{mutex};
+        for (;;) {
+            if (ready.empty() && inflight == 0) {
+                if (stop && current == none) {
+                    break;
+                }
+                const bool woken =
+                    io_cv.wait_for(lk, config.flush_interval, [this] {
+                        return !ready.empty() || stop;
+                    });
+                if (!woken || stop) {
+                    // Don't let a quiet logger sit on a part-filled batch.
+                    seal_current();
+                }
+            }
+            batch.assign(ready.begin(), ready.end());
+            ready.clear();
+            inflight += batch.size();
+            lk.unlock();
+
+            std::size_t writes = 0;
+            std::size_t fallbacks = 0;
+            std::size_t written = 0;
+            done.clear();
+            auto write_sync = [&](unsigned idx) {
+                auto& s = slots[idx];
+                if (dtl::pwrite_all(fd,
+                                    s.data + s.done,
+                                    s.len - s.done,
+                                    s.offset + s.done)) {
+                    written += s.len - s.done;
+                }
+                ++fallbacks;
+                done.push_back(idx);
+            };
+
+            for (auto idx : batch) {
+                if (prep(idx)) {
+                    ++writes;
+                    ++in_ring;
+                }
+                else {
+                    write_sync(idx);
+                }
+            }
+            ring.submit_and_wait(in_ring > 0 ? 1 : 0);
+            std::vector<unsigned> retry;
+            ring.reap([&](const io_uring_cqe& cqe) {
+                const auto idx = static_cast<unsigned>(cqe.user_data);
+                auto& s = slots[idx];
+                --in_ring;
+                if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+                    retry.push_back(idx);
+                }
+                else if (cqe.res < 0) {
+                    write_sync(idx);
+                }
+                else {
+                    s.done += static_cast<std::size_t>(cqe.res);
+                    written += static_cast<std::size_t>(cqe.res);
+                    if (s.done < s.len && cqe.res > 0) {
+                        retry.push_back(idx); // short write
+                    }
+                    else if (s.done < s.len) {
+                        write_sync(idx);
+                    }
+                    else {
+                        done.push_back(idx);
+                    }
+                }
+            });
+            for (auto idx : retry) {
+                if (prep(idx)) {
+                    ++writes;
+                    ++in_ring;
+                }
+                else {
+                    write_sync(idx);
+                }
+            }
+
+            lk.lock();
+            stats.writes += writes;
+            stats.fallback_writes += fallbacks;
+            stats.bytes_written += written;
+            for (auto idx : done) {
+                slots[idx].len = 0;
+                free_slots.push_back(idx);
+            }
+            inflight -= done.size();
+            if (!done.empty()) {
+                free_cv.notify_all();
+            }
+        }
+    }
+};
+
+bool uring_file_sink::available() noexcept
+{
+    static const bool s_available = [] {
+        uring probe;
+        return probe.init(1) == 0;
+    }();
+    return s_available;
+}
+
+uring_file_sink::uring_file_sink(std::unique_ptr<impl> impl) noexcept
+: d_impl_(std::move(impl))
+{
+}
+
+std::shared_ptr<uring_file_sink>
+uring_file_sink::create(const std::string& path,
+                        const uring_sink_config& config)
+{
+    auto im = std::make_unique<impl>(config);
+    const auto& cfg = im->config;
+
+    // Offsets are assigned per batch, so the file is not opened O_APPEND.
+    im->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (im->fd < 0) {
+        throw std::system_error(
+            errno, std::generic_category(), "open " + path);
+    }
+    const auto end = ::lseek(im->fd, 0, SEEK_END);
+    im->next_offset = end > 0 ? static_cast<std::uint64_t>(end) : 0;
+
+    const auto entries = dtl::round_up_pow2(cfg.buffer_count);
+    if (const int err = im->ring.init(static_cast<unsigned>(entries))) {
+        throw std::system_error(
+            err, std::generic_category(), "io_uring_setup");
+    }
+
+    im->arena.reset(new char[cfg.buffer_size * cfg.buffer_count]);
+    std::vector<iovec> iovs(cfg.buffer_count);
+    im->slots.resize(cfg.buffer_count);
+    for (std::size_t i = 0; i < cfg.buffer_count; ++i) {
+        auto& s = im->slots[i];
+        s = impl::slot{};
+        s.data = im->arena.get() + i * cfg.buffer_size;
+        iovs[i].iov_base = s.data;
+        iovs[i].iov_len = cfg.buffer_size;
+        im->free_slots.push_back(
+            static_cast<unsigned>(cfg.buffer_count - 1 - i));
+    }
+    // Registration pins the buffers; it fails under a tight memlock limit,
+    // in which case plain vectored writes are used.
+    im->registered =
+        im->ring.register_buffers(
+            iovs.data(), static_cast<unsigned>(iovs.size())) == 0;
+    im->stats.registered_buffers = im->registered;
+
+    auto* raw = im.get();
+    im->thread = std::thread([raw] { raw->run(); });
+    return std::shared_ptr<uring_file_sink>{
+        new uring_file_sink(std::move(im))};
+}
+
+uring_file_sink::~uring_file_sink()
+{
+    retire();
+    {
+        std::lock_guard<dtl::sink_mutex> guard{d_impl_->mutex};
+        d_impl_->stop = true;
+        d_impl_->seal_current();
+    }
+    d_impl_->io_cv.notify_one();
+    d_impl_->thread.join();
+}
+
+void uring_file_sink::do_log(const log_buffer_t& buff)
+{
+    auto& im = *d_impl_;
+    const auto size = buff.size();
+    if (size == 0) {
+        return;
+    }
+    std::unique_lock<dtl::sink_mutex> lk{im.mutex};
+
+    if (size > im.config.buffer_size) {
+        // Too big to batch: reserve its place in the file and write it here.
+        im.seal_current();
+        const auto offset = im.next_offset;
+        im.next_offset += size;
+        lk.unlock();
+        im.io_cv.notify_one();
+        // Like a batch that fell back to `pwrite`: bytes count only once
+        // written, and a failed write leaves a hole rather than throwing.
+        const bool ok = dtl::pwrite_all(im.fd, buff.data(), size, offset);
+        lk.lock();
+        ++im.stats.fallback_writes;
+        if (ok) {
+            im.stats.bytes_written += size;
+        }
+        return;
+    }
+
+    // Another producer may have opened a batch while this one waited, so
+    // re-check the current batch after every wakeup.
+    for (;;) {
+        if (im.current != impl::none &&
+            im.slots[im.current].len + size > im.config.buffer_size) {
+            im.seal_current();
+            im.io_cv.notify_one();
+        }
+        if (im.current != impl::none) {
+            break;
+        }
+        if (!im.free_slots.empty()) {
+            im.current = im.free_slots.back();
+            im.free_slots.pop_back();
+            break;
+        }
+        ++im.stats.producer_waits;
+        im.free_cv.wait(lk);
+    }
+    auto& s = im.slots[im.current];
+    std::memcpy(s.data + s.len, buff.data(), size);
+    s.len += size;
+}
+
+void uring_file_sink::do_flush()
+{
+    auto& im = *d_impl_;
+    std::unique_lock<dtl::sink_mutex> lk{im.mutex};
+    im.seal_current();
+    im.io_cv.notify_one();
+    im.free_cv.wait(
+        lk, [&im] { return im.ready.empty() && im.inflight == 0; });
+}
+
+void uring_file_sink::do_emergency_flush() noexcept
+{
+    // Write the open batch directly; batches already in the ring are up
+    // to the kernel.
+    auto& im = *d_impl_;
+    if (!im.mutex.try_lock_from_crash()) {
+        return;
+    }
+    if (im.current != impl::none && im.slots[im.current].len > 0) {
+        auto& s = im.slots[im.current];
+        dtl::pwrite_all(im.fd, s.data, s.len, im.next_offset);
+        im.next_offset += s.len;
+        s.len = 0; // the submitter's next seal gives the slot back
+    }
+    im.mutex.unlock();
+}
+
+uring_sink_stats uring_file_sink::stats() const noexcept
+{
+    std::lock_guard<dtl::sink_mutex> guard{d_impl_->mutex};
+    return d_impl_->stats;
+}
+
+#else
+
+struct uring_file_sink::impl {
+};
+
+bool uring_file_sink::available() noexcept
+{
+    return false;
+}
+
+uring_file_sink::uring_file_sink(std::unique_ptr<impl> impl) noexcept
+: d_impl_(std::move(impl))
+{
+}
+
+std::shared_ptr<uring_file_sink>
+uring_file_sink::create(const std::string& path, const uring_sink_config&)
+{
+    throw std::system_error(
+        ENOSYS, std::generic_category(), "io_uring unavailable: " + path);
+}
+
+uring_file_sink::~uring_file_sink()
+{
+}
+
+void uring_file_sink::do_log(const log_buffer_t&)
+{
+}
+
+void uring_file_sink::do_flush()
+{
+}
+
+void uring_file_sink::do_emergency_flush() noexcept
+{
+}
+
+uring_sink_stats uring_file_sink::stats() const noexcept
+{
+    return uring_sink_stats{};
+}
+
+#endif
+
+std::shared_ptr<log_sink>
+log_sink_factory::async_file_sink(const std::string& path)
+{
+    if (uring_file_sink::available()) {
+        try {
+            return uring_file_sink::create(path);
+        }
+        catch (const std::system_error&) {
+            // e.g. the ring could not be created; use the stdio path.
+        }
+    }
+    return file_sink(path);
+}
+
+} // namespace ldgr
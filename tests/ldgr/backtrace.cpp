@@ -0,0 +1,86 @@
+//! @file backtrace.cpp
+
+#include <ldgr/logger.hpp>
+#include <ldgr/memsink.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ldgr;
+
+TEST_CASE("backtrace: basic")
+{
+    auto& l = log_registry::get("BACKTRACE.BASIC");
+    auto sink = log_sink_factory::capture_sink(512);
+    sink->set_formatter(std::make_shared<log_formatter>(
+        log_formatter::as_pattern{}, "%l %m"));
+    l.remove_sink(log_sink_factory::stderr_sink());
+    l.add_sink(sink);
+    l.set_level(log_severity::info);
+    l.enable_backtrace(log_severity::debug);
+
+    SECTION("an error dumps the records that led up to it")
+    {
+        LDGR_CAT_TRACE("BACKTRACE.BASIC", "too verbose");
+        LDGR_CAT_DEBUG("BACKTRACE.BASIC", "raw {} {}", 1, 2.5);
+        LDGR_CAT_INFO("BACKTRACE.BASIC", "logged");
+        LDGR_CAT_DEBUG(
+            "BACKTRACE.BASIC", "text {} {}", std::string{"abc"}, 'x');
+        REQUIRE(sink->records() == std::vector<std::string>{"INFO logged\n"});
+
+        LDGR_CAT_ERROR("BACKTRACE.BASIC", "boom");
+        REQUIRE(sink->records() ==
+                std::vector<std::string>{"INFO logged\n",
+                                         "DEBUG raw 1 2.5\n",
+                                         "DEBUG text abc x\n",
+                                         "ERROR boom\n"});
+
+        // Dumped records are not repeated.
+        LDGR_CAT_ERROR("BACKTRACE.BASIC", "again");
+        REQUIRE(sink->total() == 5);
+    }
+
+    SECTION("the ring keeps the newest records of the calling thread")
+    {
+        std::thread other{[] {
+            LDGR_CAT_DEBUG("BACKTRACE.BASIC", "other thread");
+        }};
+        other.join();
+        const int n = static_cast<int>(dtl::backtrace_ring::capacity) + 10;
+        for (int i = 0; i < n; ++i) {
+            LDGR_CAT_DEBUG("BACKTRACE.BASIC", "{}", i);
+        }
+        l.dump_backtrace();
+        const auto recs = sink->records();
+        REQUIRE(recs.size() == dtl::backtrace_ring::capacity);
+        REQUIRE(recs.front() == "DEBUG 10\n");
+        REQUIRE(recs.back() == "DEBUG " + std::to_string(n - 1) + "\n");
+    }
+
+    SECTION("long formatted arguments are truncated")
+    {
+        const std::string big(1000, 'z');
+        LDGR_CAT_DEBUG("BACKTRACE.BASIC", "{}", big);
+        l.dump_backtrace();
+        REQUIRE(sink->records() ==
+                std::vector<std::string>{
+                    "DEBUG " +
+                    big.substr(0, dtl::backtrace_record::payload_size) +
+                    "\n"});
+    }
+
+    SECTION("disabled")
+    {
+        l.disable_backtrace();
+        LDGR_CAT_DEBUG("BACKTRACE.BASIC", "dropped");
+        LDGR_CAT_ERROR("BACKTRACE.BASIC", "boom");
+        l.dump_backtrace();
+        REQUIRE(sink->records() == std::vector<std::string>{"ERROR boom\n"});
+    }
+
+    l.disable_backtrace();
+    l.remove_sink(sink);
+}
@@ -0,0 +1,223 @@
+//! @file dgramsink.cpp
+
+#include <ldgr/dgramsink.hpp>
+
+#include "fixtures.hpp"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace ldgr;
+using ldgr_test::make_entry;
+
+namespace {
+
+//! Bound Unix datagram socket standing in for syslogd / journald.
+struct collector {
+    std::string path;
+    int fd;
+
+    explicit collector(const char* tag)
+    : path("/tmp/ldgr-test-" + std::string(tag) + "-" +
+           std::to_string(::getpid()) + ".sock")
+    , fd(::socket(AF_UNIX, SOCK_DGRAM, 0))
+    {
+        ::unlink(path.c_str());
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::snprintf(
+            addr.sun_path, sizeof(addr.sun_path), "%s", path.c_str());
+        REQUIRE(::bind(fd, reinterpret_cast<const sockaddr*>(&addr),
+                       sizeof(addr)) == 0);
+    }
+
+    ~collector()
+    {
+        ::close(fd);
+        ::unlink(path.c_str());
+    }
+
+    //! Receive everything queued on the socket without blocking.
+    std::vector<std::string> drain() const
+    {
+        std::vector<std::string> out;
+        char buff[4096];
+        for (;;) {
+            const auto n = ::recv(fd, buff, sizeof(buff), MSG_DONTWAIT);
+            if (n < 0) {
+                break;
+            }
+            out.emplace_back(buff, static_cast<std::size_t>(n));
+        }
+        return out;
+    }
+};
+
+log_formatter::format_fn message_only =
+    [](log_buffer_t& buff,
+       const log_entry_fmt_cp& ent,
+       std::time_t&,
+       std::string&) {
+        fmtutil::append(buff, ent.entry.message);
+    };
+
+} // namespace
+
+TEST_CASE("dgramsink: basic")
+{
+    collector coll{"basic"};
+
+    SECTION("records go out at once and batch behind a full socket")
+    {
+        dgram_sink_config cfg;
+        cfg.batch = 4;
+        cfg.max_queued = 4096;
+        auto sink = unix_dgram_sink::create(coll.path, message_only, cfg);
+
+        sink->log(make_entry("m0"));
+        REQUIRE(coll.drain() == std::vector<std::string>{"m0"});
+        REQUIRE(sink->queued() == 0);
+
+        // Fill the collector's socket until records start to queue.
+        int n = 1;
+        while (sink->stats().retries == 0) {
+            sink->log(make_entry("m" + std::to_string(n++)));
+        }
+        for (int i = 0; i < 10; ++i) {
+            sink->log(make_entry("m" + std::to_string(n++)));
+        }
+        REQUIRE(sink->queued() > 0);
+
+        std::vector<std::string> got;
+        while (sink->queued() > 0) {
+            auto part = coll.drain();
+            got.insert(got.end(), part.begin(), part.end());
+            sink->flush();
+        }
+        auto part = coll.drain();
+        got.insert(got.end(), part.begin(), part.end());
+        REQUIRE(got.size() == static_cast<std::size_t>(n - 1));
+        REQUIRE(got.back() == "m" + std::to_string(n - 1));
+        const auto st = sink->stats();
+        REQUIRE(st.sent == static_cast<std::size_t>(n));
+        REQUIRE(st.batches < st.sent);
+    }
+
+    SECTION("a full socket queues records instead of blocking")
+    {
+        dgram_sink_config cfg;
+        cfg.batch = 1;
+        cfg.max_queued = 8;
+        auto sink = unix_dgram_sink::create(coll.path, message_only, cfg);
+
+        constexpr int n_records = 2000;
+        for (int i = 0; i < n_records; ++i) {
+            sink->log(make_entry("m" + std::to_string(i)));
+        }
+        auto st = sink->stats();
+        REQUIRE(st.retries > 0);
+        REQUIRE(st.dropped > 0);
+        REQUIRE(sink->queued() <= cfg.max_queued);
+        REQUIRE(st.sent + st.dropped + sink->queued() == n_records);
+
+        // Once the collector catches up the queued records go out, newest
+        // last.
+        std::vector<std::string> got;
+        while (sink->queued() > 0) {
+            auto part = coll.drain();
+            got.insert(got.end(), part.begin(), part.end());
+            sink->flush();
+        }
+        auto part = coll.drain();
+        got.insert(got.end(), part.begin(), part.end());
+        REQUIRE(!got.empty());
+        REQUIRE(got.back() == "m" + std::to_string(n_records - 1));
+    }
+
+    SECTION("syslog factory")
+    {
+        auto sink = log_sink_factory::syslog_sink(coll.path);
+        sink->log(make_entry("hello"));
+        sink->flush();
+        const auto got = coll.drain();
+        REQUIRE(got.size() == 1);
+        REQUIRE(got[0].compare(0, 6, "<14>1 ") == 0);
+        REQUIRE(got[0].find(" TEST - src/foo/bar.hpp:123 hello") !=
+                std::string::npos);
+    }
+
+    SECTION("connecting to a missing collector throws")
+    {
+        REQUIRE_THROWS_AS(unix_dgram_sink::create(coll.path + ".missing"),
+                          std::system_error);
+    }
+}
+
+TEST_CASE("dgramsink: throughput bench", "[.bench]")
+{
+    collector coll{"bench"};
+    std::atomic<bool> stop{false};
+    std::thread reader([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            coll.drain();
+        }
+    });
+
+    const auto entry = make_entry("a typical log message with some payload");
+
+    auto dgram = unix_dgram_sink::create(coll.path);
+    BENCHMARK("unix dgram sink, syslog, sendmmsg x16")
+    {
+        dgram->log(entry);
+    };
+
+    dgram_sink_config single;
+    single.batch = 1;
+    auto unbatched =
+        unix_dgram_sink::create(coll.path, &syslog_formatter, single);
+    BENCHMARK("unix dgram sink, syslog, unbatched")
+    {
+        unbatched->log(entry);
+    };
+
+    // Same shape as the built-in stdout/stderr file sink, on a temp file.
+    struct tmp_file_sink final : public log_sink {
+        std::FILE* file{std::tmpfile()};
+        std::mutex mutex;
+
+        ~tmp_file_sink() override
+        {
+            std::fclose(file);
+        }
+
+        void do_log(const log_buffer_t& buff) override
+        {
+            std::lock_guard<std::mutex> guard{mutex};
+            std::fwrite(buff.data(), 1, buff.size(), file);
+            std::fflush(file);
+        }
+
+        void do_flush() override
+        {
+        }
+    } file_sink;
+    BENCHMARK("file sink")
+    {
+        file_sink.log(entry);
+    };
+
+    stop = true;
+    reader.join();
+    auto st = dgram->stats();
+    WARN("dgram sent " << st.sent << ", dropped " << st.dropped);
+}
@@ -0,0 +1,133 @@
+//! @file directsink.cpp
+
+#include <ldgr/directsink.hpp>
+
+#include "fixtures.hpp"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <fstream>
+#include <string>
+
+using namespace ldgr;
+using ldgr_test::make_entry;
+using ldgr_test::tmp_path;
+
+namespace {
+
+log_formatter::format_fn message_line =
+    [](log_buffer_t& buff,
+       const log_entry_fmt_cp& ent,
+       std::time_t&,
+       std::string&) {
+        fmtutil::append(buff, ent.entry.message);
+        fmtutil::append(buff, fmtutil::to_view("\n"));
+    };
+
+std::shared_ptr<direct_file_sink> make_sink(const std::string& path)
+{
+    direct_sink_config cfg;
+    cfg.buffer_size = 2 * cfg.block_size;
+    cfg.buffer_count = 2;
+    auto sink = direct_file_sink::create(path, cfg);
+    sink->set_formatter(std::make_shared<log_formatter>(message_line));
+    return sink;
+}
+
+} // namespace
+
+TEST_CASE("directsink: basic")
+{
+    tmp_path tmp{"direct"};
+
+    SECTION("records straddle buffers and flush trims the padding")
+    {
+        auto sink = make_sink(tmp.path);
+        std::string expected;
+        for (int i = 0; i < 3000; ++i) {
+            const auto msg = "record " + std::to_string(i);
+            sink->log(make_entry(msg));
+            expected += msg + "\n";
+        }
+        sink->flush();
+        REQUIRE(tmp.read() == expected);
+
+        const auto st = sink->stats();
+        REQUIRE(st.bytes_logged == expected.size());
+        REQUIRE(st.buffers_written == expected.size() / 8192);
+        REQUIRE(st.padded_writes == 1);
+        if (!st.direct) {
+            WARN("O_DIRECT unsupported here; wrote through the page cache");
+        }
+
+        // The flushed tail block is rewritten once more records arrive.
+        sink->log(make_entry("after flush"));
+        sink->flush();
+        REQUIRE(tmp.read() == expected + "after flush\n");
+    }
+
+    SECTION("an existing file is appended to, partial block included")
+    {
+        {
+            std::ofstream{tmp.path} << "existing\n";
+        }
+        {
+            auto sink = make_sink(tmp.path);
+            sink->log(make_entry("one"));
+        }
+        {
+            auto sink = make_sink(tmp.path);
+            sink->log(make_entry("two"));
+        }
+        REQUIRE(tmp.read() == "existing\none\ntwo\n");
+    }
+
+    SECTION("emergency flush writes queued and partial buffers")
+    {
+        auto sink = make_sink(tmp.path);
+        sink->log(make_entry("crash"));
+        sink->emergency_flush();
+        REQUIRE(tmp.read() == "crash\n");
+    }
+
+    SECTION("factory")
+    {
+        auto sink = log_sink_factory::direct_file_sink(tmp.path);
+        sink->set_formatter(std::make_shared<log_formatter>(message_line));
+        sink->log(make_entry("hello"));
+        sink->flush();
+        REQUIRE(tmp.read() == "hello\n");
+    }
+
+    SECTION("block size must be a power of two")
+    {
+        direct_sink_config cfg;
+        cfg.block_size = 3000;
+        REQUIRE_THROWS_AS(direct_file_sink::create(tmp.path, cfg),
+                          std::system_error);
+    }
+}
+
+TEST_CASE("directsink: throughput bench", "[.bench]")
+{
+    const auto entry = make_entry("a typical log message with some payload");
+
+    tmp_path stdio_tmp{"bench-stdio"};
+    auto stdio = log_sink_factory::file_sink(stdio_tmp.path);
+    BENCHMARK("stdio file sink")
+    {
+        stdio->log(entry);
+    };
+
+    tmp_path direct_tmp{"bench-direct"};
+    auto direct = direct_file_sink::create(direct_tmp.path);
+    BENCHMARK("O_DIRECT file sink")
+    {
+        direct->log(entry);
+    };
+    direct->flush();
+    const auto st = direct->stats();
+    WARN("direct " << st.direct << ", buffers " << st.buffers_written
+                   << ", waits " << st.buffer_waits);
+}
@@ -0,0 +1,81 @@
+//! @file fixtures.hpp
+//! @brief Helpers shared by the sink tests.
+
+#ifndef INCLUDED_FIXTURES
+#define INCLUDED_FIXTURES
+
+#include <ldgr/logentry.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace ldgr_test {
+
+//! An info record from `abc/src/foo/bar.hpp:123` at a fixed time.
+inline ldgr::log_entry_fmt_cp make_entry(const std::string& msg,
+                                         const char* category = "TEST")
+{
+    using namespace ldgr;
+    const log_entry entry{
+        log_severity::info,
+        fmtutil::to_view(category),
+        fmtutil::to_view("abc/src/foo/bar.hpp"),
+        123,
+        time_point(std::chrono::microseconds(1598153679123456ll)),
+        fmtutil::to_view(msg)};
+    return log_entry_util::copy_log_entry(entry);
+}
+
+//! Temp file path removed on scope exit.
+struct tmp_path {
+    std::string path;
+
+    explicit tmp_path(const char* tag)
+    : path("/tmp/ldgr-test-" + std::string(tag) + "-" +
+           std::to_string(::getpid()) + ".log")
+    {
+        ::unlink(path.c_str());
+    }
+
+    ~tmp_path()
+    {
+        ::unlink(path.c_str());
+    }
+
+    std::string read() const
+    {
+        std::ifstream in{path, std::ios::binary};
+        return std::string{std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>()};
+    }
+
+    std::vector<std::string> lines() const
+    {
+        std::vector<std::string> out;
+        std::istringstream in{read()};
+        for (std::string line; std::getline(in, line);) {
+            out.push_back(line);
+        }
+        return out;
+    }
+
+    void write(const std::string& text) const
+    {
+        // Replace the file the way editors do, so a watcher sees one event
+        // for the complete contents.
+        const auto staged = path + ".new";
+        std::ofstream{staged, std::ios::binary} << text;
+        std::rename(staged.c_str(), path.c_str());
+    }
+};
+
+} // namespace ldgr_test
+
+#endif // INCLUDED_FIXTURES
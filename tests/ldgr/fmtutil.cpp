@@ -60,6 +60,52 @@ TEST_CASE("fmtutil: basic")
         REQUIRE(fmtutil::to_string(fmtutil::append(buff, tp)) ==
                 "2020-08-23 03:34:39.123456Z");
     }
+    SECTION("append_pad_int<9> 1234")
+    {
+        REQUIRE(fmtutil::to_string(fmtutil::append_pad_int<9>(buff, 1234)) ==
+                "000001234");
+    }
+    SECTION("append duration of other periods")
+    {
+        namespace chr = std::chrono;
+        const auto ns = chr::nanoseconds(1598153679123456789ll);
+        REQUIRE(fmtutil::to_string(fmtutil::append(buff, ns)) ==
+                "2020-08-23 03:34:39.123456Z");
+        buff.clear();
+        const auto ms = chr::milliseconds(1598153679123ll);
+        REQUIRE(fmtutil::to_string(fmtutil::append(buff, ms)) ==
+                "2020-08-23 03:34:39.123000Z");
+        buff.clear();
+        const auto secs = chr::seconds(1598153679ll);
+        REQUIRE(fmtutil::to_string(fmtutil::append(buff, secs)) ==
+                "2020-08-23 03:34:39.000000Z");
+        buff.clear();
+        const chr::duration<double> fsecs{1.5};
+        REQUIRE(fmtutil::to_string(fmtutil::append(buff, fsecs)) ==
+                "1970-01-01 00:00:01.500000Z");
+    }
+    SECTION("append duration at each precision")
+    {
+        const auto ns = std::chrono::nanoseconds(1598153679123456789ll);
+        REQUIRE(fmtutil::to_string(
+                    fmtutil::append<time_precision::seconds>(buff, ns)) ==
+                "2020-08-23 03:34:39Z");
+        buff.clear();
+        REQUIRE(fmtutil::to_string(
+                    fmtutil::append<time_precision::milliseconds>(buff, ns)) ==
+                "2020-08-23 03:34:39.123Z");
+        buff.clear();
+        REQUIRE(fmtutil::to_string(
+                    fmtutil::append<time_precision::nanoseconds>(buff, ns)) ==
+                "2020-08-23 03:34:39.123456789Z");
+    }
+    SECTION("append duration before the epoch")
+    {
+        const auto ms = std::chrono::milliseconds(-250);
+        REQUIRE(fmtutil::to_string(
+                    fmtutil::append<time_precision::milliseconds>(buff, ms)) ==
+                "1969-12-31 23:59:59.750Z");
+    }
     SECTION("append level default")
     {
         REQUIRE(fmtutil::to_string(fmtutil::append(
@@ -76,6 +122,12 @@ TEST_CASE("fmtutil: basic")
         constexpr auto trunc = fmtutil::trunc_file(v);
         REQUIRE(trunc == fmtutil::to_view("x/y/z"));
     }
+    SECTION("truncate file name offset")
+    {
+        constexpr auto v = fmtutil::to_view("w/x/y/z");
+        static_assert(fmtutil::trunc_file_offset(v) == 2);
+        REQUIRE(fmtutil::trunc_file_offset(fmtutil::to_view("a/b")) == 0);
+    }
     SECTION("truncate file name - case 2")
     {
         constexpr auto v = fmtutil::to_view("z");
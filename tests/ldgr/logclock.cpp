@@ -0,0 +1,79 @@
+//! @file logclock.cpp
+
+#include <ldgr/logclock.hpp>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <thread>
+
+using namespace ldgr;
+
+namespace {
+
+namespace chr = std::chrono;
+
+//! Distance between `log_clock` and `system_clock`, read back to back.
+chr::nanoseconds skew()
+{
+    const auto before = chr::system_clock::now();
+    const auto t = log_clock::now();
+    const auto after = chr::system_clock::now();
+    if (t < before) {
+        return before - t;
+    }
+    return t > after ? t - after : chr::nanoseconds{0};
+}
+
+} // namespace
+
+TEST_CASE("logclock: basic")
+{
+    SECTION("system clock by default")
+    {
+        REQUIRE(!log_clock::using_tsc());
+        REQUIRE(skew() == chr::nanoseconds{0});
+    }
+
+    SECTION("tsc")
+    {
+        if (!log_clock::tsc_available()) {
+            REQUIRE(!log_clock::use_tsc(true));
+            REQUIRE(!log_clock::using_tsc());
+            return;
+        }
+        REQUIRE(log_clock::use_tsc(true));
+        REQUIRE(log_clock::using_tsc());
+        for (int i = 0; i < 20; ++i) {
+            REQUIRE(skew() < chr::milliseconds(1));
+            std::this_thread::sleep_for(chr::milliseconds(5));
+        }
+        log_clock::recalibrate();
+        REQUIRE(skew() < chr::milliseconds(1));
+
+        auto prev = log_clock::now();
+        for (int i = 0; i < 100000; ++i) {
+            const auto t = log_clock::now();
+            REQUIRE(t >= prev);
+            prev = t;
+        }
+        REQUIRE(!log_clock::use_tsc(false));
+        REQUIRE(!log_clock::using_tsc());
+    }
+}
+
+TEST_CASE("logclock: bench", "[.bench]")
+{
+    BENCHMARK("system_clock")
+    {
+        return chr::system_clock::now();
+    };
+    if (log_clock::use_tsc(true)) {
+        BENCHMARK("log_clock tsc")
+        {
+            return log_clock::now();
+        };
+        log_clock::use_tsc(false);
+    }
+}
@@ -0,0 +1,176 @@
+//! @file logconfig.cpp
+
+#include <ldgr/logconfig.hpp>
+#include <ldgr/memsink.hpp>
+
+#include "fixtures.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ldgr;
+using ldgr_test::tmp_path;
+
+#if defined(LDGR_HAVE_CONFIG)
+
+namespace {
+
+std::string file_sink_config(const std::string& path,
+                             const std::string& level,
+                             const std::string& pattern = "%l %c %m")
+{
+    return R"({"levels": [{"category": "*", "level": ")" + level +
+           R"("}], "sinks": [{"name": "out", "type": "file", "path": ")" +
+           path + R"(", "pattern": ")" + pattern +
+           R"(", "level": null, "categories": ["CFG.*"]}]})";
+}
+
+template <class Pred>
+bool wait_for(Pred pred)
+{
+    const auto until =
+        std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > until) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+} // namespace
+
+TEST_CASE("logconfig: basic")
+{
+    SECTION("levels pick the most specific category rule")
+    {
+        log_registry::apply_config(R"({"levels": [
+            {"category": "*", "level": "error"},
+            {"category": "CFG.*", "level": "WARN"},
+            {"category": "CFG.db.*", "level": "debug"},
+            {"category": "CFG.db.pool", "level": "trace"}],
+            "sinks": []})");
+        REQUIRE(log_registry::get("CFG.app").level() == log_severity::warn);
+        REQUIRE(log_registry::get("CFG.db.x").level() == log_severity::debug);
+        REQUIRE(log_registry::get("CFG.db.pool").level() ==
+                log_severity::trace);
+        REQUIRE(log_registry::get("OTHER").level() == log_severity::error);
+    }
+
+    SECTION("sinks are routed by category and use the pattern")
+    {
+        tmp_path out{"config-route"};
+        log_registry::apply_config(file_sink_config(out.path, "info"));
+        LDGR_CAT_INFO("CFG.route", "hello");
+        LDGR_CAT_DEBUG("CFG.route", "hidden");
+        REQUIRE(out.read() == "INFO CFG.route hello\n");
+
+        // Unchanged sinks are reused, so the file is not reopened.
+        log_registry::apply_config(
+            file_sink_config(out.path, "debug", "[%l] %m"));
+        LDGR_CAT_DEBUG("CFG.route", "shown");
+        REQUIRE(out.read() == "INFO CFG.route hello\n[DEBUG] shown\n");
+    }
+
+    SECTION("a configuration without sinks restores the code's sinks")
+    {
+        tmp_path out{"config-restore"};
+        auto& l = log_registry::get("CFG.restore");
+        l.set_level(log_severity::info);
+        auto sink = log_sink_factory::capture_sink();
+        sink->set_formatter(std::make_shared<log_formatter>(
+            log_formatter::as_pattern{}, "%m"));
+        l.remove_sink(log_sink_factory::stderr_sink());
+        l.add_sink(sink);
+        LDGR_CAT_INFO("CFG.restore", "code");
+
+        log_registry::apply_config(file_sink_config(out.path, "info"));
+        LDGR_CAT_INFO("CFG.restore", "configured");
+        log_registry::apply_config(R"({"levels": [], "sinks": []})");
+        LDGR_CAT_INFO("CFG.restore", "code again");
+
+        REQUIRE(out.read() == "INFO CFG.restore configured\n");
+        REQUIRE(sink->records() ==
+                std::vector<std::string>{"code\n", "code again\n"});
+        l.remove_sink(sink);
+        l.add_sink(log_sink_factory::stderr_sink());
+    }
+
+    SECTION("stdout and stderr sinks are not the shared ones")
+    {
+        const auto shared = log_sink_factory::stdout_sink();
+        const auto fmt = shared->formatter();
+        log_registry::apply_config(R"({"levels": [], "sinks": [
+            {"name": "o", "type": "stdout", "path": null,
+             "pattern": "%m", "level": "error", "categories": ["NOBODY"]},
+            {"name": "e", "type": "stderr", "path": null,
+             "pattern": "%m", "level": "error", "categories": ["NOBODY"]}]})");
+        REQUIRE(shared->formatter() == fmt);
+        REQUIRE(shared->level() == log_severity::trace);
+        REQUIRE(log_sink_factory::stderr_sink()->level() ==
+                log_severity::trace);
+    }
+
+    SECTION("a rejected configuration leaves the old one in place")
+    {
+        tmp_path out{"config-reject"};
+        log_registry::apply_config(file_sink_config(out.path, "info"));
+
+        REQUIRE_THROWS(log_registry::apply_config("{not json"));
+        REQUIRE_THROWS(log_registry::apply_config(
+            R"({"levels": [], "sinks": [], "extra": 1})"));
+        REQUIRE_THROWS(log_registry::apply_config(
+            R"({"levels": [{"category": "*", "level": "loud"}],
+                "sinks": []})"));
+        REQUIRE_THROWS(log_registry::apply_config(
+            R"({"levels": [], "sinks": [{"name": "x", "type": "carrier",
+                "path": null, "pattern": null, "level": null,
+                "categories": []}]})"));
+        REQUIRE_THROWS(log_registry::apply_config(
+            R"({"levels": [], "sinks": [{"name": "x", "type": "file",
+                "path": null, "pattern": null, "level": null,
+                "categories": []}]})"));
+
+        LDGR_CAT_INFO("CFG.reject", "still routed");
+        REQUIRE(out.read() == "INFO CFG.reject still routed\n");
+    }
+
+    SECTION("load_config reports missing files")
+    {
+        tmp_path out{"config-missing"};
+        REQUIRE_THROWS_AS(log_registry::load_config(out.path + ".missing"),
+                          std::system_error);
+    }
+
+    SECTION("the watcher reapplies a rewritten file")
+    {
+        tmp_path out{"config-watch"};
+        tmp_path cfg{"config-json"};
+        cfg.write(file_sink_config(out.path, "error"));
+        std::string last_error;
+        log_config_watcher watcher{
+            cfg.path, [&](const std::string& what) { last_error = what; }};
+        auto& l = log_registry::get("CFG.watch");
+        REQUIRE(l.level() == log_severity::error);
+
+        cfg.write(file_sink_config(out.path, "debug"));
+        REQUIRE(wait_for([&] { return watcher.reloads() == 1; }));
+        REQUIRE(l.level() == log_severity::debug);
+
+        cfg.write("{broken");
+        REQUIRE(wait_for([&] { return watcher.failures() == 1; }));
+        REQUIRE(l.level() == log_severity::debug);
+        REQUIRE(!last_error.empty());
+    }
+
+    log_registry::apply_config(R"({"levels": [], "sinks": []})");
+}
+
+#endif
@@ -0,0 +1,204 @@
+//! @file logcontext.cpp
+
+#include <ldgr/logger.hpp>
+#include <ldgr/memsink.hpp>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ldgr;
+
+namespace {
+
+std::vector<std::string> fields(log_context_view ctx)
+{
+    std::vector<std::string> out;
+    for (const auto f : ctx) {
+        out.push_back(fmt::format("{}={}", f.key, f.value));
+    }
+    return out;
+}
+
+std::string format_with(const log_formatter& fmt, const log_entry& entry)
+{
+    log_buffer_t buff;
+    fmt.format(buff, log_entry_util::copy_log_entry(entry));
+    return std::string{buff.data(), buff.size()};
+}
+
+log_entry make_entry()
+{
+    return {log_severity::info,
+            fmtutil::to_view("LOG.CAT"),
+            fmtutil::to_view("abc/src/foo/bar.hpp"),
+            123,
+            time_point(std::chrono::microseconds(1598153679123456ll)),
+            fmtutil::to_view("foo")};
+}
+
+} // namespace
+
+TEST_CASE("logcontext: basic")
+{
+    REQUIRE(log_context::current().empty());
+
+    SECTION("scopes push and pop fields")
+    {
+        {
+            const log_context_scope request{"request", 42};
+            const log_context_scope tenant{"tenant", "acme"};
+            REQUIRE(fields(log_context::current()) ==
+                    std::vector<std::string>{"request=42", "tenant=acme"});
+            {
+                const log_context_scope inner{"request", std::string{"7"}};
+                REQUIRE(*log_context::current().find("request") == "7");
+            }
+            REQUIRE(*log_context::current().find("request") == "42");
+            REQUIRE(!log_context::current().find("trace"));
+        }
+        REQUIRE(log_context::current().empty());
+    }
+
+    SECTION("fields that do not fit are left out")
+    {
+        std::vector<std::unique_ptr<log_context_scope>> scopes;
+        for (std::size_t i = 0; i < dtl::log_context_arena::max_depth + 2;
+             ++i) {
+            scopes.push_back(std::make_unique<log_context_scope>("k", i));
+            REQUIRE(scopes.back()->pushed() ==
+                    (i < dtl::log_context_arena::max_depth));
+        }
+        scopes.clear();
+        REQUIRE(log_context::current().empty());
+
+        const std::string big(dtl::log_context_arena::capacity, 'x');
+        const log_context_scope too_big{"big", big};
+        REQUIRE(!too_big.pushed());
+        const log_context_scope small{"small", "ok"};
+        REQUIRE(small.pushed());
+        REQUIRE(fields(log_context::current()) ==
+                std::vector<std::string>{"small=ok"});
+    }
+
+    SECTION("threads have their own context")
+    {
+        const log_context_scope outer{"thread", "main"};
+        std::thread other{[] {
+            REQUIRE(log_context::current().empty());
+            const log_context_scope s{"thread", "other"};
+            REQUIRE(*log_context::current().find("thread") == "other");
+        }};
+        other.join();
+        REQUIRE(*log_context::current().find("thread") == "main");
+    }
+
+    SECTION("task contexts follow the task across threads")
+    {
+        std::unique_ptr<log_task_context> ctx;
+        {
+            const log_context_scope request{"request", 42};
+            ctx = std::make_unique<log_task_context>();
+        }
+        REQUIRE(log_context::current().empty());
+
+        std::vector<std::string> in_task;
+        std::vector<std::string> after;
+        std::thread worker{[&] {
+            const log_context_scope own{"worker", 1};
+            {
+                const auto active = ctx->activate();
+                const log_context_scope step{"step", 2};
+                in_task = fields(log_context::current());
+            }
+            after = fields(log_context::current());
+        }};
+        worker.join();
+        REQUIRE(in_task == std::vector<std::string>{"request=42", "step=2"});
+        REQUIRE(after == std::vector<std::string>{"worker=1"});
+        REQUIRE(fields(ctx->fields()) ==
+                std::vector<std::string>{"request=42"});
+    }
+
+    SECTION("entries keep a copy of the context")
+    {
+        log_entry_fmt_cp cp;
+        {
+            const log_context_scope request{"request", 42};
+            cp = log_entry_util::copy_log_entry(make_entry());
+        }
+        const log_context_scope overwrite{"request", 43};
+        REQUIRE(fields(cp.entry.context()) ==
+                std::vector<std::string>{"request=42"});
+    }
+
+    SECTION("formatters render the context")
+    {
+        const log_context_scope request{"request", 42};
+        const log_context_scope tenant{"tenant-id", "a\"b"};
+        const auto entry = make_entry();
+
+        REQUIRE(format_with(log_formatter{&default_formatter}, entry) ==
+                fmt::format("2020-08-23 03:34:39.123456Z [ INFO] [{}] LOG.CAT "
+                            "src/foo/bar.hpp:123 "
+                            "{{request=42 tenant-id=a\"b}} foo\n",
+                            log_thread::id()));
+
+        const auto json = format_with(log_formatter{&json_formatter}, entry);
+        const std::string suffix =
+            ",\"message\":\"foo\","
+            "\"context\":{\"request\":\"42\",\"tenant-id\":\"a\\\"b\"}}";
+        REQUIRE(json.size() > suffix.size());
+        REQUIRE(json.compare(json.size() - suffix.size(),
+                             suffix.size(),
+                             suffix) == 0);
+
+        const auto journal =
+            format_with(log_formatter{&journald_formatter}, entry);
+        REQUIRE(journal.find("\nLDGR_CTX_REQUEST=42\n") != std::string::npos);
+        REQUIRE(journal.find("\nLDGR_CTX_TENANT_ID=a\"b\n") !=
+                std::string::npos);
+
+        const log_formatter pattern{log_formatter::as_pattern{},
+                                    "[%X] %X{tenant-id} %X{trace}|%X{"};
+        REQUIRE(format_with(pattern, entry) ==
+                "[request=42 tenant-id=a\"b] a\"b |request=42 tenant-id=a\"b{"
+                "\n");
+    }
+
+    SECTION("log statements pick up the context")
+    {
+        auto& l = log_registry::get("LOGCONTEXT.BASIC");
+        auto sink = log_sink_factory::capture_sink();
+        sink->set_formatter(std::make_shared<log_formatter>(
+            log_formatter::as_pattern{}, "%X{request} %m"));
+        l.remove_sink(log_sink_factory::stderr_sink());
+        l.add_sink(sink);
+        {
+            const log_context_scope request{"request", 42};
+            LDGR_CAT_INFO("LOGCONTEXT.BASIC", "inside");
+        }
+        LDGR_CAT_INFO("LOGCONTEXT.BASIC", "outside");
+        REQUIRE(sink->records() ==
+                std::vector<std::string>{"42 inside\n", " outside\n"});
+        l.remove_sink(sink);
+    }
+}
+
+TEST_CASE("logcontext: bench", "[.bench]")
+{
+    BENCHMARK("push and pop")
+    {
+        const log_context_scope request{"request", "4b1d"};
+        return log_context::current().data().size();
+    };
+    BENCHMARK("push and pop formatted")
+    {
+        const log_context_scope request{"request", 42};
+        return log_context::current().data().size();
+    };
+}
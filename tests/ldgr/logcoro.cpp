@@ -0,0 +1,162 @@
+//! @file logcoro.cpp
+
+#include <ldgr/logcoro.hpp>
+
+#if defined(LDGR_HAVE_COROUTINES) && defined(__cpp_impl_coroutine)
+#include <ldgr/logger.hpp>
+#include <ldgr/memsink.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ldgr;
+
+namespace {
+
+//! Lazily started task that sets `*done` once it has finished.
+struct task {
+    struct promise_type : log_context_promise {
+        std::atomic<bool>* done{nullptr};
+
+        struct final_awaiter {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(
+                std::coroutine_handle<promise_type> h) noexcept
+            {
+                // Suspended already; nothing touches the frame after this.
+                h.promise().done->store(true, std::memory_order_release);
+            }
+
+            void await_resume() noexcept
+            {
+            }
+        };
+
+        task get_return_object()
+        {
+            return task{
+                std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        auto initial_suspend() noexcept
+        {
+            return with_log_context(std::suspend_always{});
+        }
+
+        auto final_suspend() noexcept
+        {
+            return without_log_context(final_awaiter{});
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    explicit task(std::coroutine_handle<promise_type> h): handle(h)
+    {
+    }
+
+    task(task&& other) noexcept: handle(std::exchange(other.handle, {}))
+    {
+    }
+
+    ~task()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    //! Run on this thread until the first suspension.
+    void start(std::atomic<bool>& done)
+    {
+        handle.promise().done = &done;
+        handle.resume();
+    }
+};
+
+struct resume_on_new_thread {
+    std::thread& thread;
+
+    bool await_ready() noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        thread = std::thread([h] { h.resume(); });
+    }
+
+    void await_resume() noexcept
+    {
+    }
+};
+
+task handle_request(std::thread& hop)
+{
+    const log_context_scope step{"step", 1};
+    LDGR_CAT_INFO("LOGCORO.BASIC", "started");
+    co_await resume_on_new_thread{hop};
+    LDGR_CAT_INFO("LOGCORO.BASIC", "hopped");
+    co_await flush_async(log_registry::get("LOGCORO.BASIC"));
+    LDGR_CAT_INFO("LOGCORO.BASIC", "flushed");
+}
+
+} // namespace
+
+TEST_CASE("logcoro: basic")
+{
+    auto& l = log_registry::get("LOGCORO.BASIC");
+    auto sink = log_sink_factory::capture_sink();
+    sink->set_formatter(std::make_shared<log_formatter>(
+        log_formatter::as_pattern{}, "%X %m"));
+    l.remove_sink(log_sink_factory::stderr_sink());
+    l.add_sink(sink);
+
+    SECTION("the context follows the coroutine across threads")
+    {
+        std::thread hop;
+        auto t = [&hop] {
+            const log_context_scope request{"request", 42};
+            return handle_request(hop);
+        }();
+        REQUIRE(log_context::current().empty());
+
+        std::atomic<bool> done{false};
+        t.start(done);
+        // Suspended on the way to another thread, leaving ours alone.
+        REQUIRE(log_context::current().empty());
+        while (!done.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        hop.join();
+
+        REQUIRE(sink->records() ==
+                std::vector<std::string>{"request=42 step=1 started\n",
+                                         "request=42 step=1 hopped\n",
+                                         "request=42 step=1 flushed\n"});
+        REQUIRE(log_context::current().empty());
+    }
+
+    l.remove_sink(sink);
+}
+
+#endif
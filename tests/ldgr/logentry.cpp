@@ -7,14 +7,139 @@
 #define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include <catch2/catch.hpp>
 
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 using namespace ldgr;
 
+namespace {
+
+//! Pin the calling thread to `cpu`.
+void pin_self(unsigned cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &set);
+    ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+    static_cast<void>(cpu);
+#endif
+}
+
+//! Long-lived producer and consumer threads, each pinning itself before
+//! doing any work. `run` has the producer allocate `count` buffers and pass
+//! each through a ring to the consumer, which releases it, so allocation
+//! and release overlap and only that loop is measured.
+class handoff_pair {
+    static constexpr std::size_t ring_size = 256;
+
+    pooled_log_buffer_factory& d_pool_;
+    std::shared_ptr<log_buffer_t> d_ring_[ring_size];
+    std::atomic<std::uint64_t> d_head_{0}; // slots filled
+    std::atomic<std::uint64_t> d_tail_{0}; // slots released
+    std::atomic<std::uint64_t> d_round_{0};
+    std::atomic<std::uint64_t> d_done_{0};
+    std::size_t d_count_{0};
+    std::atomic<bool> d_stop_{false};
+    std::thread d_producer_;
+    std::thread d_consumer_;
+
+    //! Wait for the next round; false once stopping.
+    bool next_round(std::uint64_t& seen)
+    {
+        while (d_round_.load(std::memory_order_acquire) == seen) {
+            if (d_stop_.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        ++seen;
+        return true;
+    }
+
+    void produce(unsigned cpu)
+    {
+        pin_self(cpu);
+        std::uint64_t seen = 0;
+        while (next_round(seen)) {
+            for (std::size_t i = 0; i < d_count_; ++i) {
+                const auto head = d_head_.load(std::memory_order_relaxed);
+                while (head - d_tail_.load(std::memory_order_acquire) ==
+                       ring_size) {
+                    std::this_thread::yield();
+                }
+                auto& slot = d_ring_[head % ring_size];
+                slot = d_pool_(128);
+                fmtutil::append(*slot, "payload");
+                d_head_.store(head + 1, std::memory_order_release);
+            }
+        }
+    }
+
+    void consume(unsigned cpu)
+    {
+        pin_self(cpu);
+        std::uint64_t seen = 0;
+        while (next_round(seen)) {
+            for (std::size_t i = 0; i < d_count_; ++i) {
+                const auto tail = d_tail_.load(std::memory_order_relaxed);
+                while (d_head_.load(std::memory_order_acquire) == tail) {
+                    std::this_thread::yield();
+                }
+                d_ring_[tail % ring_size].reset();
+                d_tail_.store(tail + 1, std::memory_order_release);
+            }
+            d_done_.store(seen, std::memory_order_release);
+        }
+    }
+
+  public:
+    handoff_pair(pooled_log_buffer_factory& pool,
+                 unsigned producer_cpu,
+                 unsigned consumer_cpu)
+    : d_pool_(pool)
+    , d_producer_([this, producer_cpu] { produce(producer_cpu); })
+    , d_consumer_([this, consumer_cpu] { consume(consumer_cpu); })
+    {
+    }
+
+    ~handoff_pair()
+    {
+        d_stop_.store(true, std::memory_order_relaxed);
+        d_producer_.join();
+        d_consumer_.join();
+    }
+
+    //! Hand `count` buffers from the producer to the consumer and wait
+    //! until every one is released.
+    void run(std::size_t count)
+    {
+        d_count_ = count;
+        const auto round = d_round_.load(std::memory_order_relaxed) + 1;
+        d_round_.store(round, std::memory_order_release);
+        while (d_done_.load(std::memory_order_acquire) != round) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+} // namespace
+
 TEST_CASE("logentry: basic")
 {
     log_entry entry{log_severity::info,
                     fmtutil::to_view("LOG.CAT"),
                     fmtutil::to_view("src/foo/bar.hpp"),
-                    fmtutil::to_view("123"),
+                    123,
                     time_point(std::chrono::microseconds(1598153679123456ll)),
                     fmtutil::to_view("Some message type")};
     REQUIRE(entry.when.time_since_epoch().count() == 1598153679123456000ll);
@@ -31,10 +156,39 @@ TEST_CASE("logentry: basic")
         REQUIRE(out.time_struct.tm_hour == 3);
         REQUIRE(out.time_struct.tm_min == 34);
         REQUIRE(out.time_struct.tm_sec == 39);
-        REQUIRE(out.microseconds == 123456);
+        REQUIRE(out.nanoseconds == 123456000);
         REQUIRE(out.is_local == false);
         REQUIRE(out.message == entry.message);
     }
+    SECTION("nanoseconds are kept")
+    {
+        auto precise = entry;
+        precise.when += std::chrono::nanoseconds(789);
+        auto out = log_entry_util::to_log_entry_fmt(precise);
+        REQUIRE(out.nanoseconds == 123456789);
+        REQUIRE(out.microseconds() == 123456);
+        REQUIRE(out.milliseconds() == 123);
+    }
+    SECTION("times before the epoch round down")
+    {
+        auto early = entry;
+        early.when = time_point(std::chrono::nanoseconds(-1));
+        auto out = log_entry_util::to_log_entry_fmt(early);
+        REQUIRE(out.time == -1);
+        REQUIRE(out.nanoseconds == 999999999);
+    }
+    SECTION("file base is found unless given")
+    {
+        auto out = log_entry_util::to_log_entry_fmt(entry);
+        REQUIRE(out.line == 123);
+        REQUIRE(out.short_file() == fmtutil::to_view("src/foo/bar.hpp"));
+        auto given = entry;
+        given.file_base = 4;
+        out = log_entry_util::to_log_entry_fmt(given);
+        REQUIRE(out.short_file() == fmtutil::to_view("foo/bar.hpp"));
+        const auto cp = log_entry_util::copy_log_entry(given);
+        REQUIRE(cp.entry.short_file() == fmtutil::to_view("foo/bar.hpp"));
+    }
     SECTION("convert to log_entry_fmt local")
     {
         auto out = log_entry_util::to_log_entry_fmt(entry, true);
@@ -48,7 +202,7 @@ TEST_CASE("logentry: basic")
         REQUIRE(out.time_struct.tm_hour == 23);
         REQUIRE(out.time_struct.tm_min == 34);
         REQUIRE(out.time_struct.tm_sec == 39);
-        REQUIRE(out.microseconds == 123456);
+        REQUIRE(out.nanoseconds == 123456000);
         REQUIRE(out.is_local == true);
         REQUIRE(out.message == entry.message);
     }
@@ -66,12 +220,11 @@ TEST_CASE("logentry: basic")
         REQUIRE(out.time_struct.tm_hour == 3);
         REQUIRE(out.time_struct.tm_min == 34);
         REQUIRE(out.time_struct.tm_sec == 39);
-        REQUIRE(out.microseconds == 123456);
+        REQUIRE(out.nanoseconds == 123456000);
         REQUIRE(out.is_local == false);
         REQUIRE(out.message == entry.message);
         REQUIRE(out.name.begin() != entry.name.begin());
         REQUIRE(out.file.begin() != entry.file.begin());
-        REQUIRE(out.line.begin() != entry.line.begin());
         REQUIRE(out.message.begin() != entry.message.begin());
     }
     SECTION("convert to log_entry_fmt_cp pooled factory")
@@ -91,37 +244,211 @@ TEST_CASE("logentry: basic")
         REQUIRE(out.time_struct.tm_hour == 3);
         REQUIRE(out.time_struct.tm_min == 34);
         REQUIRE(out.time_struct.tm_sec == 39);
-        REQUIRE(out.microseconds == 123456);
+        REQUIRE(out.nanoseconds == 123456000);
         REQUIRE(out.is_local == false);
         REQUIRE(out.message == entry.message);
         REQUIRE(out.name.begin() != entry.name.begin());
         REQUIRE(out.file.begin() != entry.file.begin());
-        REQUIRE(out.line.begin() != entry.line.begin());
         REQUIRE(out.message.begin() != entry.message.begin());
         data.buffer.reset();
         data = log_entry_util::copy_log_entry(entry, false, factory);
         REQUIRE(data.buffer.get() == buff);
     }
-    // SECTION("benchmarks")
-    // {
-    //     auto pooled_fact = pooled_log_buffer_factory::create();
-    //     auto& factory = *pooled_fact;
-    //     BENCHMARK("copying entries default")
-    //     {
-    //         auto out = log_entry_util::copy_log_entry(entry, false);
-    //     };
-    //     BENCHMARK("copying entries pooled")
-    //     {
-    //         auto out = log_entry_util::copy_log_entry(entry, false,
-    //         factory);
-    //     };
-    //     BENCHMARK("default factory")
-    //     {
-    //         default_log_buffer_factory()();
-    //     };
-    //     BENCHMARK("pooled factory")
-    //     {
-    //         factory();
-    //     };
-    // }
+    SECTION("pooled factory size classes")
+    {
+        auto pool = pooled_log_buffer_factory::create();
+        auto small = (*pool)(10);
+        auto mid = (*pool)(3000);
+        const auto& classes = pooled_log_buffer_factory::size_classes;
+        REQUIRE(small->capacity() == classes[0]);
+        REQUIRE(mid->capacity() == classes[1]);
+        auto* mid_ptr = mid.get();
+        const auto resident = pool->stats().bytes_resident;
+        REQUIRE(resident > mid->capacity());
+        mid.reset();
+        REQUIRE((*pool)(2000).get() == mid_ptr);
+        REQUIRE(pool->stats().bytes_resident == resident);
+    }
+    SECTION("pooled factory spills huge entries")
+    {
+        auto pool = pooled_log_buffer_factory::create();
+        std::string huge(100 * 1024, 'x');
+        log_entry big = entry;
+        big.message = fmtutil::to_view(huge);
+        auto data = log_entry_util::copy_log_entry(big, false, *pool);
+        REQUIRE(data.entry.message == big.message);
+        const auto stats = pool->stats();
+        REQUIRE(stats.spilled == 1);
+        REQUIRE(stats.bytes_spilled >= huge.size());
+        REQUIRE(stats.bytes_resident == 0);
+        REQUIRE(stats.truncated == 0);
+    }
+    SECTION("pooled factory truncates huge entries")
+    {
+        log_buffer_pool_config config;
+        config.overflow = log_overflow_policy::truncate;
+        auto pool = pooled_log_buffer_factory::create(config);
+        std::string huge(100 * 1024, 'x');
+        log_entry big = entry;
+        big.message = fmtutil::to_view(huge);
+        auto data = log_entry_util::copy_log_entry(big, false, *pool);
+        REQUIRE(data.buffer->size() ==
+                pooled_log_buffer_factory::size_classes.back());
+        REQUIRE(data.buffer->capacity() ==
+                pooled_log_buffer_factory::size_classes.back());
+        REQUIRE(data.entry.message.size() < huge.size());
+        REQUIRE(data.entry.name == entry.name);
+        const auto stats = pool->stats();
+        REQUIRE(stats.truncated == 1);
+        REQUIRE(stats.spilled == 0);
+    }
+    SECTION("pooled factory counters")
+    {
+        auto pool = pooled_log_buffer_factory::create();
+        {
+            auto a = (*pool)(10);
+            auto b = (*pool)(10);
+        }
+        auto c = (*pool)(10);
+        auto stats = pool->stats();
+        REQUIRE(stats.misses == 2);
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.peak_bytes == stats.bytes_resident);
+        REQUIRE(pool->trim(0) > 0);
+        stats = pool->stats();
+        REQUIRE(stats.bytes_resident < stats.peak_bytes);
+        REQUIRE(stats.bytes_trimmed ==
+                stats.peak_bytes - stats.bytes_resident);
+    }
+    SECTION("pooled factory drops grown buffers without losing count")
+    {
+        auto pool = pooled_log_buffer_factory::create();
+        auto a = (*pool)(100);
+        const auto resident = pool->stats().bytes_resident;
+        REQUIRE(resident > 0);
+        const std::string big(5000, 'x');
+        fmtutil::append(*a, fmtutil::to_view(big));
+        a.reset();
+        REQUIRE(pool->stats().bytes_resident == 0);
+        auto b = (*pool)(100);
+        REQUIRE(pool->stats().bytes_resident == resident);
+    }
+    SECTION("pooled factory trims on release above high watermark")
+    {
+        log_buffer_pool_config config;
+        config.high_watermark = 20 * 1024;
+        config.low_watermark = 0;
+        auto pool = pooled_log_buffer_factory::create(config);
+        auto a = (*pool)(16 * 1024);
+        auto b = (*pool)(4 * 1024);
+        REQUIRE(pool->stats().bytes_resident > config.high_watermark);
+        b.reset();
+        // Only idle nodes are trimmed; `a` is still in use.
+        const auto stats = pool->stats();
+        REQUIRE(stats.bytes_trimmed > 4 * 1024);
+        REQUIRE(stats.bytes_resident < 20 * 1024);
+        a.reset();
+        // Back under the high watermark, so the idle node is kept.
+        REQUIRE(pool->stats().bytes_resident == stats.bytes_resident);
+    }
+    SECTION("pooled factory manual trim policy")
+    {
+        log_buffer_pool_config config;
+        config.trim = log_trim_policy::manual;
+        config.high_watermark = 0;
+        auto pool = pooled_log_buffer_factory::create(config);
+        (*pool)(10).reset();
+        const auto resident = pool->stats().bytes_resident;
+        REQUIRE(resident > 0);
+        REQUIRE(pool->trim() == resident);
+        REQUIRE(pool->stats().bytes_resident == 0);
+    }
+    SECTION("pooled factory memory cap")
+    {
+        log_buffer_pool_config config;
+        config.memory_cap = 8 * 1024;
+        auto pool = pooled_log_buffer_factory::create(config);
+        auto a = (*pool)(4 * 1024);
+        auto b = (*pool)(4 * 1024);
+        REQUIRE(b->capacity() >= 4 * 1024);
+        auto stats = pool->stats();
+        REQUIRE(stats.capped == 1);
+        REQUIRE(stats.bytes_resident <= config.memory_cap);
+        auto* unpooled = b.get();
+        b.reset();
+        a.reset();
+        REQUIRE((*pool)(4 * 1024).get() != unpooled);
+    }
+    SECTION("pooled factory sharding")
+    {
+        for (auto sharding : {log_pool_sharding::none,
+                              log_pool_sharding::numa_node,
+                              log_pool_sharding::cpu}) {
+            log_buffer_pool_config config;
+            config.sharding = sharding;
+            auto pool = pooled_log_buffer_factory::create(config);
+            REQUIRE(pool->shard_count() >= 1);
+            if (sharding == log_pool_sharding::none) {
+                REQUIRE(pool->shard_count() == 1);
+            }
+            {
+                handoff_pair pair{*pool, 0, 1};
+                pair.run(64);
+                const auto resident = pool->stats().bytes_resident;
+                pair.run(64);
+                REQUIRE(pool->stats().bytes_resident >= resident);
+            }
+            auto stats = pool->stats();
+            REQUIRE(stats.misses + stats.hits == 128);
+            REQUIRE(pool->trim(0) == stats.bytes_resident);
+            REQUIRE(pool->stats().bytes_resident == 0);
+        }
+    }
+    SECTION("staging buffer is reused per thread")
+    {
+        log_buffer_t* first = nullptr;
+        {
+            staging_buffer staged;
+            first = &staged.get();
+            fmtutil::append(staged.get(), entry.message);
+            staging_buffer nested;
+            REQUIRE(&nested.get() != first);
+            REQUIRE(nested.get().size() == 0);
+        }
+        staging_buffer staged;
+        REQUIRE(&staged.get() == first);
+        REQUIRE(staged.get().size() == 0);
+    }
+    SECTION("view log entry")
+    {
+        auto data = log_entry_util::view_log_entry(entry);
+        REQUIRE(!data.buffer);
+        REQUIRE(data.entry.message.begin() == entry.message.begin());
+        REQUIRE(data.entry.nanoseconds == 123456000);
+    }
+}
+
+TEST_CASE("logentry: cross-thread release bench", "[.bench]")
+{
+    // Buffers are allocated on CPU 0 and released on the last CPU, which
+    // sits on the other socket on a typical dual-socket box.
+    const auto cpus = std::max(1u, std::thread::hardware_concurrency());
+    const auto far_cpu = cpus - 1;
+    for (auto sharding : {log_pool_sharding::none,
+                          log_pool_sharding::numa_node,
+                          log_pool_sharding::cpu}) {
+        log_buffer_pool_config config;
+        config.sharding = sharding;
+        auto pool = pooled_log_buffer_factory::create(config);
+        const char* name = sharding == log_pool_sharding::none
+                               ? "handoff 4096 - unsharded"
+                               : sharding == log_pool_sharding::numa_node
+                                     ? "handoff 4096 - numa sharded"
+                                     : "handoff 4096 - cpu sharded";
+        handoff_pair pair{*pool, 0, far_cpu};
+        BENCHMARK(name)
+        {
+            pair.run(4096);
+        };
+    }
 }
@@ -0,0 +1,191 @@
+//! @file logfilter.cpp
+
+#include <ldgr/logfilter.hpp>
+#include <ldgr/logsink.hpp>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ldgr;
+
+namespace {
+
+log_entry_fmt_cp make_entry(log_severity sev,
+                            const std::string& cat,
+                            const std::string& msg,
+                            const std::string& file = "src/foo/bar.cpp")
+{
+    log_entry entry{sev,
+                    fmtutil::to_view(cat),
+                    fmtutil::to_view(file),
+                    123,
+                    time_point(std::chrono::microseconds(1598153679123456ll)),
+                    fmtutil::to_view(msg)};
+    return log_entry_util::copy_log_entry(entry);
+}
+
+bool passes(const log_filter& f,
+            log_severity sev,
+            const std::string& cat,
+            const std::string& msg = "msg",
+            const std::string& file = "src/foo/bar.cpp")
+{
+    return f.accepts(make_entry(sev, cat, msg, file).entry);
+}
+
+struct tally_sink final : public log_sink {
+    std::atomic<std::size_t> count{0};
+
+    void do_log(const log_buffer_t&) override
+    {
+        ++count;
+    }
+
+    void do_flush() override
+    {
+    }
+};
+
+} // namespace
+
+TEST_CASE("logfilter: basic")
+{
+    using act = log_filter_action;
+    const auto info = log_severity::info;
+
+    SECTION("no rules accept everything")
+    {
+        log_filter f{{}};
+        REQUIRE(passes(f, log_severity::trace, ""));
+        REQUIRE(passes(f, log_severity::fatal, "ANY.THING"));
+    }
+
+    SECTION("category prefix and exact match")
+    {
+        log_filter f{{{act::accept, "AUTH.*"}, {act::accept, "DB"}}};
+        REQUIRE(passes(f, info, "AUTH.login"));
+        REQUIRE(passes(f, info, "AUTH."));
+        REQUIRE(!passes(f, info, "AUTH"));
+        REQUIRE(!passes(f, info, "AUTHX"));
+        REQUIRE(passes(f, info, "DB"));
+        REQUIRE(!passes(f, info, "DB.pool"));
+        REQUIRE(!passes(f, info, "NET"));
+    }
+
+    SECTION("severity ranges")
+    {
+        log_filter_rule warn_up{act::accept, "*", log_severity::warn};
+        log_filter_rule debug_only{
+            act::accept, "NET*", log_severity::debug, log_severity::debug};
+        log_filter f{{warn_up, debug_only}};
+        REQUIRE(passes(f, log_severity::error, "X"));
+        REQUIRE(!passes(f, info, "X"));
+        REQUIRE(passes(f, log_severity::debug, "NET.io"));
+        REQUIRE(!passes(f, info, "NET.io"));
+    }
+
+    SECTION("reject wins over accept")
+    {
+        log_filter f{{{act::accept, "*"},
+                      {act::reject, "AUTH.secret*"},
+                      {act::reject, "", log_severity::trace,
+                       log_severity::trace}}};
+        REQUIRE(passes(f, info, "AUTH.login"));
+        REQUIRE(!passes(f, info, "AUTH.secret.keys"));
+        REQUIRE(!passes(f, log_severity::trace, "AUTH.login"));
+    }
+
+    SECTION("file, message and regex predicates")
+    {
+        log_filter_rule by_file{act::accept};
+        by_file.file = "/net/";
+        log_filter_rule by_msg{act::accept, "AUTH.*"};
+        by_msg.message = "denied";
+        log_filter_rule noisy{act::reject};
+        noisy.message_regex = "^heartbeat [0-9]+$";
+        log_filter f{{by_file, by_msg, noisy}};
+
+        REQUIRE(passes(f, info, "X", "hello", "src/net/tcp.cpp"));
+        REQUIRE(!passes(f, info, "X", "hello"));
+        REQUIRE(passes(f, info, "AUTH.login", "access denied"));
+        REQUIRE(!passes(f, info, "AUTH.login", "access granted"));
+        REQUIRE(!passes(f, info, "X", "heartbeat 42", "src/net/tcp.cpp"));
+        REQUIRE(passes(f, info, "X", "heartbeat 4x", "src/net/tcp.cpp"));
+
+        log_filter_rule bad{act::accept};
+        bad.message_regex = "(";
+        REQUIRE_THROWS_AS(log_filter{{bad}}, std::regex_error);
+    }
+
+    SECTION("sinks skip filtered records before formatting")
+    {
+        tally_sink sink;
+        REQUIRE(sink.filter() == nullptr);
+        sink.set_filter(std::make_shared<log_filter>(
+            std::vector<log_filter_rule>{{act::accept, "AUTH.*"}}));
+        sink.log(make_entry(info, "AUTH.login", "ok"));
+        sink.log(make_entry(info, "DB", "ok"));
+        REQUIRE(sink.count == 1);
+
+        sink.set_filter(nullptr);
+        sink.log(make_entry(info, "DB", "ok"));
+        REQUIRE(sink.count == 2);
+    }
+
+    SECTION("filters can be swapped while logging")
+    {
+        tally_sink sink;
+        auto only_a = std::make_shared<log_filter>(
+            std::vector<log_filter_rule>{{act::accept, "A"}});
+        auto only_b = std::make_shared<log_filter>(
+            std::vector<log_filter_rule>{{act::accept, "B"}});
+        sink.set_filter(only_a);
+
+        std::atomic<bool> stop{false};
+        std::thread logger([&] {
+            const auto a = make_entry(info, "A", "x");
+            const auto c = make_entry(info, "C", "x");
+            while (!stop) {
+                sink.log(a);
+                sink.log(c);
+            }
+        });
+        for (int i = 0; i < 1000; ++i) {
+            sink.set_filter(i % 2 ? only_a : only_b);
+        }
+        stop = true;
+        logger.join();
+        sink.set_filter(only_b);
+        const auto before = sink.count.load();
+        sink.log(make_entry(info, "A", "x"));
+        REQUIRE(sink.count == before);
+    }
+}
+
+TEST_CASE("logfilter: bench", "[.bench]")
+{
+    using act = log_filter_action;
+    std::vector<log_filter_rule> rules;
+    for (const char* cat : {"AUTH.*", "DB.*", "NET.tcp", "NET.udp", "APP"}) {
+        rules.push_back({act::accept, cat, log_severity::info});
+    }
+    rules.push_back({act::reject, "DB.pool*"});
+    const log_filter f{rules};
+    const auto hit = make_entry(log_severity::warn, "AUTH.login", "msg");
+    const auto miss = make_entry(log_severity::warn, "CACHE.evict", "msg");
+
+    BENCHMARK("accepted record")
+    {
+        return f.accepts(hit.entry);
+    };
+    BENCHMARK("rejected record")
+    {
+        return f.accepts(miss.entry);
+    };
+}
@@ -8,29 +8,252 @@
 #define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include <catch2/catch.hpp>
 
-TEST_CASE("logger: bench")
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <csignal>
+
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool s_had_buffer = false;
+
+void record_ownership(ldgr::log_buffer_t& buff,
+                      const ldgr::log_entry_fmt_cp& ent,
+                      std::time_t&,
+                      std::string&)
+{
+    s_had_buffer = static_cast<bool>(ent.buffer);
+    ldgr::fmtutil::append(buff, ent.entry.message);
+}
+
+struct capture_sink final : public ldgr::log_sink {
+    std::string str;
+    bool async = false;
+
+    capture_sink()
+    {
+        set_formatter(
+            std::make_shared<ldgr::log_formatter>(&record_ownership));
+    }
+
+    bool is_async() const noexcept override
+    {
+        return async;
+    }
+
+    void do_log(const ldgr::log_buffer_t& buff) override
+    {
+        str.append(buff.begin(), buff.end());
+    }
+
+    void do_flush() override
+    {
+    }
+};
+
+struct flush_counting_sink final : public ldgr::log_sink {
+    int flushes = 0;
+    bool log_on_flush = false;
+
+    void do_log(const ldgr::log_buffer_t&) override
+    {
+    }
+
+    void do_flush() override
+    {
+        ++flushes;
+        if (log_on_flush) {
+            LDGR_CAT_INFO("TEST.FLUSH.INNER", "flushing");
+        }
+    }
+};
+
+#if !defined(_WIN32)
+//! Holds records back until flushed, like an asynchronous sink would.
+struct pending_sink final : public ldgr::log_sink {
+    int fd;
+    ldgr::log_buffer_t pending;
+
+    explicit pending_sink(int out): fd(out)
+    {
+    }
+
+    ~pending_sink() override
+    {
+        retire();
+    }
+
+    void do_log(const ldgr::log_buffer_t& buff) override
+    {
+        pending.append(buff.begin(), buff.end());
+    }
+
+    void do_flush() override
+    {
+    }
+
+    void do_emergency_flush() noexcept override
+    {
+        if (::write(fd, pending.data(), pending.size()) > 0) {
+            pending.clear();
+        }
+    }
+};
+#endif
+
+} // namespace
+
+TEST_CASE("logger: basic")
+{
+    auto& l = ldgr::log_registry::get("TEST.LOGGER");
+    l.remove_sink(ldgr::log_sink_factory::stderr_sink());
+    auto sink = std::make_shared<capture_sink>();
+    l.add_sink(sink);
+
+    SECTION("synchronous sinks get a view")
+    {
+        LDGR_CAT_INFO("TEST.LOGGER", "value={}", 42);
+        REQUIRE(sink->str == "value=42");
+        REQUIRE(!s_had_buffer);
+    }
+    SECTION("asynchronous sinks get an owned copy")
+    {
+        auto async_sink = std::make_shared<capture_sink>();
+        async_sink->async = true;
+        l.add_sink(async_sink);
+        LDGR_CAT_INFO("TEST.LOGGER", "value={}", 43);
+        REQUIRE(async_sink->str == "value=43");
+        REQUIRE(s_had_buffer);
+        l.remove_sink(async_sink);
+        LDGR_CAT_INFO("TEST.LOGGER", "value={}", 44);
+        REQUIRE(!s_had_buffer);
+    }
+    SECTION("call site file and line")
+    {
+        sink->set_formatter(std::make_shared<ldgr::log_formatter>(
+            ldgr::log_formatter::as_pattern{}, "%f:%n|%F"));
+        const auto line = __LINE__ + 1;
+        LDGR_CAT_INFO("TEST.LOGGER", "here");
+        constexpr auto file = ldgr::fmtutil::to_view(__FILE__);
+        const auto expected = fmt::format(
+            "{}:{}|{}\n", ldgr::fmtutil::trunc_file(file), line, file);
+        REQUIRE(sink->str == expected);
+    }
+
+    l.remove_sink(sink);
+}
+
+TEST_CASE("logger: fatal flushes sinks")
+{
+    auto& l = ldgr::log_registry::get("TEST.FATAL");
+    l.remove_sink(ldgr::log_sink_factory::stderr_sink());
+    auto sink = std::make_shared<flush_counting_sink>();
+    l.add_sink(sink);
+    LDGR_CAT_ERROR("TEST.FATAL", "not yet");
+    REQUIRE(sink->flushes == 0);
+    LDGR_CAT_FATAL("TEST.FATAL", "now");
+    REQUIRE(sink->flushes == 1);
+    l.remove_sink(sink);
+}
+
+TEST_CASE("logger: sinks may log while flushing")
 {
-    SECTION("info log")
-    {
-        BENCHMARK("perf")
-        {
-            LDGR_INFO("foo: value={}", 42);
-        };
-        BENCHMARK("perf - cat")
-        {
-            LDGR_CAT_INFO("MY.CAT", "foo: value={}", 42);
-        };
-
-        ldgr::log_registry::get("MY.CAT").set_level(ldgr::log_severity::off);
-        BENCHMARK("perf - cat - off")
-        {
-            LDGR_CAT_INFO("MY.CAT", "foo: value={}", 42);
-        };
-        ldgr::log_registry::get("MY.CAT").set_level(ldgr::log_severity::info);
-
-        BENCHMARK("perf - cat - on + custom type")
-        {
-            LDGR_CAT_INFO("MY.CAT", "foo: value={}", Foo{});
-        };
+    auto& l = ldgr::log_registry::get("TEST.FLUSH");
+    l.remove_sink(ldgr::log_sink_factory::stderr_sink());
+    auto sink = std::make_shared<flush_counting_sink>();
+    sink->log_on_flush = true;
+    l.add_sink(sink);
+    ldgr::log_registry::flush_all();
+    REQUIRE(sink->flushes == 1);
+    l.remove_sink(sink);
+}
+
+#if !defined(_WIN32)
+namespace {
+
+volatile int s_depth_limit = 1 << 30;
+
+//! Recurse until the stack runs out, in frames small enough not to step
+//! over the guard page.
+int overflow_stack(int depth)
+{
+    volatile char pad[256];
+    pad[0] = static_cast<char>(depth);
+    if (depth >= s_depth_limit) {
+        return pad[0];
+    }
+    return overflow_stack(depth + 1) + pad[0];
+}
+
+//! Run `crash` in a forked child that logs to a pipe and installs the
+//! crash handler first; returns what the child wrote. The child must die
+//! of SIGSEGV.
+template <class Fn>
+std::string crash_child(Fn crash)
+{
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    const auto pid = ::fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+        ::close(fds[0]);
+        ::signal(SIGSEGV, SIG_DFL);
+        auto& l = ldgr::log_registry::get("TEST.CRASH");
+        l.remove_sink(ldgr::log_sink_factory::stderr_sink());
+        l.add_sink(std::make_shared<pending_sink>(fds[1]));
+        ldgr::log_registry::install_crash_handler(fds[1]);
+        crash();
+        ::_exit(0);
+    }
+    ::close(fds[1]);
+    std::string out;
+    char buf[256];
+    ssize_t n;
+    while ((n = ::read(fds[0], buf, sizeof(buf))) > 0) {
+        out.append(buf, static_cast<std::size_t>(n));
+    }
+    ::close(fds[0]);
+    int status = 0;
+    REQUIRE(::waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFSIGNALED(status));
+    REQUIRE(WTERMSIG(status) == SIGSEGV);
+    return out;
+}
+
+} // namespace
+
+TEST_CASE("logger: crash handler")
+{
+    SECTION("pending records are flushed before the FATAL line")
+    {
+        const auto out = crash_child([] {
+            LDGR_CAT_ERROR("TEST.CRASH", "last words={}", 42);
+            ::raise(SIGSEGV);
+        });
+        const auto flushed = out.find("last words=42");
+        const auto fatal = out.find("[FATAL] ldgr caught SIGSEGV (11)");
+        REQUIRE(flushed != std::string::npos);
+        REQUIRE(fatal != std::string::npos);
+        REQUIRE(flushed < fatal);
+    }
+
+    SECTION("a stack overflow on another thread is reported")
+    {
+        const auto out = crash_child([] {
+            std::thread t{[] {
+                LDGR_CAT_ERROR("TEST.CRASH", "deep");
+                overflow_stack(0);
+            }};
+            t.join();
+        });
+        REQUIRE(out.find("deep") != std::string::npos);
+        REQUIRE(out.find("[FATAL] ldgr caught SIGSEGV (11)") !=
+                std::string::npos);
     }
 }
+#endif
@@ -0,0 +1,229 @@
+//! @file logmetrics.cpp
+
+#include <ldgr/logger.hpp>
+#include <ldgr/logmetrics.hpp>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ldgr;
+
+namespace {
+
+struct lines_sink final : public log_sink {
+    std::mutex mutex;
+    std::vector<std::string> lines;
+
+    lines_sink()
+    {
+        set_formatter(std::make_shared<log_formatter>(
+            [](log_buffer_t& buff,
+               const log_entry_fmt_cp& ent,
+               std::time_t&,
+               std::string&) { fmtutil::append(buff, ent.entry.message); }));
+    }
+
+    void do_log(const log_buffer_t& buff) override
+    {
+        const std::lock_guard<std::mutex> guard{mutex};
+        lines.emplace_back(buff.data(), buff.size());
+    }
+
+    void do_flush() override
+    {
+    }
+};
+
+const log_metrics_report::logger_metrics*
+find_logger(const log_metrics_report& report, const std::string& name)
+{
+    for (const auto& l : report.loggers) {
+        if (l.name == name) {
+            return &l;
+        }
+    }
+    return nullptr;
+}
+
+//! Fails every write, counting the attempts.
+struct throwing_sink final : public log_sink {
+    std::atomic<int> attempts{0};
+
+    void do_log(const log_buffer_t&) override
+    {
+        ++attempts;
+        throw std::runtime_error("disk full");
+    }
+
+    void do_flush() override
+    {
+    }
+};
+
+} // namespace
+
+TEST_CASE("logmetrics: histogram")
+{
+    SECTION("buckets are contiguous and within 12.5%")
+    {
+        std::size_t prev = 0;
+        for (std::uint64_t v = 0; v < 100000; ++v) {
+            const auto b = log_histogram::bucket_of(v);
+            REQUIRE((b == prev || b == prev + 1));
+            REQUIRE(log_histogram::bucket_upper(b) >= v);
+            REQUIRE(log_histogram::bucket_upper(b) <= v + v / 8);
+            prev = b;
+        }
+        REQUIRE(log_histogram::bucket_of(~std::uint64_t{0}) ==
+                log_histogram::bucket_count - 1);
+    }
+
+    SECTION("percentiles")
+    {
+        log_histogram h;
+        REQUIRE(h.percentile(0.5) == 0);
+        for (std::uint64_t v = 1; v <= 1000; ++v) {
+            const auto b = log_histogram::bucket_of(v);
+            ++h.counts[b];
+            ++h.count;
+            h.sum_ns += v;
+            h.max_ns = std::max(h.max_ns, v);
+        }
+        const auto p50 = h.percentile(0.5);
+        REQUIRE(p50 >= 500);
+        REQUIRE(p50 <= 500 + 500 / 8);
+        REQUIRE(h.percentile(1.0) == 1000);
+        REQUIRE(h.mean() == Approx(500.5));
+
+        log_histogram sum;
+        sum.merge(h);
+        sum.merge(h);
+        REQUIRE(sum.count == 2000);
+        REQUIRE(sum.percentile(0.5) == p50);
+    }
+}
+
+#if defined(LDGR_HAVE_METRICS)
+
+TEST_CASE("logmetrics: basic")
+{
+    log_metrics::set_sample_period(1);
+    auto& l = log_registry::get("METRICS.BASIC");
+    auto sink = std::make_shared<lines_sink>();
+    l.remove_sink(log_sink_factory::stderr_sink());
+    l.add_sink(sink);
+    l.set_level(log_severity::info);
+    sink->set_level(log_severity::warn);
+
+    SECTION("loggers and sinks count and time records")
+    {
+        const auto before = l.metrics().snapshot();
+        const auto sink_before = sink->metrics().snapshot();
+        LDGR_CAT_DEBUG("METRICS.BASIC", "filtered by the logger");
+        LDGR_CAT_INFO("METRICS.BASIC", "filtered by the sink");
+        LDGR_CAT_WARN("METRICS.BASIC", "12345");
+
+        const auto after = l.metrics().snapshot();
+        REQUIRE(after.logged - before.logged == 2);
+        REQUIRE(after.filtered - before.filtered == 1);
+        REQUIRE(after.call.count - before.call.count == 2);
+
+        const auto m = sink->metrics().snapshot();
+        REQUIRE(m.logged - sink_before.logged == 1);
+        REQUIRE(m.filtered - sink_before.filtered == 1);
+        REQUIRE(m.bytes - sink_before.bytes == 5);
+        REQUIRE(m.format.count - sink_before.format.count == 1);
+        REQUIRE(m.write.count - sink_before.write.count == 1);
+    }
+
+    SECTION("per-thread shards are merged on read")
+    {
+        const auto before = l.metrics().snapshot().logged;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 40; ++t) {
+            threads.emplace_back([] {
+                for (int i = 0; i < 250; ++i) {
+                    LDGR_CAT_WARN("METRICS.BASIC", "x");
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        REQUIRE(l.metrics().snapshot().logged - before == 10000);
+    }
+
+    SECTION("registry report and reporter")
+    {
+        LDGR_CAT_WARN("METRICS.BASIC", "x");
+        const auto report = log_registry::metrics();
+        const auto* entry = find_logger(report, "METRICS.BASIC");
+        REQUIRE(entry);
+        REQUIRE(entry->metrics.logged > 0);
+        const auto it = std::find_if(
+            report.sinks.begin(), report.sinks.end(), [&](const auto& s) {
+                return s.sink == sink;
+            });
+        REQUIRE(it != report.sinks.end());
+        REQUIRE(it->loggers == std::vector<std::string>{"METRICS.BASIC"});
+
+        auto out = std::make_shared<lines_sink>();
+        {
+            log_metrics_reporter reporter{out, std::chrono::hours(1)};
+            reporter.report();
+        }
+        // One explicit report, one final report on destruction.
+        const auto lines = out->lines;
+        const auto hits = std::count_if(
+            lines.begin(), lines.end(), [](const std::string& line) {
+                return line.rfind("logger METRICS.BASIC logged=", 0) == 0;
+            });
+        REQUIRE(hits == 2);
+    }
+
+    SECTION("a failing report doesn't stop the reporter")
+    {
+        auto out = std::make_shared<throwing_sink>();
+        {
+            log_metrics_reporter reporter{out, std::chrono::milliseconds(1)};
+            const auto until =
+                std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (out->attempts < 2 &&
+                   std::chrono::steady_clock::now() < until) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        REQUIRE(out->attempts >= 2);
+    }
+
+    l.remove_sink(sink);
+    log_metrics::set_sample_period(16);
+}
+
+#endif
+
+TEST_CASE("logmetrics: bench", "[.bench]")
+{
+    log_metrics m;
+
+    BENCHMARK("counter add")
+    {
+        m.add(log_metrics::logged);
+    };
+    BENCHMARK("sampled timer")
+    {
+        const log_metrics_timer t{m, log_metrics::call};
+    };
+    BENCHMARK("filtered log statement")
+    {
+        LDGR_CAT_DEBUG("METRICS.BENCH", "{}", 42);
+    };
+}
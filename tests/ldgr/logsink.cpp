@@ -20,9 +20,31 @@ struct string_sink final : public log_sink {
     }
 };
 
+//! Counts emergency flushes; `retire_now` stands in for the start of a
+//! destructor.
+struct flush_counting_sink final : public log_sink {
+    int flushes = 0;
+
+    void retire_now() noexcept
+    {
+        retire();
+    }
+
+    void do_log(const log_buffer_t&) override
+    {
+    }
+
+    void do_flush() override
+    {
+    }
+
+    void do_emergency_flush() noexcept override
+    {
+        ++flushes;
+    }
+};
+
 #define __SEV(x) ::ldgr::log_severity::x
-#define __STR2(x) #x
-#define __STR(x) __STR2(x)
 
 #define LOG(cat, lvl, fmtstr, ...)                                            \
     do {                                                                      \
@@ -32,7 +54,7 @@ struct string_sink final : public log_sink {
         ::ldgr::log_entry entry{__SEV(lvl),                                   \
                                 ::ldgr::fmtutil::to_view(cat),                \
                                 ::ldgr::fmtutil::to_view(__FILE__),           \
-                                ::ldgr::fmtutil::to_view(__STR(__LINE__)),    \
+                                __LINE__,                                     \
                                 ::std::chrono::system_clock::now(),           \
                                 ::ldgr::fmtutil::to_view(buff)};              \
         auto cp =                                                             \
@@ -47,7 +69,7 @@ TEST_CASE("logsink: basic")
     log_entry entry{log_severity::info,
                     fmtutil::to_view("LOG.CAT"),
                     fmtutil::to_view("abc/src/foo/bar.hpp"),
-                    fmtutil::to_view("123"),
+                    123,
                     time_point(std::chrono::microseconds(1598153679123456ll)),
                     fmtutil::to_view("foo")};
 
@@ -59,60 +81,104 @@ TEST_CASE("logsink: basic")
     SECTION("log into string, default formatter")
     {
         sink.log(cp);
-        REQUIRE(fmtutil::to_view(sink.str) ==
-                fmtutil::to_view("2020-08-23 03:34:39.123456Z [ INFO] LOG.CAT "
-                                 "src/foo/bar.hpp:123 foo\n"));
+        REQUIRE(sink.str == fmt::format("2020-08-23 03:34:39.123456Z [ INFO] "
+                                        "[{}] LOG.CAT src/foo/bar.hpp:123 "
+                                        "foo\n",
+                                        log_thread::id()));
+    }
+    SECTION("default formatter shows the thread")
+    {
+        auto named = cp;
+        named.entry.thread_id = 42;
+        named.entry.thread_name = fmtutil::to_view("worker");
+        sink.log(named);
+        named.entry.cpu = 3;
+        sink.log(named);
+        REQUIRE(sink.str.find("[ INFO] [42:worker] LOG.CAT") !=
+                std::string::npos);
+        REQUIRE(sink.str.find("[ INFO] [42:worker@3] LOG.CAT") !=
+                std::string::npos);
     }
-    // SECTION("bench it!")
-    // {
-    // BENCHMARK("default fmt")
-    // {
-    //     sink.str.clear();
-    //     sink.log(cp);
-    // };
-    // sink.set_formatter(std::make_shared<log_formatter>(
-    //     [](log_buffer_t& buff, const log_entry_fmt_cp& ent) {
-    //         const auto& e = ent.entry;
-    //         fmtutil::append(buff, e.time_struct);
-    //         fmtutil::append(buff, '.');
-    //         fmtutil::append_pad_int<6>(buff, e.microseconds);
-    //         if (!e.is_local) {
-    //             fmtutil::append(buff, 'Z');
-    //         }
-    //         fmt::format_to(std::back_inserter(buff),
-    //                        FMT_COMPILE(" [{:>5}] {} {}:{} {}\n"),
-    //                        fmtutil::to_view(e.severity),
-    //                        e.name,
-    //                        fmtutil::trunc_file(e.file),
-    //                        e.line,
-    //                        e.message);
-    //     }));
-    // sink.str.clear();
-    // sink.log(cp);
-    // REQUIRE(fmtutil::to_view(sink.str) ==
-    //         fmtutil::to_view("2020-08-23 03:34:39.123456Z [ INFO]
-    //                          LOG.CAT "
-    //                                  "foo/bar.hpp:123 foo\n"));
-    // BENCHMARK("using fmt_compile")
-    // {
-    //     sink.str.clear();
-    //     sink.log(cp);
-    // };
-    // }
-    // SECTION("bench it! - stderr sink")
-    // {
-    //     auto err_sink = log_sink_factory::stderr_sink();
-    //     BENCHMARK("stderr sink")
-    //     {
-    //         err_sink->log(cp);
-    //     };
-    // }
-    // SECTION("bench it! - stderr sink")
-    // {
-    //     auto err_sink = log_sink_factory::stderr_sink();
-    //     BENCHMARK("stderr sink")
-    //     {
-    //         LOG("MY.CAT", info, "foo");
-    //     };
-    // }
+    SECTION("formatters at other precisions")
+    {
+        auto precise = entry;
+        precise.when += std::chrono::nanoseconds(789);
+        auto ns = log_entry_util::copy_log_entry(precise);
+        sink.set_formatter(std::make_shared<log_formatter>(
+            &default_formatter_at<time_precision::nanoseconds>));
+        sink.log(ns);
+        REQUIRE(sink.str.find("2020-08-23 03:34:39.123456789Z [ INFO]") == 0);
+
+        sink.str.clear();
+        sink.set_formatter(std::make_shared<log_formatter>(
+            &default_formatter_at<time_precision::seconds>));
+        sink.log(ns);
+        REQUIRE(sink.str.find("2020-08-23 03:34:39Z [ INFO]") == 0);
+
+        sink.str.clear();
+        sink.set_formatter(std::make_shared<log_formatter>(
+            &json_formatter_at<time_precision::milliseconds>));
+        sink.log(ns);
+        REQUIRE(sink.str.find("{\"time\":\"2020-08-23T03:34:39.123Z\"") ==
+                0);
+    }
+    SECTION("pattern timestamp precision")
+    {
+        auto precise = entry;
+        precise.when += std::chrono::nanoseconds(789);
+        sink.set_formatter(std::make_shared<log_formatter>(
+            log_formatter::as_pattern{},
+            "%d{s}|%d{ms}|%d|%i{ns}|%d{xx}"));
+        sink.log(log_entry_util::copy_log_entry(precise));
+        REQUIRE(sink.str == "2020-08-23 03:34:39Z|2020-08-23 03:34:39.123Z|"
+                            "2020-08-23 03:34:39.123456Z|"
+                            "2020-08-23T03:34:39.123456789Z|"
+                            "2020-08-23 03:34:39.123456Z{xx}\n");
+    }
+    SECTION("syslog formatter")
+    {
+        sink.set_formatter(std::make_shared<log_formatter>(&syslog_formatter));
+        sink.log(cp);
+        const std::string prefix = "<14>1 2020-08-23T03:34:39.123456Z ";
+        const std::string suffix = " LOG.CAT - src/foo/bar.hpp:123 foo";
+        REQUIRE(sink.str.compare(0, prefix.size(), prefix) == 0);
+        REQUIRE(sink.str.size() > prefix.size() + suffix.size());
+        REQUIRE(sink.str.compare(
+                    sink.str.size() - suffix.size(), suffix.size(), suffix) ==
+                0);
+    }
+    SECTION("journald formatter")
+    {
+        sink.set_formatter(
+            std::make_shared<log_formatter>(&journald_formatter));
+        sink.log(cp);
+        REQUIRE(sink.str.find("PRIORITY=6\n") == 0);
+        REQUIRE(sink.str.find("\nLDGR_CATEGORY=LOG.CAT\n") !=
+                std::string::npos);
+        REQUIRE(sink.str.find("\nCODE_LINE=123\n") != std::string::npos);
+        REQUIRE(sink.str.find("\nMESSAGE=foo\n") != std::string::npos);
+
+        entry.message = fmtutil::to_view("two\nlines");
+        auto multi = log_entry_util::copy_log_entry(entry);
+        sink.str.clear();
+        sink.log(multi);
+        const char binary[] = "\nMESSAGE\n\x09\0\0\0\0\0\0\0two\nlines\n";
+        REQUIRE(sink.str.find(binary, 0, sizeof(binary) - 1) !=
+                std::string::npos);
+    }
+}
+
+TEST_CASE("logsink: live sinks")
+{
+    flush_counting_sink sink;
+    const auto flush_all = [] {
+        log_sink::for_each_live(
+            [](log_sink& s) noexcept { s.emergency_flush(); });
+    };
+    flush_all();
+    REQUIRE(sink.flushes == 1);
+    sink.retire_now();
+    flush_all();
+    REQUIRE(sink.flushes == 1);
+    sink.retire_now(); // idempotent, and the destructor retires again
 }
@@ -0,0 +1,234 @@
+//! @file logsite.cpp
+
+#include <ldgr/logger.hpp>
+#include <ldgr/logsite.hpp>
+#include <ldgr/memsink.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <regex>
+#include <string>
+#include <vector>
+
+using namespace ldgr;
+
+namespace {
+
+const log_site* s_site = nullptr;
+bool s_copied_site_strings = false;
+
+void record_site(log_buffer_t& buff,
+                 const log_entry_fmt_cp& ent,
+                 std::time_t&,
+                 std::string&)
+{
+    const auto& e = ent.entry;
+    s_site = e.site;
+    s_copied_site_strings =
+        e.site && (e.name.data() != e.site->category.data() ||
+                   e.file.data() != e.site->file.data());
+    fmtutil::append(buff, e.message);
+}
+
+struct site_sink final : public log_sink {
+    bool async = false;
+
+    site_sink()
+    {
+        set_formatter(std::make_shared<log_formatter>(&record_site));
+    }
+
+    bool is_async() const noexcept override
+    {
+        return async;
+    }
+
+    void do_log(const log_buffer_t&) override
+    {
+    }
+
+    void do_flush() override
+    {
+    }
+};
+
+} // namespace
+
+TEST_CASE("logsite: basic")
+{
+    SECTION("descriptor")
+    {
+        using args = decltype(dtl::log_site_args(
+            1, 2u, 2.5, true, 'c', "str", std::string{}, nullptr));
+        static constexpr auto site =
+            dtl::make_log_site<args>(log_severity::warn,
+                                     fmtutil::to_view("SITE.CAT"),
+                                     fmtutil::to_view("a/b/c/d.cpp"),
+                                     42,
+                                     fmt::string_view{"{} {}"});
+        static_assert(site.line == 42);
+        static_assert(site.arg_count == 8);
+        REQUIRE(site.short_file() == fmtutil::to_view("b/c/d.cpp"));
+        REQUIRE(site.arg_types[0] == log_arg_type::signed_integer);
+        REQUIRE(site.arg_types[1] == log_arg_type::unsigned_integer);
+        REQUIRE(site.arg_types[2] == log_arg_type::floating);
+        REQUIRE(site.arg_types[3] == log_arg_type::boolean);
+        REQUIRE(site.arg_types[4] == log_arg_type::character);
+        REQUIRE(site.arg_types[5] == log_arg_type::string);
+        REQUIRE(site.arg_types[6] == log_arg_type::string);
+        REQUIRE(site.arg_types[7] == log_arg_type::pointer);
+
+        using none = decltype(dtl::log_site_args());
+        REQUIRE(none::types.size() == 0);
+    }
+
+    SECTION("records point at their call site")
+    {
+        auto& l = log_registry::get("SITE.BASIC");
+        l.remove_sink(log_sink_factory::stderr_sink());
+        auto sink = std::make_shared<site_sink>();
+        sink->async = true;
+        l.add_sink(sink);
+
+        const auto line = __LINE__ + 1;
+        LDGR_CAT_INFO("SITE.BASIC", "n={}", 3);
+        REQUIRE(s_site != nullptr);
+        REQUIRE(s_site->severity == log_severity::info);
+        REQUIRE(s_site->category == fmtutil::to_view("SITE.BASIC"));
+        REQUIRE(s_site->line == static_cast<std::uint32_t>(line));
+        REQUIRE(s_site->format == fmtutil::to_view("n={}"));
+        REQUIRE(s_site->arg_count == 1);
+        REQUIRE(!s_copied_site_strings);
+
+        const auto* first = s_site;
+        const log_site* loop_sites[2] = {};
+        for (auto& site : loop_sites) {
+            LDGR_CAT_INFO("SITE.BASIC", "loop");
+            site = s_site;
+        }
+        REQUIRE(loop_sites[0] == loop_sites[1]);
+        REQUIRE(loop_sites[0] != first);
+        l.remove_sink(sink);
+    }
+
+    SECTION("runtime categories name each record")
+    {
+        auto sink = log_sink_factory::capture_sink(16);
+        sink->set_formatter(std::make_shared<log_formatter>(
+            log_formatter::as_pattern{}, "%c %m"));
+        for (const char* name : {"SITE.RT.A", "SITE.RT.B"}) {
+            auto& l = log_registry::get(name);
+            l.remove_sink(log_sink_factory::stderr_sink());
+            l.add_sink(sink);
+        }
+        const auto by_string = [](const std::string& cat) {
+            LDGR_CAT_INFO(cat, "string");
+        };
+        const auto by_pointer = [](const char* cat) {
+            LDGR_CAT_INFO(cat, "pointer");
+        };
+        by_string("SITE.RT.A");
+        by_string(std::string{"SITE.RT.B"});
+        by_pointer("SITE.RT.A");
+        by_pointer(std::string{"SITE.RT.B"}.c_str());
+        REQUIRE(sink->records() ==
+                std::vector<std::string>{"SITE.RT.A string\n",
+                                         "SITE.RT.B string\n",
+                                         "SITE.RT.A pointer\n",
+                                         "SITE.RT.B pointer\n"});
+        for (const char* name : {"SITE.RT.A", "SITE.RT.B"}) {
+            log_registry::get(name).remove_sink(sink);
+        }
+    }
+}
+
+TEST_CASE("logsite: switches")
+{
+    auto& l = log_registry::get("SITE.SWITCH");
+    l.remove_sink(log_sink_factory::stderr_sink());
+    l.set_level(log_severity::info);
+    auto sink = log_sink_factory::capture_sink(16);
+    sink->set_formatter(std::make_shared<log_formatter>(
+        log_formatter::as_pattern{}, "%m"));
+    l.add_sink(sink);
+
+    const auto debug_line = __LINE__ + 3;
+    const auto log_both = [] {
+        LDGR_CAT_INFO("SITE.SWITCH", "info");
+        LDGR_CAT_DEBUG("SITE.SWITCH", "debug");
+    };
+
+    SECTION("sites follow the level until switched")
+    {
+        log_both();
+        REQUIRE(sink->records() == std::vector<std::string>{"info\n"});
+
+        const auto key = fmt::format("*logsite.cpp:{}", debug_line);
+        REQUIRE(log_sites::set(key, log_site_mode::on) == 1);
+        log_both();
+        REQUIRE(sink->records() ==
+                std::vector<std::string>{"info\n", "info\n", "debug\n"});
+
+        REQUIRE(log_sites::set("SITE.SWITCH", log_site_mode::off) == 2);
+        log_both();
+        REQUIRE(sink->total() == 3);
+
+        log_sites::reset();
+        log_both();
+        REQUIRE(sink->total() == 4);
+    }
+
+    SECTION("runtime-category sites switch by file and line")
+    {
+        const auto line = __LINE__ + 2;
+        const auto log_as = [](const std::string& cat) {
+            LDGR_CAT_DEBUG(cat, "runtime");
+        };
+        log_as("SITE.SWITCH");
+        REQUIRE(sink->total() == 0);
+
+        const log_site* found = nullptr;
+        for (const auto* site : log_sites::list()) {
+            if (site->line == static_cast<std::uint32_t>(line) &&
+                site->format == fmtutil::to_view("runtime")) {
+                found = site;
+            }
+        }
+        REQUIRE(found != nullptr);
+        REQUIRE(found->category.size() == 0);
+
+        log_sites::set("SITE.SWITCH", log_site_mode::on);
+        log_as("SITE.SWITCH");
+        REQUIRE(sink->total() == 0);
+
+        log_sites::set(fmt::format("*logsite.cpp:{}", line),
+                       log_site_mode::on);
+        log_as("SITE.SWITCH");
+        REQUIRE(sink->records() == std::vector<std::string>{"runtime\n"});
+        log_sites::reset();
+    }
+
+    SECTION("rules apply to sites reached later")
+    {
+        REQUIRE(log_sites::set_regex("^SITE\\.LATE$", log_site_mode::on) ==
+                0);
+        auto& late = log_registry::get("SITE.LATE");
+        late.remove_sink(log_sink_factory::stderr_sink());
+        late.set_level(log_severity::off);
+        late.add_sink(sink);
+        LDGR_CAT_TRACE("SITE.LATE", "late");
+        REQUIRE(sink->records() == std::vector<std::string>{"late\n"});
+        late.remove_sink(sink);
+
+        bool listed = false;
+        for (const auto* site : log_sites::list()) {
+            listed = listed || site->category == fmtutil::to_view("SITE.LATE");
+        }
+        REQUIRE(listed);
+        REQUIRE_THROWS_AS(log_sites::set_regex("(", log_site_mode::on),
+                          std::regex_error);
+        log_sites::reset();
+    }
+
+    l.remove_sink(sink);
+}
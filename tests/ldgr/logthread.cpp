@@ -0,0 +1,121 @@
+//! @file logthread.cpp
+
+#include <ldgr/logger.hpp>
+#include <ldgr/logthread.hpp>
+#include <ldgr/memsink.hpp>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace ldgr;
+
+TEST_CASE("logthread: basic")
+{
+    SECTION("ids are cached per thread")
+    {
+        const auto id = log_thread::id();
+        REQUIRE(id != 0);
+        REQUIRE(log_thread::id() == id);
+#if defined(__linux__)
+        REQUIRE(id == static_cast<std::uint32_t>(::syscall(SYS_gettid)));
+#endif
+        std::uint32_t other = 0;
+        std::thread t{[&other] { other = log_thread::id(); }};
+        t.join();
+        REQUIRE(other != 0);
+        REQUIRE(other != id);
+    }
+
+#if defined(__linux__)
+    SECTION("a forked child looks its id up again")
+    {
+        const auto parent = log_thread::id();
+        const auto pid = ::fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) {
+            const auto id = log_thread::id();
+            const bool ok = id != parent &&
+                            id == static_cast<std::uint32_t>(::getpid());
+            ::_exit(ok ? 0 : 1);
+        }
+        int status = 0;
+        REQUIRE(::waitpid(pid, &status, 0) == pid);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+#endif
+
+    SECTION("names")
+    {
+        std::string unnamed = "?";
+        std::string named;
+        std::thread t{[&] {
+            unnamed = std::string{log_thread::name().data(),
+                                  log_thread::name().size()};
+            log_thread::set_name("worker-7");
+            named = std::string{log_thread::name().data(),
+                                log_thread::name().size()};
+        }};
+        t.join();
+        // Threads only inherit the process name, which is not reported.
+        REQUIRE(unnamed.empty());
+        REQUIRE(named == "worker-7");
+    }
+
+    SECTION("cpu capture")
+    {
+        REQUIRE(log_thread::captured_cpu() == -1);
+        log_thread::set_capture_cpu(true);
+        const auto cpu = log_thread::captured_cpu();
+        log_thread::set_capture_cpu(false);
+#if defined(__linux__)
+        REQUIRE(cpu >= 0);
+#endif
+        REQUIRE(log_thread::captured_cpu() == -1);
+    }
+
+    SECTION("records carry the thread")
+    {
+        auto& l = log_registry::get("LOGTHREAD.BASIC");
+        auto sink = log_sink_factory::capture_sink();
+        sink->set_formatter(std::make_shared<log_formatter>(
+            log_formatter::as_pattern{}, "%t %T %P"));
+        l.remove_sink(log_sink_factory::stderr_sink());
+        l.add_sink(sink);
+
+        std::uint32_t id = 0;
+        std::thread t{[&id] {
+            log_thread::set_name("pool-1");
+            id = log_thread::id();
+            LDGR_CAT_INFO("LOGTHREAD.BASIC", "x");
+        }};
+        t.join();
+        REQUIRE(sink->records() ==
+                std::vector<std::string>{std::to_string(id) + " pool-1 -1\n"});
+        l.remove_sink(sink);
+    }
+}
+
+TEST_CASE("logthread: bench", "[.bench]")
+{
+    BENCHMARK("id and name")
+    {
+        return log_thread::id() + log_thread::name().size();
+    };
+    log_thread::set_capture_cpu(true);
+    BENCHMARK("cpu")
+    {
+        return log_thread::captured_cpu();
+    };
+    log_thread::set_capture_cpu(false);
+}
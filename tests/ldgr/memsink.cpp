@@ -0,0 +1,98 @@
+//! @file memsink.cpp
+
+#include <ldgr/memsink.hpp>
+
+#include "fixtures.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ldgr;
+using ldgr_test::make_entry;
+
+namespace {
+
+void message_only(log_sink& sink)
+{
+    sink.set_formatter(std::make_shared<log_formatter>(
+        [](log_buffer_t& buff,
+           const log_entry_fmt_cp& ent,
+           std::time_t&,
+           std::string&) { fmtutil::append(buff, ent.entry.message); }));
+}
+
+} // namespace
+
+TEST_CASE("memsink: basic")
+{
+    SECTION("null sink")
+    {
+        auto sink = log_sink_factory::null_sink();
+        sink->log(make_entry("dropped"));
+        sink->flush();
+        auto raw = log_sink_factory::null_sink(false);
+        raw->log(make_entry("dropped"));
+    }
+
+    SECTION("capture sink keeps the newest records")
+    {
+        auto sink = log_sink_factory::capture_sink(3);
+        message_only(*sink);
+        REQUIRE(sink->capacity() == 3);
+        REQUIRE(sink->records().empty());
+
+        for (int i = 0; i < 5; ++i) {
+            sink->log(make_entry(std::to_string(i)));
+        }
+        REQUIRE(sink->total() == 5);
+        REQUIRE(sink->records() == std::vector<std::string>{"2", "3", "4"});
+
+        auto* tmp = std::tmpfile();
+        REQUIRE(tmp);
+        sink->dump(tmp);
+        std::rewind(tmp);
+        char buf[16] = {};
+        REQUIRE(std::fread(buf, 1, sizeof(buf) - 1, tmp) == 3);
+        REQUIRE(std::string{buf} == "234");
+        std::fclose(tmp);
+
+        sink->clear();
+        REQUIRE(sink->total() == 0);
+        REQUIRE(sink->records().empty());
+        sink->log(make_entry("5"));
+        REQUIRE(sink->records() == std::vector<std::string>{"5"});
+    }
+
+    SECTION("counting sink sums across threads")
+    {
+        auto sink = log_sink_factory::counting_sink();
+        message_only(*sink);
+        std::vector<std::thread> threads;
+        // More threads than metrics slots, so the shared cell is used too.
+        for (int t = 0; t < 40; ++t) {
+            threads.emplace_back([&sink] {
+                for (int i = 0; i < 250; ++i) {
+                    sink->log(make_entry("abcd"));
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        REQUIRE(sink->records() == 10000);
+        REQUIRE(sink->bytes() == 40000);
+    }
+
+    SECTION("counting sink without formatting")
+    {
+        auto sink = log_sink_factory::counting_sink(false);
+        sink->log(make_entry("abcd"));
+        sink->log(make_entry("abcd"));
+        REQUIRE(sink->records() == 2);
+        REQUIRE(sink->bytes() == 0);
+    }
+}
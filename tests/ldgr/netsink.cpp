@@ -0,0 +1,277 @@
+//! @file netsink.cpp
+
+#include <ldgr/netsink.hpp>
+
+#include "fixtures.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace ldgr;
+using ldgr_test::make_entry;
+
+namespace {
+
+template <class PRED>
+bool wait_for(PRED pred)
+{
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+//! Loopback collector: one listening socket, one accepted connection.
+struct collector {
+    int listen_fd{-1};
+    int fd{-1};
+    unsigned short port{0};
+    std::string path;
+    std::string data;
+
+    //! TCP on 127.0.0.1; port 0 picks a free one.
+    explicit collector(unsigned short p)
+    {
+        listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        const int one = 1;
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(p);
+        REQUIRE(::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr),
+                       sizeof(addr)) == 0);
+        socklen_t len = sizeof(addr);
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+        port = ntohs(addr.sin_port);
+        REQUIRE(::listen(listen_fd, 4) == 0);
+    }
+
+    //! Unix stream socket at `p`.
+    explicit collector(const std::string& p): path(p)
+    {
+        ::unlink(path.c_str());
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::snprintf(
+            addr.sun_path, sizeof(addr.sun_path), "%s", path.c_str());
+        REQUIRE(::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr),
+                       sizeof(addr)) == 0);
+        REQUIRE(::listen(listen_fd, 4) == 0);
+    }
+
+    ~collector()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        ::close(listen_fd);
+        if (!path.empty()) {
+            ::unlink(path.c_str());
+        }
+    }
+
+    //! Read until `done(data)` holds or five seconds pass.
+    template <class PRED>
+    bool read_until(PRED done)
+    {
+        const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!done(data)) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            pollfd pfd{fd >= 0 ? fd : listen_fd, POLLIN, 0};
+            if (::poll(&pfd, 1, 50) <= 0) {
+                continue;
+            }
+            if (fd < 0) {
+                fd = ::accept(listen_fd, nullptr, nullptr);
+                continue;
+            }
+            char buff[4096];
+            const auto n = ::read(fd, buff, sizeof(buff));
+            if (n <= 0) {
+                ::close(fd);
+                fd = -1;
+                continue;
+            }
+            data.append(buff, static_cast<std::size_t>(n));
+        }
+        return true;
+    }
+
+    //! Split `data` into length-prefixed frames.
+    static std::vector<std::string> frames(const std::string& data)
+    {
+        std::vector<std::string> out;
+        std::size_t pos = 0;
+        while (pos + 4 <= data.size()) {
+            const auto* p = reinterpret_cast<const unsigned char*>(&data[pos]);
+            const std::size_t len = (std::size_t{p[0]} << 24) |
+                                    (std::size_t{p[1]} << 16) |
+                                    (std::size_t{p[2]} << 8) | p[3];
+            if (pos + 4 + len > data.size()) {
+                break;
+            }
+            out.emplace_back(data, pos + 4, len);
+            pos += 4 + len;
+        }
+        return out;
+    }
+};
+
+net_sink_config fast_reconnect()
+{
+    net_sink_config cfg;
+    cfg.backoff_min = std::chrono::milliseconds(5);
+    cfg.backoff_max = std::chrono::milliseconds(20);
+    return cfg;
+}
+
+} // namespace
+
+#if defined(LDGR_HAVE_LIBUV)
+
+TEST_CASE("netsink: basic")
+{
+    SECTION("length-prefixed records over tcp")
+    {
+        collector coll{0};
+        auto sink = net_sink::tcp("127.0.0.1", coll.port);
+        for (int i = 0; i < 3; ++i) {
+            sink->log(make_entry("rec " + std::to_string(i)));
+        }
+        REQUIRE(coll.read_until([](const std::string& d) {
+            return collector::frames(d).size() == 3;
+        }));
+        const auto frames = collector::frames(coll.data);
+        for (int i = 0; i < 3; ++i) {
+            REQUIRE(frames[i].find("TEST src/foo/bar.hpp:123 rec " +
+                                   std::to_string(i) + "\n") !=
+                    std::string::npos);
+        }
+        REQUIRE(sink->stats().enqueued == 3);
+        REQUIRE(sink->stats().connects == 1);
+    }
+
+    SECTION("json lines over a unix socket")
+    {
+        collector coll{"/tmp/ldgr-test-net-" + std::to_string(::getpid())};
+        net_sink_config cfg;
+        cfg.framing = net_framing::json_lines;
+        auto sink = net_sink::unix_socket(coll.path, cfg);
+        sink->log(make_entry("say \"hi\""));
+        REQUIRE(coll.read_until(
+            [](const std::string& d) { return d.find('\n') != d.npos; }));
+        REQUIRE(coll.data.front() == '{');
+        REQUIRE(coll.data.find("\"message\":\"say \\\"hi\\\"\"}\n") !=
+                std::string::npos);
+    }
+
+    SECTION("records spool while the peer is down and follow a reconnect")
+    {
+        unsigned short port = 0;
+        {
+            collector probe{0};
+            port = probe.port;
+        }
+        auto sink = net_sink::tcp("127.0.0.1", port, fast_reconnect());
+        for (int i = 0; i < 5; ++i) {
+            sink->log(make_entry("rec " + std::to_string(i)));
+        }
+        REQUIRE(wait_for([&] { return sink->stats().connect_failures > 1; }));
+        REQUIRE(!sink->stats().connected);
+
+        collector coll{port};
+        REQUIRE(coll.read_until([](const std::string& d) {
+            return collector::frames(d).size() == 5;
+        }));
+        const auto frames = collector::frames(coll.data);
+        REQUIRE(frames.back().find("rec 4\n") != std::string::npos);
+        REQUIRE(sink->stats().dropped == 0);
+    }
+
+    SECTION("a full spool drops records instead of blocking")
+    {
+        unsigned short port = 0;
+        {
+            collector probe{0};
+            port = probe.port;
+        }
+        auto cfg = fast_reconnect();
+        cfg.spool_bytes = 256;
+        auto sink = net_sink::tcp("127.0.0.1", port, cfg);
+        for (int i = 0; i < 20; ++i) {
+            sink->log(make_entry("rec " + std::to_string(i)));
+        }
+        const auto st = sink->stats();
+        REQUIRE(st.dropped > 0);
+        REQUIRE(st.enqueued + st.dropped == 20);
+        REQUIRE(st.spool_peak <= cfg.spool_bytes);
+    }
+
+    SECTION("disk spillover keeps records while the peer is down")
+    {
+        unsigned short port = 0;
+        {
+            collector probe{0};
+            port = probe.port;
+        }
+        const auto spill =
+            "/tmp/ldgr-test-net-spill-" + std::to_string(::getpid());
+        ::unlink(spill.c_str());
+
+        auto cfg = fast_reconnect();
+        cfg.spool_bytes = 256;
+        cfg.spill_path = spill;
+        auto sink = net_sink::tcp("127.0.0.1", port, cfg);
+        for (int i = 0; i < 20; ++i) {
+            sink->log(make_entry("rec " + std::to_string(i)));
+            REQUIRE(wait_for([&] { return sink->stats().spool_bytes == 0; }));
+        }
+        REQUIRE(sink->stats().bytes_spilled > 0);
+
+        collector coll{port};
+        REQUIRE(coll.read_until([](const std::string& d) {
+            return collector::frames(d).size() == 20;
+        }));
+        const auto frames = collector::frames(coll.data);
+        for (int i = 0; i < 20; ++i) {
+            REQUIRE(frames[i].find("rec " + std::to_string(i) + "\n") !=
+                    std::string::npos);
+        }
+        const auto st = sink->stats();
+        REQUIRE(st.dropped == 0);
+        REQUIRE(st.bytes_replayed == st.bytes_spilled);
+        sink.reset();
+        ::unlink(spill.c_str());
+    }
+}
+
+#else
+
+TEST_CASE("netsink: basic")
+{
+    REQUIRE_THROWS_AS(net_sink::tcp("127.0.0.1", 9), std::system_error);
+}
+
+#endif
@@ -0,0 +1,171 @@
+//! @file shmring.cpp
+
+#include <ldgr/logger.hpp>
+#include <ldgr/shmring.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace ldgr;
+
+namespace {
+
+std::string ring_name(const char* tag)
+{
+    return "/ldgr-test-" + std::string(tag) + "-" + std::to_string(::getpid());
+}
+
+struct ring_reader {
+    const shm_ring& ring;
+    std::uint64_t seq = 0;
+    std::vector<char> buff = std::vector<char>(ring.max_record_size());
+    std::size_t size = 0;
+    std::uint32_t flags = 0;
+    std::uint64_t lost = 0;
+
+    shm_ring::read_status next()
+    {
+        return ring.read(seq, buff.data(), size, flags, lost);
+    }
+
+    std::string str() const
+    {
+        return std::string(buff.data(), size);
+    }
+};
+
+} // namespace
+
+TEST_CASE("shmring: basic")
+{
+    SECTION("write and read back")
+    {
+        const auto name = ring_name("basic");
+        auto ring = shm_ring::open(name, 5, 64);
+        shm_ring::unlink(name);
+        REQUIRE(ring->slot_count() == 8);
+        REQUIRE(ring->max_record_size() ==
+                64 - sizeof(shm_ring_layout::slot));
+
+        ring_reader rd{*ring};
+        REQUIRE(rd.next() == shm_ring::read_status::empty);
+
+        ring->write("one", 3);
+        ring->write("two", 3);
+        REQUIRE(rd.next() == shm_ring::read_status::ok);
+        REQUIRE(rd.str() == "one");
+        REQUIRE(rd.next() == shm_ring::read_status::ok);
+        REQUIRE(rd.str() == "two");
+        REQUIRE(rd.flags == 0);
+        REQUIRE(rd.next() == shm_ring::read_status::empty);
+    }
+
+    SECTION("oversized records are truncated")
+    {
+        const auto name = ring_name("trunc");
+        auto ring = shm_ring::open(name, 4, 64);
+        shm_ring::unlink(name);
+
+        const std::string big(200, 'x');
+        ring->write(big.data(), big.size());
+
+        ring_reader rd{*ring};
+        REQUIRE(rd.next() == shm_ring::read_status::ok);
+        REQUIRE(rd.size == ring->max_record_size());
+        REQUIRE((rd.flags & shm_ring_layout::truncated) != 0);
+    }
+
+    SECTION("a lapped reader reports lost records")
+    {
+        const auto name = ring_name("lap");
+        auto ring = shm_ring::open(name, 4, 64);
+        shm_ring::unlink(name);
+
+        for (int i = 0; i < 10; ++i) {
+            const auto rec = std::to_string(i);
+            ring->write(rec.data(), rec.size());
+        }
+
+        ring_reader rd{*ring};
+        REQUIRE(rd.next() == shm_ring::read_status::lost);
+        REQUIRE(rd.lost == 6);
+        for (int i = 6; i < 10; ++i) {
+            REQUIRE(rd.next() == shm_ring::read_status::ok);
+            REQUIRE(rd.str() == std::to_string(i));
+        }
+        REQUIRE(rd.next() == shm_ring::read_status::empty);
+    }
+
+    SECTION("attach sees the creator's records and geometry")
+    {
+        const auto name = ring_name("attach");
+        auto writer = shm_ring::open(name, 16, 128);
+        auto reader = shm_ring::attach(name);
+        auto again = shm_ring::open(name, 1024, 4096);
+        shm_ring::unlink(name);
+
+        REQUIRE(reader->slot_count() == 16);
+        REQUIRE(again->slot_count() == 16);
+        REQUIRE_THROWS_AS(shm_ring::attach(name), std::system_error);
+
+        writer->write("hello", 5);
+        ring_reader rd{*reader};
+        REQUIRE(rd.next() == shm_ring::read_status::ok);
+        REQUIRE(rd.str() == "hello");
+    }
+
+    SECTION("concurrent writers never tear records")
+    {
+        const auto name = ring_name("mt");
+        auto ring = shm_ring::open(name, 1024, 64);
+        shm_ring::unlink(name);
+
+        constexpr int n_threads = 4;
+        constexpr int n_records = 200;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < n_threads; ++t) {
+            threads.emplace_back([&ring, t] {
+                const std::string rec(16, static_cast<char>('a' + t));
+                for (int i = 0; i < n_records; ++i) {
+                    ring->write(rec.data(), rec.size());
+                }
+            });
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+
+        ring_reader rd{*ring};
+        int seen = 0;
+        while (rd.next() == shm_ring::read_status::ok) {
+            const auto rec = rd.str();
+            REQUIRE(rec.size() == 16);
+            REQUIRE(rec == std::string(16, rec[0]));
+            ++seen;
+        }
+        REQUIRE(seen == n_threads * n_records);
+    }
+
+    SECTION("shm sink")
+    {
+        const auto name = ring_name("sink");
+        auto sink = log_sink_factory::shm_sink(name, 64, 256);
+        auto reader = shm_ring::attach(name);
+        shm_ring::unlink(name);
+
+        auto& l = log_registry::get("TEST.SHM");
+        l.remove_sink(log_sink_factory::stderr_sink());
+        l.add_sink(sink);
+        LDGR_CAT_INFO("TEST.SHM", "to shared memory {}", 42);
+        l.remove_sink(sink);
+
+        ring_reader rd{*reader};
+        REQUIRE(rd.next() == shm_ring::read_status::ok);
+        REQUIRE(rd.str().find("to shared memory 42") != std::string::npos);
+    }
+}
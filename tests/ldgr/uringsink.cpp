@@ -0,0 +1,208 @@
+//! @file uringsink.cpp
+
+#include <ldgr/uringsink.hpp>
+
+#include "fixtures.hpp"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ldgr;
+using ldgr_test::make_entry;
+using ldgr_test::tmp_path;
+
+namespace {
+
+log_formatter::format_fn message_line =
+    [](log_buffer_t& buff,
+       const log_entry_fmt_cp& ent,
+       std::time_t&,
+       std::string&) {
+        fmtutil::append(buff, ent.entry.message);
+        fmtutil::append(buff, fmtutil::to_view("\n"));
+    };
+
+} // namespace
+
+TEST_CASE("uringsink: basic")
+{
+    SECTION("file sink appends")
+    {
+        tmp_path tmp{"file"};
+        {
+            auto sink = log_sink_factory::file_sink(tmp.path);
+            sink->set_formatter(std::make_shared<log_formatter>(message_line));
+            sink->log(make_entry("one"));
+        }
+        {
+            auto sink = log_sink_factory::file_sink(tmp.path);
+            sink->set_formatter(std::make_shared<log_formatter>(message_line));
+            sink->log(make_entry("two"));
+        }
+        REQUIRE(tmp.read() == "one\ntwo\n");
+        REQUIRE_THROWS_AS(log_sink_factory::file_sink("/nonexistent/x.log"),
+                          std::system_error);
+    }
+
+    SECTION("async file sink factory")
+    {
+        tmp_path tmp{"async"};
+        auto sink = log_sink_factory::async_file_sink(tmp.path);
+        sink->set_formatter(std::make_shared<log_formatter>(message_line));
+        sink->log(make_entry("hello"));
+        sink->flush();
+        REQUIRE(tmp.read() == "hello\n");
+    }
+
+    if (!uring_file_sink::available()) {
+        WARN("io_uring unavailable, skipping uring_file_sink sections");
+        return;
+    }
+
+    SECTION("records from many threads land whole and in batch order")
+    {
+        tmp_path tmp{"uring"};
+        {
+            std::ofstream{tmp.path} << "existing\n";
+        }
+        uring_sink_config cfg;
+        cfg.buffer_size = 256;
+        cfg.buffer_count = 2;
+        auto sink = uring_file_sink::create(tmp.path, cfg);
+        sink->set_formatter(std::make_shared<log_formatter>(message_line));
+
+        constexpr int n_threads = 4;
+        constexpr int n_records = 500;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < n_threads; ++t) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < n_records; ++i) {
+                    sink->log(make_entry(std::to_string(t) + ":" +
+                                         std::to_string(i)));
+                }
+            });
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+        sink->flush();
+
+        const auto lines = tmp.lines();
+        REQUIRE(lines.size() == n_threads * n_records + 1);
+        REQUIRE(lines.front() == "existing");
+        std::vector<int> next(n_threads, 0);
+        for (std::size_t i = 1; i < lines.size(); ++i) {
+            const auto colon = lines[i].find(':');
+            REQUIRE(colon != std::string::npos);
+            const int t = std::stoi(lines[i].substr(0, colon));
+            REQUIRE(std::stoi(lines[i].substr(colon + 1)) == next[t]);
+            ++next[t];
+        }
+        const auto st = sink->stats();
+        REQUIRE(st.writes > 1);
+        REQUIRE(st.bytes_written == tmp.read().size() - 9);
+    }
+
+    SECTION("oversized records are written in place")
+    {
+        tmp_path tmp{"uring-big"};
+        uring_sink_config cfg;
+        cfg.buffer_size = 64;
+        auto sink = uring_file_sink::create(tmp.path, cfg);
+        sink->set_formatter(std::make_shared<log_formatter>(message_line));
+
+        const std::string big(200, 'x');
+        sink->log(make_entry("a"));
+        sink->log(make_entry(big));
+        sink->log(make_entry("b"));
+        sink->flush();
+        REQUIRE(tmp.read() == "a\n" + big + "\nb\n");
+        const auto st = sink->stats();
+        REQUIRE(st.fallback_writes == 1);
+        REQUIRE(st.bytes_written == tmp.read().size());
+    }
+
+    SECTION("a partial batch is written after the flush interval")
+    {
+        tmp_path tmp{"uring-idle"};
+        uring_sink_config cfg;
+        cfg.flush_interval = std::chrono::milliseconds(5);
+        auto sink = uring_file_sink::create(tmp.path, cfg);
+        sink->set_formatter(std::make_shared<log_formatter>(message_line));
+        sink->log(make_entry("idle"));
+
+        const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (tmp.read().empty() &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        REQUIRE(tmp.read() == "idle\n");
+    }
+
+    SECTION("empty records and emergency flushes don't stall shutdown")
+    {
+        tmp_path tmp{"uring-empty"};
+        {
+            auto sink = uring_file_sink::create(tmp.path);
+            sink->set_formatter(std::make_shared<log_formatter>(
+                [](log_buffer_t&,
+                   const log_entry_fmt_cp&,
+                   std::time_t&,
+                   std::string&) {}));
+            sink->log(make_entry("nothing"));
+        }
+        {
+            auto sink = uring_file_sink::create(tmp.path);
+            sink->set_formatter(std::make_shared<log_formatter>(message_line));
+            sink->log(make_entry("rescued"));
+            sink->emergency_flush();
+        }
+        REQUIRE(tmp.read() == "rescued\n");
+    }
+
+    SECTION("destruction writes pending records")
+    {
+        tmp_path tmp{"uring-dtor"};
+        {
+            auto sink = uring_file_sink::create(tmp.path);
+            sink->set_formatter(std::make_shared<log_formatter>(message_line));
+            sink->log(make_entry("last words"));
+        }
+        REQUIRE(tmp.read() == "last words\n");
+    }
+}
+
+TEST_CASE("uringsink: throughput bench", "[.bench]")
+{
+    const auto entry = make_entry("a typical log message with some payload");
+
+    // file_sink is the stdio path behind stdout_sink/stderr_sink.
+    tmp_path stdio_tmp{"bench-stdio"};
+    auto stdio = log_sink_factory::file_sink(stdio_tmp.path);
+    BENCHMARK("stdio file sink")
+    {
+        stdio->log(entry);
+    };
+
+    tmp_path uring_tmp{"bench-uring"};
+    auto uring = log_sink_factory::async_file_sink(uring_tmp.path);
+    BENCHMARK("async file sink")
+    {
+        uring->log(entry);
+    };
+    uring->flush();
+
+    if (auto* u = dynamic_cast<uring_file_sink*>(uring.get())) {
+        const auto st = u->stats();
+        WARN("uring writes " << st.writes << ", producer waits "
+                             << st.producer_waits << ", registered "
+                             << st.registered_buffers);
+    }
+}